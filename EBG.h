@@ -6,6 +6,7 @@
 #pragma comment(lib, "winmm.lib")
 
 #include "EBG_graphics.h"
+#include "EBG_profiler.h"
 
 std::string GetLastErrorAsString()
 {
@@ -117,10 +118,57 @@ namespace ebg
 		MSG msg;
 	};
 
+	// render scale from the smoothed frame time: pixel cost ~ scale^2, so an overshoot scales down
+	// by sqrt(budget / time) (at most 15% a step), a clear undershoot scales back up 5% a step,
+	// a few frames of cooldown after every change let the average see the new size
+	struct resolution_controller
+	{
+		float min_scale, max_scale, scale;
+		float budget_ms, smoothed_ms;
+		unsigned cooldown;
+
+		void init(float budget, float min_s, float max_s)
+		{
+			budget_ms = budget;
+			min_scale = min_s;
+			max_scale = max_s;
+			scale = max_s;
+			smoothed_ms = 0.0f;
+			cooldown = 0;
+		}
+
+		// true when the scale changed
+		bool update(float frame_ms)
+		{
+			smoothed_ms = smoothed_ms == 0.0f ? frame_ms : smoothed_ms * 0.9f + frame_ms * 0.1f;
+
+			if (cooldown != 0)
+			{
+				cooldown--;
+				return false;
+			}
+
+			float s = scale;
+			if (smoothed_ms > budget_ms)
+				s = scale * (std::max)(sqrtf(budget_ms * 0.9f / smoothed_ms), 0.85f);
+			else if (smoothed_ms < budget_ms * 0.7f)
+				s = scale + 0.05f;
+
+			s = std::clamp(s, min_scale, max_scale);
+			if (fabsf(s - scale) < 0.01f)
+				return false;
+
+			scale = s;
+			cooldown = 8;
+			return true;
+		}
+	};
+
 	struct basic_engine
 	{
 		fpoint fdim, fhdim;
 		ipoint idim;
+		// fhdim & hdim: half of the render surface, the window (idim, fdim) with dynamic resolution off
 		upoint hdim;
 
 		float ratio, inv_ratio;
@@ -133,6 +181,17 @@ namespace ebg
 		abc_keyboard keyboard;
 		float* depth_buffer;
 		graphics::surface surface;
+		// row-major copy of a tiled surface, same as surface.buffer otherwise
+		color_t* present_buffer;
+		// gets every presented frame (streaming, recording), null = none
+		void (*frame_sink)(void* data, const color_t* colors, upoint dim);
+		void* frame_sink_data;
+
+		// dynamic resolution: surface is drawn smaller than idim & upscaled into present_buffer
+		bool dynamic_resolution;
+		resolution_controller resolution;
+		// row-major copy of a tiled surface before upscaling
+		color_t* scale_buffer;
 		HWND window;
 
 		win_data data;
@@ -148,9 +207,9 @@ namespace ebg
 			GetCursorPos(&mouse.win_pos);
 			ScreenToClient(window, &mouse.win_pos);
 			mouse.old_pos = mouse.pos;
-			mouse.pos = ipoint(mouse.win_pos.x, surface.dim.y - mouse.win_pos.y);
+			mouse.pos = ipoint(mouse.win_pos.x, idim.y - mouse.win_pos.y);
 			mouse.delta = mouse.pos - mouse.old_pos;
-			mouse.in_screen = is_inside(mouse.pos, surface.dim);
+			mouse.in_screen = is_inside(mouse.pos, upoint(idim));
 		}
 
 		inline void refresh_mouse_ticks()
@@ -163,8 +222,12 @@ namespace ebg
 		// auto updates mouse
 		void start_tick()
 		{
+			EBG_PROFILE_FRAME_BEGIN();
 			start_time = timeGetTime();
 
+			if (window == nullptr)
+				return;
+
 			while (PeekMessageW(&data.msg, window, 0, 0, PM_REMOVE))
 			{
 				TranslateMessage(&data.msg);
@@ -176,20 +239,47 @@ namespace ebg
 
 		void end_tick()
 		{
-			StretchDIBits(
-				data.hdc,
-				0, 0, idim.x, idim.y,
-				0, 0, idim.x, idim.y,
-				surface.buffer, &data.bitmap_info,
-				DIB_RGB_COLORS, SRCCOPY
-			);
+			EBG_STATS_FRAME_END(surface.buffer, surface.buffer_size);
+
+			{
+				EBG_PROFILE_SCOPE(spresent);
+
+				if (dynamic_resolution)
+				{
+					const color_t* src = surface.buffer;
+					if (surface.x_offsets != nullptr)
+					{
+						graphics::detile(&surface, scale_buffer);
+						src = scale_buffer;
+					}
+					graphics::upscale_bilinear(src, surface.dim, present_buffer, idim);
+				}
+				else if (surface.x_offsets != nullptr)
+					graphics::detile(&surface, present_buffer);
+
+				if (window != nullptr)
+					StretchDIBits(
+						data.hdc,
+						0, 0, idim.x, idim.y,
+						0, 0, idim.x, idim.y,
+						present_buffer, &data.bitmap_info,
+						DIB_RGB_COLORS, SRCCOPY
+					);
+
+				// the size of present_buffer: the window's after an upscale
+				if (frame_sink != nullptr)
+					frame_sink(frame_sink_data, present_buffer, dynamic_resolution ? upoint(idim) : surface.dim);
+			}
 
 			refresh_mouse_ticks();
 
 			real_dt = timeGetTime() - start_time;
 			if (real_dt < target_frame_time)
 			{
-				Sleep(target_frame_time - real_dt);
+				{
+					EBG_PROFILE_SCOPE(ssleep);
+					Sleep(target_frame_time - real_dt);
+				}
 				udt = target_frame_time;
 				delta_time = target_delta_time;
 			}
@@ -199,20 +289,26 @@ namespace ebg
 				delta_time = static_cast<float>(udt) * inv_dt_multipler;
 			}
 			tick++;
+
+			if (dynamic_resolution && resolution.update(static_cast<float>(real_dt)))
+				set_render_scale(resolution.scale);
+
+			EBG_PROFILE_FRAME_END();
 		}
 
 		basic_engine() {}
 
-		basic_engine(const char* title, upoint window_dimension, bool console, int fps,
-			WNDPROC event_handler, HINSTANCE hInstance, bool alloc_depth_buffer = false)
+		// surface_tile_log2: 0 = row-major, 2 = 4x4 tiles, 3 = 8x8 tiles (depth buffer follows the surface)
+		void init(upoint window_dimension, int fps, bool alloc_depth_buffer, unsigned surface_tile_log2)
 		{
 			tick = real_dt = start_time = udt = 0L;
 			delta_time = .0f;
-			has_console = console;
+			has_console = false;
 			running = false;
+			// fps 0: no frame cap
 			target_fps = fps;
-			target_frame_time = 1000 / fps;
-			target_delta_time = dt_multipler / static_cast<float>(fps);
+			target_frame_time = fps != 0 ? 1000 / fps : 0;
+			target_delta_time = fps != 0 ? dt_multipler / static_cast<float>(fps) : .0f;
 
 			memset(keyboard.keys, 0, 26);
 			memset(&mouse.left, 0, 6);
@@ -227,11 +323,60 @@ namespace ebg
 			ratio = fdim.x / fdim.y;
 			inv_ratio = fdim.y / fdim.x;
 
-			surface = graphics::surface(window_dimension);
+			surface = graphics::surface(window_dimension, true, surface_tile_log2);
+			present_buffer = surface_tile_log2 != 0 ? TYPE_MALLOC(color_t, window_dimension.x * window_dimension.y) : surface.buffer;
 
 			depth_buffer = alloc_depth_buffer == true ? TYPE_MALLOC(float, surface.buffer_size) : nullptr;
 
 			window = nullptr;
+			frame_sink = nullptr;
+			frame_sink_data = nullptr;
+
+			dynamic_resolution = false;
+			scale_buffer = nullptr;
+		}
+
+		// surface (and its half dims) at scale of the window, even sizes
+		void set_render_scale(float scale)
+		{
+			upoint dim(
+				(std::max)(static_cast<unsigned>(fdim.x * scale) & ~1U, 2U),
+				(std::max)(static_cast<unsigned>(fdim.y * scale) & ~1U, 2U));
+
+			graphics::resize_surface(&surface, upoint((std::min)(dim.x, unsigned(idim.x)), (std::min)(dim.y, unsigned(idim.y))));
+
+			hdim = surface.dim >> 1U;
+			fhdim = fpoint(surface.dim) * 0.5f;
+		}
+
+		// keeps target_fps by drawing into a smaller surface (min_scale..max_scale of the window) and
+		// upscaling it on present, needs a frame cap; the app keeps drawing into surface as before
+		void enable_dynamic_resolution(float min_scale = 0.5f, float max_scale = 1.0f)
+		{
+			assert(target_frame_time != 0 && min_scale > 0.0f && min_scale <= max_scale && max_scale <= 1.0f);
+
+			if (present_buffer == surface.buffer)
+				present_buffer = TYPE_MALLOC(color_t, idim.x * idim.y);
+			if (surface.x_offsets != nullptr && scale_buffer == nullptr)
+				scale_buffer = TYPE_MALLOC(color_t, idim.x * idim.y);
+
+			dynamic_resolution = true;
+			resolution.init(static_cast<float>(target_frame_time), min_scale, max_scale);
+			set_render_scale(max_scale);
+		}
+
+		// headless: no window, console or messages, only the surface & depth buffer (benchmarks, captures)
+		basic_engine(upoint dimension, int fps, bool alloc_depth_buffer = true, unsigned surface_tile_log2 = 0)
+		{
+			init(dimension, fps, alloc_depth_buffer, surface_tile_log2);
+			running = true;
+		}
+
+		basic_engine(const char* title, upoint window_dimension, bool console, int fps,
+			WNDPROC event_handler, HINSTANCE hInstance, bool alloc_depth_buffer = false, unsigned surface_tile_log2 = 0)
+		{
+			init(window_dimension, fps, alloc_depth_buffer, surface_tile_log2);
+			has_console = console;
 
 			if (console)
 			{
@@ -296,9 +441,22 @@ namespace ebg
 			FreeConsole();
 		}
 
-		ReleaseDC(be->window, be->data.hdc);
-		DestroyWindow(be->window);
-		UnregisterClassA(be->data.wndc.lpszClassName, be->data.wndc.hInstance);
+		if (be->window != nullptr)
+		{
+			ReleaseDC(be->window, be->data.hdc);
+			DestroyWindow(be->window);
+			UnregisterClassA(be->data.wndc.lpszClassName, be->data.wndc.hInstance);
+		}
+
+		free(be->depth_buffer);
+		be->depth_buffer = nullptr;
+
+		if (be->present_buffer != be->surface.buffer)
+			free(be->present_buffer);
+		be->present_buffer = nullptr;
+
+		free(be->scale_buffer);
+		be->scale_buffer = nullptr;
 
 		graphics::delete_surface(&be->surface);
 	}
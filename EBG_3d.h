@@ -5,8 +5,11 @@
 #define _USE_MATH_DEFINES
 #include <math.h>
 
+#include <array>
 #include <fstream>
 
+#include "EBG_threads.h"
+
 /*
 TODO:
 ok  Mesh rot, local_rotation_center
@@ -49,6 +52,7 @@ namespace eb3d
 
 	typedef vec3<float> vertex_t;
 	typedef unsigned short index16_t;
+	typedef unsigned index32_t;
 
 	namespace basic_math
 	{
@@ -77,44 +81,314 @@ namespace eb3d
 		}
 	}
 
+	/*
+	sin & cos of rotations, 3 methods (sincos::method, default mpolynomial):
+	mtable         nearest entry of a 2^n table (the old lookup), error ~pi / 2^n
+	minterpolated  linear interpolation between table entries, error ~(2 pi / 2^n)^2 / 8 (3e-7 at n = 12)
+	mpolynomial    range reduction to [-pi/4, pi/4] & minimax polynomials, no table, error ~1e-7,
+	               4 angles at a time (SSE2) in batch
+	negative angles wrap like positive ones on every method
+
+	the table is computed by init, or compiled in with EBG_SINCOS_CONSTEXPR = n (its log2 resolution)
+	*/
 	namespace sincos
 	{
-		float* sin_hash_table, multipler, inv_multipler;
-		unsigned resolution, res_4;
+		enum methods
+		{
+			mtable = 0,
+			minterpolated = 1,
+			mpolynomial = 2
+		};
+
+		uint8_t method = mpolynomial;
+
+		const float* sin_hash_table;
+		float multipler, inv_multipler;
+		unsigned resolution, res_4, mask;
+
+		// sin(2 pi i / resolution) from a Taylor series on [-pi/2, pi/2], also at compile time
+		constexpr float table_entry(unsigned i, unsigned resolution)
+		{
+			constexpr double pi = 3.14159265358979323846;
+
+			// i / resolution in [-1/2, 1/2) turns, mirrored into [-1/4, 1/4]
+			double t = static_cast<double>(i) / static_cast<double>(resolution);
+			if (t >= 0.5)
+				t -= 1.0;
+			if (t > 0.25)
+				t = 0.5 - t;
+			else if (t < -0.25)
+				t = -0.5 - t;
+
+			double x = t * 2.0 * pi, x2 = x * x;
+
+			// x (1 - x^2/(2*3) (1 - x^2/(4*5) (1 - ...)))
+			double term = 1.0;
+			for (int n = 21; n >= 3; n -= 2)
+				term = 1.0 - x2 / static_cast<double>((n - 1) * n) * term;
+			return static_cast<float>(x * term);
+		}
+
+		template <unsigned short log2_resolution>
+		constexpr std::array<float, 1U << log2_resolution> make_table()
+		{
+			std::array<float, 1U << log2_resolution> table = {};
+			for (unsigned i = 0; i < (1U << log2_resolution); i++)
+				table[i] = table_entry(i, 1U << log2_resolution);
+			return table;
+		}
+
+#ifdef EBG_SINCOS_CONSTEXPR
+		constexpr std::array<float, 1U << EBG_SINCOS_CONSTEXPR> static_table = make_table<EBG_SINCOS_CONSTEXPR>();
+#endif
 
 		void init(unsigned short log2_resolution)
 		{
 			resolution = 1 << log2_resolution;
 			res_4 = resolution >> 2;
-
-			sin_hash_table = TYPE_MALLOC(float, resolution);
-			assert(sin_hash_table != nullptr);
+			mask = resolution - 1;
 
 			multipler = basic_math::mulby2power(M_1_2PI, log2_resolution);
 			inv_multipler = basic_math::mulby2power(M_2PI, -log2_resolution);
 
+#ifdef EBG_SINCOS_CONSTEXPR
+			if (log2_resolution == EBG_SINCOS_CONSTEXPR)
+			{
+				sin_hash_table = static_table.data();
+				return;
+			}
+#endif
+
+			float* table = TYPE_MALLOC(float, resolution);
+			assert(table != nullptr);
+
 			for (unsigned i = 0; i < resolution; i++)
-				sin_hash_table[i] = sinf(static_cast<float>(i) * inv_multipler);
+				table[i] = table_entry(i, resolution);
+			sin_hash_table = table;
+		}
+
+		inline void table_sincosf(float x, float& sinv, float& cosv)
+		{
+			// signed & rounded to the nearest entry, the mask wraps negative indexes
+			int t = static_cast<int>(floorf(x * multipler + 0.5f));
+			sinv = sin_hash_table[t & mask];
+			cosv = sin_hash_table[(t + res_4) & mask];
+		}
+
+		inline void interpolated_sincosf(float x, float& sinv, float& cosv)
+		{
+			float f = x * multipler, whole = floorf(f), w = f - whole;
+			int t = static_cast<int>(whole);
+
+			float s0 = sin_hash_table[t & mask], s1 = sin_hash_table[(t + 1) & mask],
+				c0 = sin_hash_table[(t + res_4) & mask], c1 = sin_hash_table[(t + res_4 + 1) & mask];
+			sinv = s0 + (s1 - s0) * w;
+			cosv = c0 + (c1 - c0) * w;
+		}
+
+		// Cody-Waite pi/2 in two parts & the minimax coefficients on [-pi/4, pi/4] (Cephes sinf/cosf)
+		constexpr float two_over_pi = 0.636619772367581f, pi_2_hi = 1.5707963705062866f, pi_2_lo = -4.371139000186243e-8f,
+			s1 = -1.6666654611e-1f, s2 = 8.3321608736e-3f, s3 = -1.9515295891e-4f,
+			c1 = 4.166664568298827e-2f, c2 = -1.388731625493765e-3f, c3 = 2.443315711809948e-5f;
+
+		inline void polynomial_sincosf(float x, float& sinv, float& cosv)
+		{
+			float q = floorf(x * two_over_pi + 0.5f);
+			float r = (x - q * pi_2_hi) - q * pi_2_lo, r2 = r * r;
+
+			float s = r + r * r2 * (s1 + r2 * (s2 + r2 * s3)),
+				c = 1.0f - 0.5f * r2 + r2 * r2 * (c1 + r2 * (c2 + r2 * c3));
+
+			// quadrant: (s, c), (c, -s), (-s, -c), (-c, s)
+			int quadrant = static_cast<int>(q) & 3;
+			sinv = quadrant & 1 ? c : s;
+			cosv = quadrant & 1 ? s : c;
+			if (quadrant & 2)
+				sinv = -sinv;
+			if ((quadrant + 1) & 2)
+				cosv = -cosv;
+		}
+
+		inline void sincosf(float x, float& sinv, float& cosv)
+		{
+			switch (method)
+			{
+			case mtable:
+				table_sincosf(x, sinv, cosv);
+				return;
+			case minterpolated:
+				interpolated_sincosf(x, sinv, cosv);
+				return;
+			default:
+				polynomial_sincosf(x, sinv, cosv);
+				return;
+			}
 		}
 
 		inline float sinf(float x)
 		{
-			return sin_hash_table[static_cast<unsigned>(x * multipler) % resolution];
+			float s, c;
+			sincosf(x, s, c);
+			return s;
 		}
 
 		inline float cosf(float x)
 		{
-			return sin_hash_table[(static_cast<unsigned>(x * multipler) + res_4) % resolution];
+			float s, c;
+			sincosf(x, s, c);
+			return c;
 		}
 
-		inline void sincosf(float x, float& sinv, float& cosv)
+		// sin & cos of amount angles with the current method
+		void batch(const float* angles, float* sines, float* cosines, unsigned amount)
 		{
-			unsigned t = static_cast<unsigned>(x * multipler);
-			sinv = sin_hash_table[t % resolution];
-			cosv = sin_hash_table[(t + res_4) % resolution];
+			unsigned i = 0;
+
+			if (method == mpolynomial)
+			{
+				const __m128 k_two_over_pi = _mm_set1_ps(two_over_pi), k_hi = _mm_set1_ps(pi_2_hi), k_lo = _mm_set1_ps(pi_2_lo),
+					k_half = _mm_set1_ps(0.5f), k_one = _mm_set1_ps(1.0f);
+				const __m128i one = _mm_set1_epi32(1), two = _mm_set1_epi32(2);
+
+				for (; i + 4 <= amount; i += 4)
+				{
+					__m128 x = _mm_loadu_ps(angles + i);
+
+					// round to nearest (the default MXCSR mode)
+					__m128i qi = _mm_cvtps_epi32(_mm_mul_ps(x, k_two_over_pi));
+					__m128 q = _mm_cvtepi32_ps(qi);
+					__m128 r = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(q, k_hi)), _mm_mul_ps(q, k_lo)), r2 = _mm_mul_ps(r, r);
+
+					__m128 s = _mm_add_ps(r, _mm_mul_ps(_mm_mul_ps(r, r2),
+						_mm_add_ps(_mm_set1_ps(s1), _mm_mul_ps(r2, _mm_add_ps(_mm_set1_ps(s2), _mm_mul_ps(r2, _mm_set1_ps(s3)))))));
+					__m128 c = _mm_add_ps(_mm_sub_ps(k_one, _mm_mul_ps(k_half, r2)), _mm_mul_ps(_mm_mul_ps(r2, r2),
+						_mm_add_ps(_mm_set1_ps(c1), _mm_mul_ps(r2, _mm_add_ps(_mm_set1_ps(c2), _mm_mul_ps(r2, _mm_set1_ps(c3)))))));
+
+					__m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(qi, one), one));
+					__m128 sin_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(qi, two), 30)),
+						cos_sign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(qi, one), two), 30));
+
+					__m128 sv = _mm_or_ps(_mm_and_ps(swap, c), _mm_andnot_ps(swap, s)),
+						cv = _mm_or_ps(_mm_and_ps(swap, s), _mm_andnot_ps(swap, c));
+					_mm_storeu_ps(sines + i, _mm_xor_ps(sv, sin_sign));
+					_mm_storeu_ps(cosines + i, _mm_xor_ps(cv, cos_sign));
+				}
+			}
+
+			for (; i < amount; i++)
+				sincosf(angles[i], sines[i], cosines[i]);
 		}
 	}
 
+	/*
+	unit quaternion rotation, same meaning as the euler XYZ of rotation_data (x first, then y, then z),
+	a * b rotates by b then a, slerp interpolates on the shortest arc at constant speed
+	*/
+	struct quaternion
+	{
+		float w, x, y, z;
+
+		static inline quaternion identity()
+		{
+			return { 1.0f, 0.0f, 0.0f, 0.0f };
+		}
+
+		static quaternion from_axis_angle(fvec3 axis, float angle)
+		{
+			float s, c;
+			sincos::sincosf(angle * 0.5f, s, c);
+			s /= sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+			return { c, axis.x * s, axis.y * s, axis.z * s };
+		}
+
+		// qz * qy * qx
+		static quaternion from_euler(fvec3 rotation)
+		{
+			float sx, cx, sy, cy, sz, cz;
+			sincos::sincosf(rotation.x * 0.5f, sx, cx);
+			sincos::sincosf(rotation.y * 0.5f, sy, cy);
+			sincos::sincosf(rotation.z * 0.5f, sz, cz);
+
+			return {
+				cz * cy * cx + sz * sy * sx,
+				cz * cy * sx - sz * sy * cx,
+				cz * sy * cx + sz * cy * sx,
+				sz * cy * cx - cz * sy * sx
+			};
+		}
+
+		inline quaternion operator*(const quaternion& b) const
+		{
+			return {
+				w * b.w - x * b.x - y * b.y - z * b.z,
+				w * b.x + x * b.w + y * b.z - z * b.y,
+				w * b.y - x * b.z + y * b.w + z * b.x,
+				w * b.z + x * b.y - y * b.x + z * b.w
+			};
+		}
+
+		inline quaternion conjugate() const
+		{
+			return { w, -x, -y, -z };
+		}
+
+		inline float dot(const quaternion& b) const
+		{
+			return w * b.w + x * b.x + y * b.y + z * b.z;
+		}
+
+		// composing many rotations drifts off unit length
+		inline quaternion normalized() const
+		{
+			float inv = 1.0f / sqrtf(dot(*this));
+			return { w * inv, x * inv, y * inv, z * inv };
+		}
+
+		static quaternion slerp(const quaternion& a, quaternion b, float t)
+		{
+			float d = a.dot(b);
+			if (d < 0.0f)
+			{
+				b = { -b.w, -b.x, -b.y, -b.z };
+				d = -d;
+			}
+
+			// nearly parallel: nlerp (sin of the angle -> 0)
+			float wa = 1.0f - t, wb = t;
+			if (d < 0.9995f)
+			{
+				float angle = acosf(d), inv_sin = 1.0f / sinf(angle);
+				wa = sinf(wa * angle) * inv_sin;
+				wb = sinf(wb * angle) * inv_sin;
+			}
+
+			return quaternion{ a.w * wa + b.w * wb, a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb }.normalized();
+		}
+
+		fvec3 rotate(fvec3 v) const
+		{
+			// v + 2 w (q x v) + 2 q x (q x v)
+			fvec3 q(x, y, z), t = fvec3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x) * 2.0f;
+			return v + t * w + fvec3(q.y * t.z - q.z * t.y, q.z * t.x - q.x * t.z, q.x * t.y - q.y * t.x);
+		}
+
+		// row major rotation matrix
+		void matrix(float m[9]) const
+		{
+			float xx = x * x, yy = y * y, zz = z * z, xy = x * y, xz = x * z, yz = y * z, wx = w * x, wy = w * y, wz = w * z;
+
+			m[0] = 1.0f - 2.0f * (yy + zz);
+			m[1] = 2.0f * (xy - wz);
+			m[2] = 2.0f * (xz + wy);
+			m[3] = 2.0f * (xy + wz);
+			m[4] = 1.0f - 2.0f * (xx + zz);
+			m[5] = 2.0f * (yz - wx);
+			m[6] = 2.0f * (xz - wy);
+			m[7] = 2.0f * (yz + wx);
+			m[8] = 1.0f - 2.0f * (xx + yy);
+		}
+	};
+
 	// EULAR -ZYX
 	struct reverse_inverse_rotation_data
 	{
@@ -123,8 +397,18 @@ namespace eb3d
 		float c[9];
 		float t[4];
 
+		// bumped when update rebuilds the matrix (rotation changed), 0 = never built
+		unsigned version = 0;
+		fvec3 built_rotation;
+
 		void update()
 		{
+			if (version != 0 && rotation == built_rotation)
+				return;
+
+			built_rotation = rotation;
+			version++;
+
 			sincos::sincosf(-rotation.x, sinv.x, cosv.x);
 			sincos::sincosf(-rotation.y, sinv.y, cosv.y);
 			sincos::sincosf(-rotation.z, sinv.z, cosv.z);
@@ -160,11 +444,37 @@ namespace eb3d
 			};
 		}
 
+		// the inverse of orientation (a camera's orientation in the world) instead of the euler angles,
+		// kept until rotation changes, version is bumped only when the matrix changed
+		void set(const quaternion& orientation)
+		{
+			float m[9], n[9];
+			orientation.matrix(m);
+
+			// transposed, n[1] & n[5] are stored negated
+			n[0] = m[0];
+			n[1] = -m[3];
+			n[2] = m[6];
+			n[3] = m[1];
+			n[4] = m[4];
+			n[5] = -m[7];
+			n[6] = m[2];
+			n[7] = m[5];
+			n[8] = m[8];
+
+			built_rotation = rotation;
+			if (version != 0 && memcmp(c, n, sizeof(c)) == 0)
+				return;
+
+			memcpy(c, n, sizeof(c));
+			version++;
+		}
+
 		inline fvec3 normal_forward() const
 		{
 			return {
-				t[3] - t[2] * sinv.y,
-				t[1] + t[0] * sinv.y,
+				c[6],
+				c[7],
 				c[8]
 			};
 		}
@@ -174,7 +484,7 @@ namespace eb3d
 			return {
 				c[0],
 				c[1],
-				sinv.y
+				c[2]
 			};
 		}
 	};
@@ -187,6 +497,10 @@ namespace eb3d
 		float c[9];
 		float t[4];
 
+		// bumped when update rebuilds the matrix (rotation changed), 0 = never built
+		unsigned version = 0;
+		fvec3 built_rotation;
+
 		fvec3 old_rotate_vertex(fvec3 pos) const
 		{
 			float t = pos.y;
@@ -206,9 +520,20 @@ namespace eb3d
 
 		void update()
 		{
+			if (version != 0 && rotation == built_rotation)
+				return;
+
 			sincos::sincosf(rotation.x, sinv.x, cosv.x);
 			sincos::sincosf(rotation.y, sinv.y, cosv.y);
 			sincos::sincosf(rotation.z, sinv.z, cosv.z);
+			build();
+		}
+
+		// the matrix from sinv & cosv
+		void build()
+		{
+			built_rotation = rotation;
+			version++;
 
 			t[0] = sinv.x * sinv.z;
 			t[1] = cosv.x * cosv.z;
@@ -241,6 +566,38 @@ namespace eb3d
 			};
 		}
 
+		// the matrix of orientation instead of the euler angles, kept until rotation changes
+		// (sinv, cosv & t aren't updated), version is bumped only when the matrix changed
+		void set(const quaternion& orientation)
+		{
+			float m[9];
+			orientation.matrix(m);
+			m[6] = -m[6];
+
+			built_rotation = rotation;
+			if (version != 0 && memcmp(c, m, sizeof(c)) == 0)
+				return;
+
+			memcpy(c, m, sizeof(c));
+			version++;
+		}
+
+		// transposed rotate_vertex
+		fvec3 inverse_rotate_vertex(fvec3 pos) const
+		{
+			return {
+				c[0] * pos.x +
+				c[3] * pos.y -
+				c[6] * pos.z,
+				c[1] * pos.x +
+				c[4] * pos.y +
+				c[7] * pos.z,
+				c[2] * pos.x +
+				c[5] * pos.y +
+				c[8] * pos.z
+			};
+		}
+
 		inline fvec3 forward() const
 		{
 			return {
@@ -311,16 +668,224 @@ namespace eb3d
 		*/
 	};
 
-	struct triangle
+	// update of many rotations: the sin & cos of all changed angles in one sincos::batch,
+	// the buffers are kept from frame to frame (they only grow)
+	struct rotation_batch
+	{
+		std::vector<rotation_data*> changed;
+		std::vector<float> angles, sines, cosines;
+
+		void update(rotation_data* const* rotations, unsigned amount)
+		{
+			changed.clear();
+			for (unsigned i = 0; i < amount; i++)
+				if (rotations[i]->version == 0 || rotations[i]->rotation != rotations[i]->built_rotation)
+					changed.push_back(rotations[i]);
+
+			unsigned angle_amount = static_cast<unsigned>(changed.size()) * 3;
+			if (angles.size() < angle_amount)
+			{
+				angles.resize(angle_amount);
+				sines.resize(angle_amount);
+				cosines.resize(angle_amount);
+			}
+
+			for (size_t i = 0; i < changed.size(); i++)
+			{
+				angles[i * 3] = changed[i]->rotation.x;
+				angles[i * 3 + 1] = changed[i]->rotation.y;
+				angles[i * 3 + 2] = changed[i]->rotation.z;
+			}
+
+			sincos::batch(angles.data(), sines.data(), cosines.data(), angle_amount);
+
+			for (size_t i = 0; i < changed.size(); i++)
+			{
+				changed[i]->sinv = fvec3(sines[i * 3], sines[i * 3 + 1], sines[i * 3 + 2]);
+				changed[i]->cosv = fvec3(cosines[i * 3], cosines[i * 3 + 1], cosines[i * 3 + 2]);
+				changed[i]->build();
+			}
+		}
+	};
+
+	// rotation_batch::update with the batch of the calling thread
+	void update_rotations(rotation_data* const* rotations, unsigned amount)
+	{
+		thread_local rotation_batch batch;
+		batch.update(rotations, amount);
+	}
+
+	template <typename index_t>
+	struct basic_triangle
 	{
 		// indexes of vertices
-		index16_t a, b, c;
+		index_t a, b, c;
 		// fvec3 normal; // TODO: add triangle center ??
 		float inv_normal_length;
-		// TODO: normals
+		// unit normals: compound_mesh::planes
 	};
 
-	class compound_mesh;
+	// 16 bit indexes for meshes up to 65536 vertices & triangles, 32 bit for larger ones
+	typedef basic_triangle<index16_t> triangle;
+	typedef basic_triangle<index32_t> triangle32;
+
+	/*
+	Triangle & vertex order for locality of the world_vertices gathers (Tipsify, Sander et al. 2007)
+
+	triangles are emitted fanning around a vertex, the next fan is the recently used vertex with live triangles
+	that stays longest in a cache_size FIFO, dead ends go back through the recent vertices,
+	then vertices are renumbered in first use order (unused ones last)
+	*/
+	namespace mesh_order
+	{
+		// compound_mesh(file) reorders what it loads, off: no measurable gain on the bundled meshes
+		// (they stay in L2, and the files are mostly in grid order) & the draw order changes ties
+		bool on_import = false;
+
+		// average cache miss ratio: vertices missing a FIFO of cache_size per triangle (0.5 - 3)
+		template <typename index_t>
+		float acmr(const basic_triangle<index_t>* triangles, unsigned triangle_amount, unsigned vertex_amount, unsigned cache_size = 16)
+		{
+			if (triangle_amount == 0)
+				return 0.0f;
+
+			// a vertex is cached while it entered less than cache_size misses ago
+			std::vector<unsigned> entered(vertex_amount, 0);
+			unsigned misses = 0;
+
+			for (unsigned i = 0; i < triangle_amount; i++)
+				for (index_t v : { triangles[i].a, triangles[i].b, triangles[i].c })
+					if (entered[v] == 0 || misses - entered[v] >= cache_size)
+						entered[v] = ++misses;
+
+			return static_cast<float>(misses) / static_cast<float>(triangle_amount);
+		}
+
+		template <typename index_t>
+		// uvs: texture coordinates moved along with the vertices, or nullptr
+		void optimize(basic_triangle<index_t>* triangles, unsigned triangle_amount, vertex_t* vertices, unsigned vertex_amount,
+			fpoint* uvs = nullptr, unsigned cache_size = 16)
+		{
+			if (triangle_amount == 0)
+				return;
+
+			// triangles of every vertex
+			std::vector<unsigned> first(vertex_amount + 1, 0), adjacent(triangle_amount * 3);
+			for (unsigned i = 0; i < triangle_amount; i++)
+				for (index_t v : { triangles[i].a, triangles[i].b, triangles[i].c })
+					first[v + 1]++;
+			for (unsigned v = 0; v < vertex_amount; v++)
+				first[v + 1] += first[v];
+
+			std::vector<unsigned> live(vertex_amount), fill(first.begin(), first.end() - 1);
+			for (unsigned i = 0; i < triangle_amount; i++)
+				for (index_t v : { triangles[i].a, triangles[i].b, triangles[i].c })
+					adjacent[fill[v]++] = i;
+			for (unsigned v = 0; v < vertex_amount; v++)
+				live[v] = first[v + 1] - first[v];
+
+			std::vector<unsigned> stamp(vertex_amount, 0), dead_ends, candidates, order;
+			std::vector<bool> emitted(triangle_amount, false);
+			order.reserve(triangle_amount);
+
+			unsigned time = cache_size + 1, cursor = 0;
+			int fan = 0;
+
+			while (fan >= 0)
+			{
+				candidates.clear();
+
+				for (unsigned k = first[fan]; k < first[fan + 1]; k++)
+				{
+					unsigned t = adjacent[k];
+					if (emitted[t])
+						continue;
+
+					for (index_t v : { triangles[t].a, triangles[t].b, triangles[t].c })
+					{
+						dead_ends.push_back(v);
+						candidates.push_back(v);
+						live[v]--;
+
+						if (time - stamp[v] > cache_size)
+							stamp[v] = time++;
+					}
+
+					emitted[t] = true;
+					order.push_back(t);
+				}
+
+				// candidate still in the cache after its live triangles are emitted, the oldest first,
+				// none (all would leave the cache) goes to the dead ends
+				fan = -1;
+				int best = 0;
+				for (unsigned v : candidates)
+				{
+					if (live[v] == 0)
+						continue;
+
+					int priority = time - stamp[v] + 2 * live[v] <= cache_size ? time - stamp[v] : 0;
+					if (priority > best)
+					{
+						best = priority;
+						fan = v;
+					}
+				}
+
+				// dead end: a recent vertex with live triangles, else the next one in order
+				while (fan < 0 && dead_ends.empty() == false)
+				{
+					unsigned v = dead_ends.back();
+					dead_ends.pop_back();
+					if (live[v] != 0)
+						fan = v;
+				}
+
+				for (; fan < 0 && cursor < vertex_amount; cursor++)
+					if (live[cursor] != 0)
+						fan = cursor;
+			}
+
+			// renumber the vertices in first use order
+			std::vector<basic_triangle<index_t>> sorted(triangle_amount);
+			std::vector<vertex_t> moved(vertex_amount);
+			std::vector<fpoint> moved_uvs(uvs != nullptr ? vertex_amount : 0);
+			std::vector<int> remap(vertex_amount, -1);
+			unsigned next = 0;
+
+			for (unsigned i = 0; i < triangle_amount; i++)
+			{
+				basic_triangle<index_t> tri = triangles[order[i]];
+				for (index_t* v : { &tri.a, &tri.b, &tri.c })
+				{
+					if (remap[*v] < 0)
+					{
+						remap[*v] = next;
+						if (uvs != nullptr)
+							moved_uvs[next] = uvs[*v];
+						moved[next++] = vertices[*v];
+					}
+					*v = static_cast<index_t>(remap[*v]);
+				}
+				sorted[i] = tri;
+			}
+
+			for (unsigned v = 0; v < vertex_amount; v++)
+				if (remap[v] < 0)
+				{
+					if (uvs != nullptr)
+						moved_uvs[next] = uvs[v];
+					moved[next++] = vertices[v];
+				}
+
+			std::copy(sorted.begin(), sorted.end(), triangles);
+			std::copy(moved.begin(), moved.end(), vertices);
+			std::copy(moved_uvs.begin(), moved_uvs.end(), uvs);
+		}
+	}
+
+	template <typename index_t>
+	class basic_compound_mesh;
 
 	struct camera
 	{
@@ -357,7 +922,10 @@ namespace eb3d
 			return fvec2(v.x * t, v.y * t);
 		}
 
-		void draw_triangle(compound_mesh* mesh, index16_t index, basic_engine* engine) const;
+		// id: nonzero draws it flat instead of the shaded triangle (ids of EBG_visibility.h),
+		// the second triangle of a 2 in 1 out near clip as id | clipped_half_id
+		template <typename index_t>
+		void draw_triangle(basic_compound_mesh<index_t>* mesh, index_t index, basic_engine* engine, color_t id = 0) const;
 	};
 
 	/*
@@ -418,124 +986,754 @@ namespace eb3d
 			bm, bc;
 	};
 
-	class compound_mesh
+	// local vertex quantized against the mesh's bounding box (compound_mesh::quantize)
+	struct packed_vertex
+	{
+		uint16_t x, y, z;
+	};
+
+	// compound_mesh(file) quantizes what it loads
+	bool quantize_on_import = false;
+
+	// normalized, of the camera independent lighting, meshes relight at their next update when it changes
+	fvec3 light_direction = normalize(fvec3(-1.0f, 1.0f, -1.0f));
+
+	enum light_types
+	{
+		ldirectional = 0,
+		lpoint = 1
+	};
+
+	/*
+	directional: vector is the unit direction towards the light (like light_direction),
+	point: vector is the position, intensity / (1 + falloff * distance^2)
+	a point's lightning is the sum of intensity * dot(normal, towards the light) of all lights,
+	signed like light_direction's, bccd maps it to the color
+	*/
+	struct light
+	{
+		fvec3 vector;
+		float intensity, falloff;
+		uint8_t type;
+	};
+
+	inline bool operator==(const light& a, const light& b)
+	{
+		return a.vector == b.vector && a.intensity == b.intensity && a.falloff == b.falloff && a.type == b.type;
+	}
+
+	// in world space, meshes relight at their next update when they (or the mesh's transform) change,
+	// empty: gouraud meshes have light_direction alone, flat ones the old local space light_direction
+	std::vector<light> lights;
+
+	// lightning of 4 points p with unit normals n, lights in the space of the points
+	inline __m128 light_points(const light* lights, unsigned amount, __m128 px, __m128 py, __m128 pz, __m128 nx, __m128 ny, __m128 nz)
+	{
+		__m128 sum = _mm_setzero_ps();
+
+		for (unsigned i = 0; i < amount; i++)
+		{
+			light l = lights[i];
+
+			if (l.type == ldirectional)
+			{
+				sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(l.intensity), _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(nx, _mm_set1_ps(l.vector.x)),
+					_mm_mul_ps(ny, _mm_set1_ps(l.vector.y))),
+					_mm_mul_ps(nz, _mm_set1_ps(l.vector.z)))));
+				continue;
+			}
+
+			__m128 dx = _mm_sub_ps(_mm_set1_ps(l.vector.x), px),
+				dy = _mm_sub_ps(_mm_set1_ps(l.vector.y), py),
+				dz = _mm_sub_ps(_mm_set1_ps(l.vector.z), pz);
+			__m128 distance_square = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+			__m128 facing = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, dx), _mm_mul_ps(ny, dy)), _mm_mul_ps(nz, dz));
+
+			// intensity * dot(n, d) / (|d| * (1 + falloff * |d|^2)), a light on the point adds nothing
+			__m128 divisor = _mm_mul_ps(_mm_sqrt_ps(distance_square),
+				_mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(_mm_set1_ps(l.falloff), distance_square)));
+			__m128 term = _mm_div_ps(_mm_mul_ps(_mm_set1_ps(l.intensity), facing), divisor);
+			sum = _mm_add_ps(sum, _mm_and_ps(term, _mm_cmpgt_ps(distance_square, _mm_setzero_ps())));
+		}
+
+		return sum;
+	}
+
+	// bccd maps of 4 lightnings, clamped to 0 - 255
+	inline __m128i lightning_colors(__m128 lightning, const basic_color_conversation_data& bccd)
+	{
+		__m128 lo = _mm_setzero_ps(), hi = _mm_set1_ps(255.0f);
+		auto channel = [&](float m, float c)
+		{
+			__m128 v = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(lightning, _mm_set1_ps(m)), _mm_set1_ps(c)), hi);
+			return _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(v, lo), hi));
+		};
+
+		return _mm_or_si128(_mm_or_si128(channel(bccd.bm, bccd.bc),
+			_mm_slli_epi32(channel(bccd.gm, bccd.gc), 8)),
+			_mm_slli_epi32(channel(bccd.rm, bccd.rc), 16));
+	}
+
+	template <typename index_t>
+	class basic_compound_mesh
 	{
 	public:
+		typedef basic_triangle<index_t> triangle_t;
+
+		// vertices & triangles an index_t can address
+		static constexpr uint64_t index_limit = uint64_t(1) << (sizeof(index_t) * 8);
+
 		vertex_t* world_vertices;
 		unsigned vertex_amount;
-		triangle* triangles;
+		triangle_t* triangles;
 		unsigned triangle_amount;
 		basic_color_conversation_data bccd;
 
+		// the constructor or file asked for more vertices or triangles than index_limit: the mesh was left empty
+		// (0 of both) instead of wrapping the indexes, load_split or compound_mesh32 take such meshes
+		bool index_overflow;
+
 		vertex_t* local_vertices;
 
+		// instead of local_vertices (nullptr then) after quantize: vertex = packed * quant_scale + quant_offset,
+		// largest error of a coordinate against the float vertices
+		packed_vertex* packed;
+		fvec3 quant_scale, quant_offset;
+		float quantization_error;
+
 		fvec3 position;
 		rotation_data* rotation;
 
 		bool is_static;
 
-		inline void static_calc_world_vertices(camera* cam)
+		// unit normal & offset (dot(normal, local vertex)) of every triangle's plane in local space,
+		// 4 arrays of planes_stride floats: normal x, y, z & offset, zero padded to whole 4 triangles
+		float* planes;
+		unsigned planes_stride;
+
+		// front facing triangles of the last update in triangle order, all draw looks at (see cull_backfaces)
+		index_t* visible;
+		unsigned visible_amount;
+
+		// camera independent lighting of every triangle, recalculated when bccd, light_direction or lights
+		// changed at update (see update_colors), allocated by setup
+		color_t* triangle_colors;
+		basic_color_conversation_data lit_bccd;
+		fvec3 lit_direction;
+		bool colors_valid;
+
+		// graphics::draw::hflat: a color per triangle, hgouraud: a color per vertex interpolated over the triangles,
+		// htextured: texture tinted by the color of the triangle
+		uint8_t shading;
+
+		// htextured: texture coordinates of every vertex ('t u v' lines of the file or calc_planar_uvs)
+		// & the texture, not owned by the mesh
+		fpoint* uvs;
+		const graphics::texture* texture;
+
+		// hgouraud: unit normals of the vertices in local space (area weighted of their triangles),
+		// 3 arrays of normals_stride floats: x, y & z, & the lit color of every vertex, made by the first gouraud update
+		float* vertex_normals;
+		unsigned normals_stride;
+		color_t* vertex_colors;
+
+		// lights in local space of this update & of the colors
+		std::vector<light> lighting, lit_lights;
+		uint8_t lit_shading;
+
+		// what world_vertices were computed from, update skips the transform while it still holds
+		const camera* updated_cam;
+		fvec3 updated_cam_position, updated_position;
+		unsigned updated_cam_version, updated_rotation_version;
+		uint8_t updated_type;
+
+		inline void static_calc_world_vertices(camera* cam, unsigned begin, unsigned end)
 		{
-			for (unsigned i = 0; i < vertex_amount; i++)
+			for (unsigned i = begin; i < end; i++)
 				world_vertices[i] = cam->rotation.rotate_vertex(local_vertices[i] - cam->position);
 		}
 
-		inline void only_pos_calc_world_vertices(camera* cam)
+		inline void only_pos_calc_world_vertices(camera* cam, unsigned begin, unsigned end)
 		{
 			fvec3 temp = position - cam->position;
-			for (unsigned i = 0; i < vertex_amount; i++)
+			for (unsigned i = begin; i < end; i++)
 				world_vertices[i] = cam->rotation.rotate_vertex(local_vertices[i] + temp);
 		}
 
-		inline void calc_world_vertices(camera* cam)
+		// the camera & mesh rotations fused: world = x * m[0] + y * m[1] + z * m[2] + translation
+		inline void calc_world_vertices(camera* cam, unsigned begin, unsigned end)
 		{
-			fvec3 temp = position - cam->position;
-			for (unsigned i = 0; i < vertex_amount; i++)
-				world_vertices[i] = cam->rotation.rotate_vertex(rotation->rotate_vertex(local_vertices[i]) + temp);
+			fvec3 m[3] = {
+				cam->rotation.rotate_vertex(rotation->rotate_vertex({ 1.0f, 0.0f, 0.0f })),
+				cam->rotation.rotate_vertex(rotation->rotate_vertex({ 0.0f, 1.0f, 0.0f })),
+				cam->rotation.rotate_vertex(rotation->rotate_vertex({ 0.0f, 0.0f, 1.0f }))
+			}, translation = cam->rotation.rotate_vertex(position - cam->position);
+
+			for (unsigned i = begin; i < end; i++)
+			{
+				vertex_t v = local_vertices[i];
+				world_vertices[i] = {
+					m[0].x * v.x + m[1].x * v.y + m[2].x * v.z + translation.x,
+					m[0].y * v.x + m[1].y * v.y + m[2].y * v.z + translation.y,
+					m[0].z * v.x + m[1].z * v.y + m[2].z * v.z + translation.z
+				};
+			}
 		}
 
-		inline void update(camera* cam, uint8_t update_type = tauto)
+		// any update_type (resolved): world = x * m[0] + y * m[1] + z * m[2] + translation,
+		// the dequantization folded into the matrix of the transform
+		inline void packed_calc_world_vertices(camera* cam, uint8_t update_type, unsigned begin, unsigned end)
 		{
-			switch (update_type)
+			fvec3 m[3] = {
+				{ quant_scale.x, 0.0f, 0.0f },
+				{ 0.0f, quant_scale.y, 0.0f },
+				{ 0.0f, 0.0f, quant_scale.z }
+			}, translation = quant_offset;
+
+			if (update_type == tdynamic)
 			{
-			case tauto:
-				if (is_static)
-				{
-			case tstatic:
-				static_calc_world_vertices(cam);
-				return;
-				}
-			case tdynamic:
-				rotation->update();
-				calc_world_vertices(cam);
-				return;
-			case tonly_pos:
-				only_pos_calc_world_vertices(cam);
-				return;
+				for (fvec3& c : m)
+					c = rotation->rotate_vertex(c);
+				translation = rotation->rotate_vertex(translation);
 			}
-		}
+			if (update_type != tstatic)
+				translation += position;
 
-		void draw(camera* cam, basic_engine* engine);
+			for (fvec3& c : m)
+				c = cam->rotation.rotate_vertex(c);
+			translation = cam->rotation.rotate_vertex(translation - cam->position);
 
-		void calc_normal_lengths()
-		{
-			for (int i = 0; i < triangle_amount; i++)
+			for (unsigned i = begin; i < end; i++)
 			{
-				vertex_t a = local_vertices[triangles[i].a];
-				triangles[i].inv_normal_length = 1.0f / magnitude(cross(local_vertices[triangles[i].b] - a, local_vertices[triangles[i].c] - a));
+				packed_vertex p = packed[i];
+				float x = p.x, y = p.y, z = p.z;
+
+				world_vertices[i] = {
+					m[0].x * x + m[1].x * y + m[2].x * z + translation.x,
+					m[0].y * x + m[1].y * y + m[2].y * z + translation.y,
+					m[0].z * x + m[1].z * y + m[2].z * z + translation.z
+				};
+			}
+		}
+
+		inline vertex_t local_vertex(unsigned i) const
+		{
+			if (packed == nullptr)
+				return local_vertices[i];
+
+			packed_vertex p = packed[i];
+			return fvec3(p.x, p.y, p.z) * quant_scale + quant_offset;
+		}
+
+		// 16 bit local vertices in the bounding box (half the memory & the bytes read per update),
+		// returns quantization_error
+		float quantize()
+		{
+			if (packed != nullptr || vertex_amount == 0)
+				return quantization_error;
+
+			fvec3 lo = local_vertices[0], hi = lo;
+			for (unsigned i = 1; i < vertex_amount; i++)
+			{
+				vertex_t v = local_vertices[i];
+				lo = fvec3((std::min)(lo.x, v.x), (std::min)(lo.y, v.y), (std::min)(lo.z, v.z));
+				hi = fvec3((std::max)(hi.x, v.x), (std::max)(hi.y, v.y), (std::max)(hi.z, v.z));
+			}
+
+			fvec3 extent = hi - lo;
+			quant_offset = lo;
+			quant_scale = extent / 65535.0f;
+			fvec3 inv(extent.x > 0.0f ? 65535.0f / extent.x : 0.0f, extent.y > 0.0f ? 65535.0f / extent.y : 0.0f, extent.z > 0.0f ? 65535.0f / extent.z : 0.0f);
+
+			packed = TYPE_MALLOC(packed_vertex, vertex_amount);
+			assert(packed != nullptr);
+
+			quantization_error = 0.0f;
+			for (unsigned i = 0; i < vertex_amount; i++)
+			{
+				fvec3 q = (local_vertices[i] - lo) * inv;
+				packed[i] = {
+					static_cast<uint16_t>((std::min)(q.x + 0.5f, 65535.0f)),
+					static_cast<uint16_t>((std::min)(q.y + 0.5f, 65535.0f)),
+					static_cast<uint16_t>((std::min)(q.z + 0.5f, 65535.0f))
+				};
+
+				fvec3 e = local_vertex(i) - local_vertices[i];
+				quantization_error = (std::max)(quantization_error, (std::max)((std::max)(fabsf(e.x), fabsf(e.y)), fabsf(e.z)));
+			}
+
+			free(local_vertices);
+			local_vertices = nullptr;
+
+			// planes & colors of the quantized vertices
+			if (planes != nullptr)
+				touch();
+
+			return quantization_error;
+		}
+
+		// tauto -> tstatic or tdynamic
+		inline uint8_t resolve_update_type(uint8_t update_type) const
+		{
+			return update_type == tauto ? static_cast<uint8_t>(is_static ? tstatic : tdynamic) : update_type;
+		}
+
+		// update_type resolved, rotation updated already: world_vertices are still those of this camera & transform
+		inline bool up_to_date(const camera* cam, uint8_t update_type) const
+		{
+			return updated_cam == cam && updated_type == update_type &&
+				updated_cam_version == cam->rotation.version && updated_cam_position == cam->position &&
+				(update_type == tstatic || updated_position == position) &&
+				(update_type != tdynamic || updated_rotation_version == rotation->version);
+		}
+
+		inline void mark_updated(const camera* cam, uint8_t update_type)
+		{
+			updated_cam = cam;
+			updated_type = update_type;
+			updated_cam_version = cam->rotation.version;
+			updated_cam_position = cam->position;
+			updated_position = position;
+			updated_rotation_version = update_type == tdynamic ? rotation->version : 0;
+		}
+
+		// local_vertices were edited: new planes & vertex normals, the next update transforms, culls & relights them
+		inline void touch()
+		{
+			calc_normal_lengths();
+			if (vertex_normals != nullptr)
+				calc_vertex_normals();
+			updated_cam = nullptr;
+			colors_valid = false;
+		}
+
+		// world position in the space of local_vertices, update_type resolved, rotation updated already
+		inline fvec3 local_point(fvec3 p, uint8_t update_type) const
+		{
+			switch (update_type)
+			{
+			case tstatic:
+				return p;
+			case tdynamic:
+				return rotation->inverse_rotate_vertex(p - position);
+			default:
+				return p - position;
+			}
+		}
+
+		inline fvec3 local_camera(const camera* cam, uint8_t update_type) const
+		{
+			return local_point(cam->position, update_type);
+		}
+
+		// visible = triangles whose plane has the camera in front, the world space
+		// dot(cross(v1 - v0, v2 - v0), v0) < 0 of draw_triangle done in local space, 4 planes at a time
+		void cull_backfaces(const camera* cam, uint8_t update_type)
+		{
+			fvec3 c = local_camera(cam, update_type);
+			__m128 cx = _mm_set1_ps(c.x), cy = _mm_set1_ps(c.y), cz = _mm_set1_ps(c.z);
+			const float* nx = planes, * ny = planes + planes_stride, * nz = ny + planes_stride, * offsets = nz + planes_stride;
+			unsigned amount = 0;
+
+			for (unsigned i = 0; i < triangle_amount; i += 4)
+			{
+				// offset - dot(normal, camera) = dot(normal, v0 - camera), padding is 0: culled
+				__m128 side = _mm_sub_ps(_mm_loadu_ps(offsets + i), _mm_add_ps(_mm_add_ps(
+					_mm_mul_ps(_mm_loadu_ps(nx + i), cx),
+					_mm_mul_ps(_mm_loadu_ps(ny + i), cy)),
+					_mm_mul_ps(_mm_loadu_ps(nz + i), cz)));
+
+				for (unsigned bits = _mm_movemask_ps(_mm_cmplt_ps(side, _mm_setzero_ps())); bits != 0; bits &= bits - 1)
+					visible[amount++] = static_cast<index_t>(i + std::countr_zero(bits));
+			}
+
+			visible_amount = amount;
+		}
+
+		// the old lighting: triangles [begin, end) against light_direction in local space
+		void calc_triangle_colors(unsigned begin, unsigned end)
+		{
+			for (unsigned i = begin; i < end; i++)
+			{
+				triangle_t tri = triangles[i];
+				float lightning =
+					dot(
+						cross(
+							local_vertex(tri.b) - local_vertex(tri.a),
+							local_vertex(tri.c) - local_vertex(tri.a)
+						),
+						light_direction
+					)
+					* tri.inv_normal_length;
+
+				triangle_colors[i] = RGB(
+					uint8_t(max((lightning * bccd.bm + bccd.bc) * 255.0f, 0.0f)),
+					uint8_t(max((lightning * bccd.gm + bccd.gc) * 255.0f, 0.0f)),
+					uint8_t(max((lightning * bccd.rm + bccd.rc) * 255.0f, 0.0f))
+				);
+			}
+		}
+
+		// uvs projected from the local vertices, u = dot(vertex, u_axis), v = dot(vertex, v_axis)
+		void calc_planar_uvs(fvec3 u_axis, fvec3 v_axis)
+		{
+			if (uvs == nullptr)
+			{
+				uvs = TYPE_MALLOC(fpoint, vertex_amount);
+				assert(uvs != nullptr);
+			}
+
+			for (unsigned i = 0; i < vertex_amount; i++)
+			{
+				vertex_t v = local_vertex(i);
+				uvs[i] = fpoint(dot(v, u_axis), dot(v, v_axis));
+			}
+		}
+
+		// normal sums of the triangles around every vertex, cross products weigh them by area,
+		// vertices of a split_mesh part get the sums of the part's triangles
+		void calc_vertex_normals()
+		{
+			if (vertex_normals == nullptr)
+			{
+				normals_stride = (vertex_amount + 3) & ~3U;
+				vertex_normals = TYPE_MALLOC(float, normals_stride * 3);
+				vertex_colors = TYPE_MALLOC(color_t, vertex_amount);
+				assert(vertex_normals != nullptr && vertex_colors != nullptr);
+			}
+
+			float* nx = vertex_normals, * ny = nx + normals_stride, * nz = ny + normals_stride;
+			memset(vertex_normals, 0, normals_stride * 3 * sizeof(float));
+
+			for (unsigned i = 0; i < triangle_amount; i++)
+			{
+				triangle_t tri = triangles[i];
+				vertex_t a = local_vertex(tri.a);
+				fvec3 normal = cross(local_vertex(tri.b) - a, local_vertex(tri.c) - a);
+
+				for (index_t v : { tri.a, tri.b, tri.c })
+				{
+					nx[v] += normal.x;
+					ny[v] += normal.y;
+					nz[v] += normal.z;
+				}
+			}
+
+			// copies of a vertex (uv or normal seams of the file) share the sum, no crease along the seam
+			std::vector<unsigned> order(vertex_amount);
+			for (unsigned v = 0; v < vertex_amount; v++)
+				order[v] = v;
+			auto less = [&](unsigned a, unsigned b)
+			{
+				vertex_t va = local_vertex(a), vb = local_vertex(b);
+				return va.x != vb.x ? va.x < vb.x : va.y != vb.y ? va.y < vb.y : va.z < vb.z;
+			};
+			std::sort(order.begin(), order.end(), less);
+
+			for (unsigned first = 0, last; first < vertex_amount; first = last)
+			{
+				fvec3 sum(nx[order[first]], ny[order[first]], nz[order[first]]);
+				for (last = first + 1; last < vertex_amount && less(order[first], order[last]) == false; last++)
+					sum += fvec3(nx[order[last]], ny[order[last]], nz[order[last]]);
+
+				for (unsigned k = first; k < last; k++)
+				{
+					nx[order[k]] = sum.x;
+					ny[order[k]] = sum.y;
+					nz[order[k]] = sum.z;
+				}
+			}
+
+			for (unsigned v = 0; v < vertex_amount; v++)
+			{
+				float length = magnitude(fvec3(nx[v], ny[v], nz[v]));
+				float inv = length != 0.0f ? 1.0f / length : 0.0f;
+				nx[v] *= inv;
+				ny[v] *= inv;
+				nz[v] *= inv;
+			}
+		}
+
+		// 4 points a time of [begin, end): vertices (gouraud) or triangle centers (flat) by lighting
+		void light_colors(unsigned begin, unsigned end)
+		{
+			const light* l = lighting.data();
+			unsigned amount = static_cast<unsigned>(lighting.size());
+			bool vertices = shading == graphics::draw::hgouraud;
+			const float* nx, * ny, * nz;
+			color_t* colors;
+
+			if (vertices)
+				nx = vertex_normals, ny = nx + normals_stride, nz = ny + normals_stride, colors = vertex_colors;
+			else
+				nx = planes, ny = planes + planes_stride, nz = ny + planes_stride, colors = triangle_colors;
+
+			for (unsigned i = begin; i < end; i += 4)
+			{
+				alignas(16) float p[3][4] = {};
+				unsigned count = (std::min)(end - i, 4U);
+
+				for (unsigned k = 0; k < count; k++)
+				{
+					fvec3 v;
+					if (vertices)
+						v = local_vertex(i + k);
+					else
+					{
+						triangle_t tri = triangles[i + k];
+						v = (local_vertex(tri.a) + local_vertex(tri.b) + local_vertex(tri.c)) / 3.0f;
+					}
+					p[0][k] = v.x;
+					p[1][k] = v.y;
+					p[2][k] = v.z;
+				}
+
+				// the normal arrays are padded to whole 4s
+				__m128 lightning = light_points(l, amount, _mm_load_ps(p[0]), _mm_load_ps(p[1]), _mm_load_ps(p[2]),
+					_mm_loadu_ps(nx + i), _mm_loadu_ps(ny + i), _mm_loadu_ps(nz + i));
+				alignas(16) color_t c[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(c), lightning_colors(lightning, bccd));
+				std::copy(c, c + count, colors + i);
+			}
+		}
+
+		// lights of update_type's transform into lighting, true when the colors must be recalculated
+		// (calc_colors of [0, color_amount()) then mark_lit), update_type resolved, rotation updated already
+		bool colors_stale(uint8_t update_type)
+		{
+			lighting.clear();
+			if (shading == graphics::draw::hgouraud && lights.empty())
+				lighting.push_back({ light_direction, 1.0f, 0.0f, ldirectional });
+			else
+				lighting.assign(lights.begin(), lights.end());
+
+			for (light& l : lighting)
+			{
+				if (l.type == lpoint)
+					l.vector = local_point(l.vector, update_type);
+				else if (update_type == tdynamic)
+					l.vector = rotation->inverse_rotate_vertex(l.vector);
+			}
+
+			if (shading == graphics::draw::hgouraud && vertex_normals == nullptr)
+			{
+				calc_vertex_normals();
+				colors_valid = false;
+			}
+
+			return colors_valid == false || lit_shading != shading || memcmp(&lit_bccd, &bccd, sizeof(bccd)) != 0 ||
+				lit_lights != lighting || (lighting.empty() && lit_direction != light_direction);
+		}
+
+		// vertices (gouraud) or triangles (flat) calc_colors takes
+		inline unsigned color_amount() const
+		{
+			return shading == graphics::draw::hgouraud ? vertex_amount : triangle_amount;
+		}
+
+		// [begin, end) of color_amount(), after colors_stale, begin a multiple of 4
+		inline void calc_colors(unsigned begin, unsigned end)
+		{
+			if (lighting.empty())
+				calc_triangle_colors(begin, end);
+			else
+				light_colors(begin, end);
+		}
+
+		inline void mark_lit()
+		{
+			lit_bccd = bccd;
+			lit_direction = light_direction;
+			lit_lights.swap(lighting);
+			lit_shading = shading;
+			colors_valid = true;
+		}
+
+		// update_type resolved, rotation updated already
+		inline void update_colors(uint8_t update_type)
+		{
+			if (colors_stale(update_type))
+			{
+				calc_colors(0, color_amount());
+				mark_lit();
+			}
+		}
+
+		// only the vertex transform of [begin, end), rotation must be updated already (see update)
+		inline void update_vertices(camera* cam, uint8_t update_type, unsigned begin, unsigned end)
+		{
+			if (packed != nullptr)
+			{
+				packed_calc_world_vertices(cam, resolve_update_type(update_type), begin, end);
+				return;
+			}
+
+			switch (resolve_update_type(update_type))
+			{
+			case tstatic:
+				static_calc_world_vertices(cam, begin, end);
+				return;
+			case tdynamic:
+				calc_world_vertices(cam, begin, end);
+				return;
+			case tonly_pos:
+				only_pos_calc_world_vertices(cam, begin, end);
+				return;
+			}
+		}
+
+		inline void update(camera* cam, uint8_t update_type = tauto)
+		{
+			EBG_PROFILE_SCOPE(smesh_update);
+
+			update_type = resolve_update_type(update_type);
+			if (update_type == tdynamic)
+				rotation->update();
+			update_colors(update_type);
+
+			if (up_to_date(cam, update_type))
+				return;
+
+			update_vertices(cam, update_type, 0, vertex_amount);
+			cull_backfaces(cam, update_type);
+			mark_updated(cam, update_type);
+		}
+
+		void draw(camera* cam, basic_engine* engine);
+
+		// and the planes
+		void calc_normal_lengths()
+		{
+			float* nx = planes, * ny = planes + planes_stride, * nz = ny + planes_stride, * offsets = nz + planes_stride;
+			memset(planes, 0, (planes_stride << 2) * sizeof(float));
+
+			for (int i = 0; i < triangle_amount; i++)
+			{
+				vertex_t a = local_vertex(triangles[i].a);
+				fvec3 normal = cross(local_vertex(triangles[i].b) - a, local_vertex(triangles[i].c) - a);
+				float length = magnitude(normal);
+				triangles[i].inv_normal_length = 1.0f / length;
+
+				// degenerate triangles keep a 0 plane, never visible
+				if (length == 0.0f)
+					continue;
+
+				normal *= triangles[i].inv_normal_length;
+				nx[i] = normal.x;
+				ny[i] = normal.y;
+				nz[i] = normal.z;
+				offsets[i] = dot(normal, a);
 			}
 		}
 
 		void setup(camera* cam)
 		{
-			update(cam);
+			free(planes);
+			free(visible);
+			planes_stride = (triangle_amount + 3) & ~3U;
+			planes = TYPE_MALLOC(float, planes_stride << 2);
+			visible = TYPE_MALLOC(index_t, triangle_amount);
+			assert(planes != nullptr && visible != nullptr);
+			visible_amount = 0;
 			calc_normal_lengths();
+
+			free(triangle_colors);
+			triangle_colors = TYPE_MALLOC(color_t, triangle_amount);
+			assert(triangle_colors != nullptr);
+			colors_valid = false;
+
+			update(cam);
 		}
 
-		compound_mesh(unsigned vertex_amount, unsigned triangle_amount)
-			: vertex_amount(vertex_amount), triangle_amount(triangle_amount), position(position)
+		basic_compound_mesh(unsigned vertex_amount, unsigned triangle_amount)
+			: vertex_amount(vertex_amount), triangle_amount(triangle_amount), position()
 		{
-			world_vertices = TYPE_MALLOC(vertex_t, vertex_amount);
-			triangles = TYPE_MALLOC(triangle, triangle_amount);
-			local_vertices = TYPE_MALLOC(vertex_t, vertex_amount);
+			index_overflow = vertex_amount > index_limit || triangle_amount > index_limit;
+			if (index_overflow)
+				this->vertex_amount = this->triangle_amount = 0;
+
+			world_vertices = TYPE_MALLOC(vertex_t, this->vertex_amount);
+			triangles = TYPE_MALLOC(triangle_t, this->triangle_amount);
+			local_vertices = TYPE_MALLOC(vertex_t, this->vertex_amount);
 
+			rotation = nullptr;
 			is_static = true;
+			updated_cam = nullptr;
+			triangle_colors = nullptr;
+			planes = nullptr;
+			visible = nullptr;
+			packed = nullptr;
+			quantization_error = 0.0f;
+			shading = graphics::draw::hflat;
+			vertex_normals = nullptr;
+			vertex_colors = nullptr;
+			uvs = nullptr;
+			texture = nullptr;
 		}
 
-		compound_mesh(unsigned vertex_amount, unsigned triangle_amount, fvec3 position, fvec3 rotation)
+		basic_compound_mesh(unsigned vertex_amount, unsigned triangle_amount, fvec3 position, fvec3 rotation)
 			: vertex_amount(vertex_amount), triangle_amount(triangle_amount), position(position)
 		{
-			world_vertices = TYPE_MALLOC(vertex_t, vertex_amount);
-			triangles = TYPE_MALLOC(triangle, triangle_amount);
-			local_vertices = TYPE_MALLOC(vertex_t, vertex_amount);
+			index_overflow = vertex_amount > index_limit || triangle_amount > index_limit;
+			if (index_overflow)
+				this->vertex_amount = this->triangle_amount = 0;
+
+			world_vertices = TYPE_MALLOC(vertex_t, this->vertex_amount);
+			triangles = TYPE_MALLOC(triangle_t, this->triangle_amount);
+			local_vertices = TYPE_MALLOC(vertex_t, this->vertex_amount);
 
 			this->rotation = new rotation_data;
 			this->rotation->rotation = rotation;
 
 			is_static = false;
+			updated_cam = nullptr;
+			triangle_colors = nullptr;
+			planes = nullptr;
+			visible = nullptr;
+			packed = nullptr;
+			quantization_error = 0.0f;
+			shading = graphics::draw::hflat;
+			vertex_normals = nullptr;
+			vertex_colors = nullptr;
+			uvs = nullptr;
+			texture = nullptr;
 		}
 
-		compound_mesh(const char* file_name, fvec3 size = 1.0f)
+		basic_compound_mesh(const char* file_name, fvec3 size = 1.0f)
 		{
+			index_overflow = false;
 			is_static = true;
+			rotation = nullptr;
+			updated_cam = nullptr;
+			triangle_colors = nullptr;
+			planes = nullptr;
+			visible = nullptr;
+			packed = nullptr;
+			quantization_error = 0.0f;
+			shading = graphics::draw::hflat;
+			vertex_normals = nullptr;
+			vertex_colors = nullptr;
+			uvs = nullptr;
+			texture = nullptr;
 
 			std::ifstream file(file_name);
 			assert(file.is_open());
 
 			char* buffer = reinterpret_cast<char*>(data::cb);
 
-			index16_t i = 0;
-			unsigned amount;
+			unsigned i = 0, uv_i = 0, amount;
 			char* start;
-			triangle tri;
+			triangle_t tri;
 			vertex_t v;
 
 			vertex_amount = 0;
 			triangle_amount = 0;
 			world_vertices = nullptr;
+			local_vertices = nullptr;
 			triangles = nullptr;
 
-			while (file.eof() == false)
+			while (file.eof() == false && index_overflow == false)
 			{
 				file.getline(buffer, data::cb_size);
 
@@ -566,10 +1764,18 @@ namespace eb3d
 					}
 					file.clear();
 					file.seekg(0);
+					[[fallthrough]];
 				case 'm':
+					// too large for 16 bit indexes: left empty, compound_mesh32 or load_split take it
+					if (vertex_amount > index_limit || triangle_amount > index_limit)
+					{
+						index_overflow = true;
+						vertex_amount = triangle_amount = 0;
+						break;
+					}
 					world_vertices = TYPE_MALLOC(vertex_t, vertex_amount);
 					local_vertices = TYPE_MALLOC(vertex_t, vertex_amount);
-					triangles = TYPE_MALLOC(triangle, triangle_amount);
+					triangles = TYPE_MALLOC(triangle_t, triangle_amount);
 					break;
 				case 'c':
 					i = 0;
@@ -586,9 +1792,29 @@ namespace eb3d
 					start++;
 					v.z = atof(start);
 
-					local_vertices[i] = v * size;
+					if (i < vertex_amount)
+						local_vertices[i] = v * size;
 					i++;
 					break;
+				case 't':
+					// vertices without a 't' line keep (0, 0), lines past the vertices are ignored
+					if (uvs == nullptr)
+					{
+						uvs = TYPE_MALLOC(fpoint, vertex_amount);
+						assert(uvs != nullptr);
+						std::fill(uvs, uvs + vertex_amount, fpoint(0.0f, 0.0f));
+					}
+					if (uv_i >= vertex_amount)
+						break;
+					start = buffer + 2;
+					uvs[uv_i].x = atof(start);
+
+					while (*start != ' ') start++;
+					start++;
+					uvs[uv_i].y = atof(start);
+
+					uv_i++;
+					break;
 				case 'f':
 					start = buffer + 2;
 					tri.a = atol(start) - 1;
@@ -601,14 +1827,23 @@ namespace eb3d
 					start++;
 					tri.c = atol(start) - 1;
 
-					triangles[i] = tri;
+					if (i < triangle_amount)
+						triangles[i] = tri;
 					i++;
 					break;
 				}
 			}
+
+			if (index_overflow)
+				return;
+
+			if (mesh_order::on_import)
+				mesh_order::optimize(triangles, triangle_amount, local_vertices, vertex_amount, uvs);
+			if (quantize_on_import)
+				quantize();
 		}
 
-		compound_mesh(const char* file_name, fvec3 position, fvec3 rotation, fvec3 size = 1.0f) : compound_mesh(file_name, size)
+		basic_compound_mesh(const char* file_name, fvec3 position, fvec3 rotation, fvec3 size = 1.0f) : basic_compound_mesh(file_name, size)
 		{
 			this->position = position;
 			is_static = false;
@@ -617,6 +1852,144 @@ namespace eb3d
 		}
 	};
 
+	typedef basic_compound_mesh<index16_t> compound_mesh;
+	typedef basic_compound_mesh<index32_t> compound_mesh32;
+
+	template <typename index_t>
+	void delete_compound_mesh(basic_compound_mesh<index_t>* mesh)
+	{
+		free(mesh->world_vertices);
+		free(mesh->local_vertices);
+		free(mesh->packed);
+		free(mesh->triangles);
+		free(mesh->triangle_colors);
+		free(mesh->planes);
+		free(mesh->visible);
+		free(mesh->vertex_normals);
+		free(mesh->vertex_colors);
+		free(mesh->uvs);
+		delete mesh->rotation;
+
+		mesh->world_vertices = mesh->local_vertices = nullptr;
+		mesh->packed = nullptr;
+		mesh->quantization_error = 0.0f;
+		mesh->triangles = nullptr;
+		mesh->triangle_colors = nullptr;
+		mesh->planes = nullptr;
+		mesh->visible = nullptr;
+		mesh->vertex_normals = nullptr;
+		mesh->vertex_colors = nullptr;
+		mesh->uvs = nullptr;
+		mesh->rotation = nullptr;
+	}
+
+	// 16 bit parts of a mesh, each up to 65536 vertices & triangles, in triangle order (mesh_order::optimize
+	// first keeps the parts compact), vertices on the borders are in both parts,
+	// same transform, colors, shading, uvs & texture as the mesh, setup each part before drawing,
+	// every part owns its rotation_data: move & turn them together (place_parts)
+	std::vector<compound_mesh*> split_mesh(const compound_mesh32* mesh)
+	{
+		constexpr unsigned none = ~0U, limit = static_cast<unsigned>(compound_mesh::index_limit);
+
+		std::vector<compound_mesh*> parts;
+		// index in the current part of every vertex of the mesh
+		std::vector<unsigned> remap(mesh->vertex_amount, none), used;
+		std::vector<triangle> part_triangles;
+
+		auto finish_part = [&]()
+		{
+			unsigned vertex_amount = static_cast<unsigned>(used.size()), triangle_amount = static_cast<unsigned>(part_triangles.size());
+			compound_mesh* part;
+			if (mesh->rotation != nullptr)
+				part = new compound_mesh(vertex_amount, triangle_amount, mesh->position, mesh->rotation->rotation);
+			else
+			{
+				part = new compound_mesh(vertex_amount, triangle_amount);
+				part->position = mesh->position;
+			}
+
+			if (mesh->uvs != nullptr)
+			{
+				part->uvs = TYPE_MALLOC(fpoint, vertex_amount);
+				assert(part->uvs != nullptr);
+			}
+
+			for (unsigned v = 0; v < vertex_amount; v++)
+			{
+				part->local_vertices[v] = mesh->local_vertex(used[v]);
+				if (mesh->uvs != nullptr)
+					part->uvs[v] = mesh->uvs[used[v]];
+				remap[used[v]] = none;
+			}
+			std::copy(part_triangles.begin(), part_triangles.end(), part->triangles);
+
+			part->is_static = mesh->is_static;
+			part->bccd = mesh->bccd;
+			part->shading = mesh->shading;
+			part->texture = mesh->texture;
+			parts.push_back(part);
+
+			used.clear();
+			part_triangles.clear();
+		};
+
+		for (unsigned i = 0; i < mesh->triangle_amount; i++)
+		{
+			triangle32 tri = mesh->triangles[i];
+			unsigned fresh = (remap[tri.a] == none) + (remap[tri.b] == none) + (remap[tri.c] == none);
+
+			if (used.size() + fresh > limit || part_triangles.size() == limit)
+				finish_part();
+
+			triangle t;
+			index16_t* to[3] = { &t.a, &t.b, &t.c };
+			index32_t from[3] = { tri.a, tri.b, tri.c };
+			for (unsigned k = 0; k < 3; k++)
+			{
+				if (remap[from[k]] == none)
+				{
+					remap[from[k]] = static_cast<unsigned>(used.size());
+					used.push_back(from[k]);
+				}
+				*to[k] = static_cast<index16_t>(remap[from[k]]);
+			}
+			part_triangles.push_back(t);
+		}
+
+		if (part_triangles.empty() == false)
+			finish_part();
+
+		return parts;
+	}
+
+	// a mesh file of any size as 16 bit parts (one when it fits), see split_mesh
+	std::vector<compound_mesh*> load_split(const char* file_name, fvec3 size = 1.0f)
+	{
+		compound_mesh32 mesh(file_name, size);
+		std::vector<compound_mesh*> parts = split_mesh(&mesh);
+		delete_compound_mesh(&mesh);
+		return parts;
+	}
+
+	std::vector<compound_mesh*> load_split(const char* file_name, fvec3 position, fvec3 rotation, fvec3 size = 1.0f)
+	{
+		compound_mesh32 mesh(file_name, position, rotation, size);
+		std::vector<compound_mesh*> parts = split_mesh(&mesh);
+		delete_compound_mesh(&mesh);
+		return parts;
+	}
+
+	// the same position & rotation for every part of a split mesh, parts without a rotation_data only move
+	inline void place_parts(const std::vector<compound_mesh*>& parts, fvec3 position, fvec3 rotation)
+	{
+		for (compound_mesh* part : parts)
+		{
+			part->position = position;
+			if (part->rotation != nullptr)
+				part->rotation->rotation = rotation;
+		}
+	}
+
 	inline ipoint mapto_engine(fpoint p, basic_engine* engine)
 	{
 		return ipoint(
@@ -625,7 +1998,8 @@ namespace eb3d
 		);
 	}
 
-	inline void clip_1i_2o_triangle(vertex_t* vertices, char i, char o1, char o2, float near)
+	// colors: attributes interpolated along with the vertices (gouraud colors, uvs), or nullptr
+	inline void clip_1i_2o_triangle(vertex_t* vertices, char i, char o1, char o2, float near, fvec3* colors = nullptr)
 	{
 		// x * (dz / dx) + iz - ix * (dz / dx) = near
 		// y * (dz / dy) + iz - ix * (dz / dy) = near
@@ -646,9 +2020,15 @@ namespace eb3d
 		vertices[o1].y = inV.y + d1.y * n_izm1;
 		vertices[o2].x = inV.x + d2.x * n_izm2;
 		vertices[o2].y = inV.y + d2.y * n_izm2;
+
+		if (colors != nullptr)
+		{
+			colors[o1] = colors[i] + (colors[o1] - colors[i]) * n_izm1;
+			colors[o2] = colors[i] + (colors[o2] - colors[i]) * n_izm2;
+		}
 	}
 
-	inline void clip_2i_1o_triangle(vertex_t* vertices, char i1, char i2, char o, float near)
+	inline void clip_2i_1o_triangle(vertex_t* vertices, char i1, char i2, char o, float near, fvec3* colors = nullptr)
 	{
 		vertex_t outV = vertices[o];
 
@@ -660,11 +2040,96 @@ namespace eb3d
 
 		vertices[o] = { outV.x + d1.x * n_ozm1, outV.y + d1.y * n_ozm1, near };
 		vertices[3] = { outV.x + d2.x * n_ozm2, outV.y + d2.y * n_ozm2, near };
+
+		if (colors != nullptr)
+		{
+			fvec3 outC = colors[o];
+			colors[o] = outC + (colors[i1] - outC) * n_ozm1;
+			colors[3] = outC + (colors[i2] - outC) * n_ozm2;
+		}
 	}
 
-	void camera::draw_triangle(compound_mesh* mesh, index16_t index, basic_engine* engine) const
+	// id bit of the second triangle of a 2 in 1 out near clip (draw_triangle with an id)
+	constexpr color_t clipped_half_id = 0x80000000U;
+
+	/*
+	near clip of draw_triangle: vertices (room for 4) & attributes (or nullptr) of a triangle,
+	returns how many vertices were behind near (3: nothing to draw), the triangle is vertices 0, 1 & 2,
+	after a 2 in 1 out clip (1) the second one is 3, iI & t
+	*/
+	inline char clip_near(vertex_t* vertices, fvec3* attributes, float near, char& iI, char& t)
 	{
-		triangle tri = mesh->triangles[index];
+		char iV[3], oV[3], i = 0, o = 0;
+
+		// temporary bug fix
+		float some_value = near + magnitude(vertices[0]) * EPSILON;
+		(vertices[0].z < some_value ? oV[o++] : iV[i++]) = 0;
+		(vertices[1].z < some_value ? oV[o++] : iV[i++]) = 1;
+		(vertices[2].z < some_value ? oV[o++] : iV[i++]) = 2;
+
+		if (o == 2)
+			clip_1i_2o_triangle(vertices, iV[0], oV[0], oV[1], some_value, attributes);
+		else if (o == 1)
+		{
+			iI = iV[1];
+			t = oV[0];
+			clip_2i_1o_triangle(vertices, iV[0], iI, t, some_value, attributes);
+		}
+
+		return o;
+	}
+
+	// r, g & b of a color as raster attributes, +0.5 so the truncation of the span loops rounds
+	inline fvec3 color_attributes(color_t c)
+	{
+		return fvec3(float((c >> 16) & 0xFF) + 0.5f, float((c >> 8) & 0xFF) + 0.5f, float(c & 0xFF) + 0.5f);
+	}
+
+	// u & v of a vertex as raster attributes, 0 pads them to clip like colors
+	inline fvec3 uv_attributes(fpoint uv)
+	{
+		return fvec3(uv.x, uv.y, 0.0f);
+	}
+
+	template <uint8_t shade_mode>
+	inline graphics::draw::raster_vertex<shade_mode> shaded_vertex(ipoint p, float z, fvec3 a)
+	{
+		if constexpr (shade_mode == graphics::draw::hgouraud)
+			return { p, z, { a.x, a.y, a.z } };
+		else
+			return { p, z, { a.x, a.y } };
+	}
+
+	// the triangle of draw_triangle with interpolated attributes, & the second half of a 2 in 1 out clip (oI == 1)
+	template <uint8_t shade_mode>
+	inline void rasterise_shaded(const vertex_t* vertices, const ipoint* mappedv, const fvec3* attributes, char oI, char iI, char t,
+		const graphics::draw::raster_target& target)
+	{
+		graphics::draw::rasterise<graphics::draw::ztest, shade_mode, graphics::draw::bopaque>(
+			shaded_vertex<shade_mode>(mappedv[0], vertices[0].z, attributes[0]),
+			shaded_vertex<shade_mode>(mappedv[1], vertices[1].z, attributes[1]),
+			shaded_vertex<shade_mode>(mappedv[2], vertices[2].z, attributes[2]),
+			target
+		);
+
+		if (oI == 1)
+		{
+			graphics::draw::rasterise<graphics::draw::ztest, shade_mode, graphics::draw::bopaque>(
+				shaded_vertex<shade_mode>(mappedv[3], vertices[3].z, attributes[3]),
+				shaded_vertex<shade_mode>(mappedv[iI], vertices[iI].z, attributes[iI]),
+				shaded_vertex<shade_mode>(mappedv[t], vertices[t].z, attributes[t]),
+				target
+			);
+		}
+	}
+
+	template <typename index_t>
+	void camera::draw_triangle(basic_compound_mesh<index_t>* mesh, index_t index, basic_engine* engine, color_t id) const
+	{
+		EBG_PROFILE_LAP_START();
+		EBG_STATS_BAND_ADD(engine->surface, triangles_submitted, 1);
+
+		basic_triangle<index_t> tri = mesh->triangles[index];
 
 		vertex_t vertices[4] = {
 			mesh->world_vertices[tri.a],
@@ -672,65 +2137,94 @@ namespace eb3d
 			mesh->world_vertices[tri.c]
 		};
 
-		vertex_t normal = cross(vertices[1] - vertices[0], vertices[2] - vertices[0]);
-		if (dot(normal, vertices[0]) >= 0.0f)
-			return;
+		// back faces are culled at update (compound_mesh::visible)
 
-		char iV[3], oV[3], iI = 0, oI = 0, t;
+		// normal *= tri.inv_normal_length;
 
-		// temporary bug fix
-		float some_value = near + magnitude(vertices[0]) * EPSILON;
-		(vertices[0].z < some_value ? oV[oI++] : iV[iI++]) = 0;
-		(vertices[1].z < some_value ? oV[oI++] : iV[iI++]) = 1;
-		(vertices[2].z < some_value ? oV[oI++] : iV[iI++]) = 2;
+		// float lightning = dot(normal, { 0.0f, 0.0f, -1.0f }) * 255.0f;
 
-		if (oI == 3)
-			return;
+		// Camera independent lighting, calculated at update
+		uint8_t shading = id != 0 ? static_cast<uint8_t>(graphics::draw::hflat) : mesh->shading;
+		color_t color = id;
+		// gouraud colors or uvs, clipped along with the vertices
+		fvec3 attributes[4];
 
-		// normal *= tri.inv_normal_length;
+		if (shading == graphics::draw::hgouraud)
+		{
+			attributes[0] = color_attributes(mesh->vertex_colors[tri.a]);
+			attributes[1] = color_attributes(mesh->vertex_colors[tri.b]);
+			attributes[2] = color_attributes(mesh->vertex_colors[tri.c]);
+		}
+		else
+		{
+			if (id == 0)
+				color = mesh->triangle_colors[index];
 
-		// float lightning = dot(normal, { 0.0f, 0.0f, -1.0f }) * 255.0f;
+			if (shading == graphics::draw::htextured)
+			{
+				assert(mesh->uvs != nullptr && mesh->texture != nullptr);
+				attributes[0] = uv_attributes(mesh->uvs[tri.a]);
+				attributes[1] = uv_attributes(mesh->uvs[tri.b]);
+				attributes[2] = uv_attributes(mesh->uvs[tri.c]);
+			}
+		}
 
-		// Camera independent lighting
-		float lightning =
-			dot(
-				cross(
-					mesh->local_vertices[tri.b] - mesh->local_vertices[tri.a],
-					mesh->local_vertices[tri.c] - mesh->local_vertices[tri.a]
-				),
-				normalize({ -1.0f, 1.0f, -1.0f })
-			)
-			* tri.inv_normal_length;
-		color_t color = RGB(
-			uint8_t(max((lightning * mesh->bccd.bm + mesh->bccd.bc) * 255.0f, 0.0f)),
-			uint8_t(max((lightning * mesh->bccd.gm + mesh->bccd.gc) * 255.0f, 0.0f)),
-			uint8_t(max((lightning * mesh->bccd.rm + mesh->bccd.rc) * 255.0f, 0.0f))
-		);
+		EBG_PROFILE_LAP(slighting);
+
+		char iI = 0, t = 0, oI = clip_near(vertices, shading != graphics::draw::hflat ? attributes : nullptr, near, iI, t);
 
-		ipoint mappedv[3];
+		EBG_PROFILE_LAP(sclipping);
 
-		if (oI == 2)
+		if (oI == 3)
 		{
-			clip_1i_2o_triangle(vertices, iV[0], oV[0], oV[1], some_value);
+			EBG_STATS_BAND_ADD(engine->surface, near_rejected, 1);
+			return;
 		}
-		else if (oI == 1)
+
+		EBG_STATS_BAND_ADD(engine->surface, clipped_to_one, oI == 2);
+		EBG_STATS_BAND_ADD(engine->surface, clipped_to_two, oI == 1);
+
+		// partial redraw: nothing to do off the repaint blocks
+		if (oI == 0 && engine->surface.repaint != nullptr)
 		{
-			iI = iV[1];
-			t = oV[0];
+			ipoint a = mapto_engine(persf(vertices[0]), engine), b = mapto_engine(persf(vertices[1]), engine), c = mapto_engine(persf(vertices[2]), engine);
 
-			clip_2i_1o_triangle(vertices, iV[0], iI, t, some_value);
+			if (graphics::draw::repaints(&engine->surface,
+				ipoint((std::min)((std::min)(a.x, b.x), c.x), (std::min)((std::min)(a.y, b.y), c.y)),
+				ipoint((std::max)((std::max)(a.x, b.x), c.x), (std::max)((std::max)(a.y, b.y), c.y))) == false)
+				return;
 		}
 
+		ipoint mappedv[4];
+
 		mappedv[0] = mapto_engine(persf(vertices[0]), engine);
 		mappedv[1] = mapto_engine(persf(vertices[1]), engine); // Must be stored in cache
 		mappedv[2] = mapto_engine(persf(vertices[2]), engine);
 
+		EBG_PROFILE_LAP(sprojection);
+		EBG_STATS_BAND_ADD(engine->surface, triangles_rasterized, oI == 1 ? 2 : 1);
+
+		if (shading != graphics::draw::hflat)
+		{
+			graphics::draw::raster_target target = { &engine->surface, engine->depth_buffer, color, mesh->texture };
+			if (oI == 1)
+				mappedv[3] = mapto_engine(persf(vertices[3]), engine);
+
+			if (shading == graphics::draw::hgouraud)
+				rasterise_shaded<graphics::draw::hgouraud>(vertices, mappedv, attributes, oI, iI, t, target);
+			else
+				rasterise_shaded<graphics::draw::htextured>(vertices, mappedv, attributes, oI, iI, t, target);
+
+			EBG_PROFILE_LAP(sraster);
+			return;
+		}
+
 		// graphics::draw::triangle(mappedv[0], mappedv[1], mappedv[2], engine->depth_buffer, colors::white, &engine->surface);
 
 		graphics::draw::depth_rasterisation(
 			mappedv[0], mappedv[1], mappedv[2],
 			vertices[0].z, vertices[1].z, vertices[2].z,
-			engine->depth_buffer, color, color, &engine->surface
+			engine->depth_buffer, color, &engine->surface
 		);
 
 		if (oI == 1)
@@ -744,15 +2238,112 @@ namespace eb3d
 				vertices[3].z,
 				vertices[iI].z,
 				vertices[t].z,
-				engine->depth_buffer, color, color, &engine->surface
+				engine->depth_buffer, id != 0 ? id | clipped_half_id : color, &engine->surface
 			);
 		}
+
+		EBG_PROFILE_LAP(sraster);
+	}
+
+	template <typename index_t>
+	inline void basic_compound_mesh<index_t>::draw(camera* cam, basic_engine* engine)
+	{
+		EBG_STATS_BAND_ADD(engine->surface, triangles_submitted, triangle_amount - visible_amount);
+		EBG_STATS_BAND_ADD(engine->surface, backface_rejected, triangle_amount - visible_amount);
+
+		for (unsigned i = 0; i < visible_amount; i++)
+			cam->draw_triangle(this, visible[i], engine);
+
+		EBG_PROFILE_FLUSH();
+	}
+
+	/*
+	band parallel frame, for N threads:
+	every thread transforms 1/N of the vertices of every mesh,
+	then draws every mesh into its own band of rows (surface.row_begin/row_end)
+	triangle setup is repeated per band, pixels are written exactly once
+	*/
+	template <typename index_t>
+	void update_parallel(basic_compound_mesh<index_t>** meshes, const uint8_t* update_types, unsigned mesh_amount, camera* cam, thread_pool* pool)
+	{
+		unsigned threads = pool->amount;
+		std::vector<uint8_t> stale(mesh_amount);
+
+		std::vector<rotation_data*> rotations;
+		for (unsigned m = 0; m < mesh_amount; m++)
+			if (meshes[m]->resolve_update_type(update_types[m]) == tdynamic)
+				rotations.push_back(meshes[m]->rotation);
+		update_rotations(rotations.data(), static_cast<unsigned>(rotations.size()));
+
+		std::vector<uint8_t> relight(mesh_amount);
+
+		for (unsigned m = 0; m < mesh_amount; m++)
+		{
+			uint8_t update_type = meshes[m]->resolve_update_type(update_types[m]);
+			relight[m] = meshes[m]->colors_stale(update_type);
+			stale[m] = meshes[m]->up_to_date(cam, update_type) == false;
+		}
+
+		pool->run([&](unsigned index)
+		{
+			EBG_PROFILE_SCOPE(smesh_update);
+
+			for (unsigned m = 0; m < mesh_amount; m++)
+			{
+				if (relight[m] != 0)
+				{
+					// whole 4s but the last
+					unsigned amount = meshes[m]->color_amount();
+					meshes[m]->calc_colors((amount * index / threads) & ~3U, index + 1 == threads ? amount : (amount * (index + 1) / threads) & ~3U);
+				}
+
+				if (stale[m] == 0)
+					continue;
+
+				unsigned amount = meshes[m]->vertex_amount;
+				meshes[m]->update_vertices(cam, update_types[m], amount * index / threads, amount * (index + 1) / threads);
+			}
+
+			// a whole mesh per thread, it doesn't need the vertices
+			for (unsigned m = index; m < mesh_amount; m += threads)
+				if (stale[m] != 0)
+					meshes[m]->cull_backfaces(cam, meshes[m]->resolve_update_type(update_types[m]));
+		});
+
+		for (unsigned m = 0; m < mesh_amount; m++)
+		{
+			if (relight[m] != 0)
+				meshes[m]->mark_lit();
+			if (stale[m] != 0)
+				meshes[m]->mark_updated(cam, meshes[m]->resolve_update_type(update_types[m]));
+		}
+	}
+
+	template <typename index_t>
+	void draw_bands(basic_compound_mesh<index_t>** meshes, unsigned mesh_amount, camera* cam, basic_engine* engine, thread_pool* pool)
+	{
+		unsigned threads = pool->amount;
+
+		pool->run([&](unsigned index)
+		{
+			// bands are whole 8 row blocks so tiled surfaces don't share tiles between threads
+			unsigned blocks = (engine->surface.dim.y + 7) >> 3;
+
+			basic_engine band = *engine;
+			band.surface.row_begin = min((blocks * index / threads) << 3, engine->surface.dim.y);
+			band.surface.row_end = min((blocks * (index + 1) / threads) << 3, engine->surface.dim.y);
+
+			for (unsigned m = 0; m < mesh_amount; m++)
+				meshes[m]->draw(cam, &band);
+		});
 	}
 
-	inline void compound_mesh::draw(camera* cam, basic_engine* engine)
+	template <typename index_t>
+	void draw_parallel(basic_compound_mesh<index_t>** meshes, const uint8_t* update_types, unsigned mesh_amount,
+		camera* cam, basic_engine* engine, thread_pool* pool)
 	{
-		for (int i = 0; i < triangle_amount; i++)
-			cam->draw_triangle(this, i, engine);
+		update_parallel(meshes, update_types, mesh_amount, cam, pool);
+		draw_bands(meshes, mesh_amount, cam, engine, pool);
 	}
 
 	struct sphere_collision_module
@@ -3,6 +3,9 @@
 #include "EBG_point.h"
 #include "EBG_colors.h"
 #include <bit>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
 
 #include <cassert>
 
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "EBG_3d.h"
+
+#include <vector>
+#include <string>
+#include <fstream>
+
+namespace eb3d
+{
+	struct camera_key
+	{
+		float time;
+		fvec3 position, rotation;
+	};
+
+	// keys sorted by time, linear between keys, clamped outside
+	struct camera_path
+	{
+		std::vector<camera_key> keys;
+
+		// rotations between keys on the shortest arc at constant speed (quaternion::slerp) instead of the euler angles linear
+		bool slerp = false;
+
+		inline void add(float time, fvec3 position, fvec3 rotation)
+		{
+			keys.push_back({ time, position, rotation });
+		}
+
+		inline float duration() const
+		{
+			return keys.empty() ? 0.0f : keys.back().time;
+		}
+
+		// text file, one key per line: time x y z rotation_x rotation_y rotation_z
+		// empty lines and lines starting with # are skipped, false on a bad line or unsorted times
+		bool load(const char* file_name)
+		{
+			std::ifstream file(file_name);
+			if (file.is_open() == false)
+				return false;
+
+			keys.clear();
+
+			std::string line;
+			while (std::getline(file, line))
+			{
+				size_t first = line.find_first_not_of(" \t\r");
+				if (first == std::string::npos || line[first] == '#')
+					continue;
+
+				camera_key k;
+				if (sscanf(line.c_str(), "%f %f %f %f %f %f %f", &k.time, &k.position.x, &k.position.y, &k.position.z,
+					&k.rotation.x, &k.rotation.y, &k.rotation.z) != 7 || (keys.empty() == false && k.time < keys.back().time))
+					return false;
+
+				keys.push_back(k);
+			}
+
+			return keys.empty() == false;
+		}
+
+		void sample(float time, camera* cam) const
+		{
+			assert(keys.empty() == false);
+
+			unsigned i = 1;
+			while (i < keys.size() && keys[i].time < time)
+				i++;
+
+			if (i == keys.size() || time <= keys[0].time)
+			{
+				const camera_key& k = time <= keys[0].time ? keys[0] : keys.back();
+				cam->position = k.position;
+				cam->rotation.rotation = k.rotation;
+			}
+			else
+			{
+				const camera_key& a = keys[i - 1], & b = keys[i];
+				float t = (time - a.time) / (b.time - a.time);
+
+				cam->position = a.position + (b.position - a.position) * t;
+				if (slerp)
+					cam->rotation.set(quaternion::slerp(quaternion::from_euler(a.rotation), quaternion::from_euler(b.rotation), t));
+				else
+					cam->rotation.rotation = a.rotation + (b.rotation - a.rotation) * t;
+			}
+
+			cam->update();
+		}
+	};
+}
@@ -0,0 +1,447 @@
+#pragma once
+
+#include "EBG_graphics.h"
+
+#include <cstdio>
+#include <vector>
+
+/*
+Reference captures & image comparison
+
+colors as binary PPM (P6), depth as grayscale PFM (Pf, little endian),
+encoders for QOI images & YUV4MPEG2 (Y4M) frames of image sequences
+buffers are row-major with y = 0 at the bottom (like the surface),
+PPM, QOI & Y4M store the top row first, PFM the bottom row first
+*/
+
+namespace ebg
+{
+	namespace capture
+	{
+		struct image
+		{
+			upoint dim;
+			std::vector<color_t> colors;
+			std::vector<float> depth;
+		};
+
+		// row-major copy of the surface & depth buffer (tiled or not), depth_buffer may be null
+		void grab(const graphics::surface* surf, const float* depth_buffer, image* out)
+		{
+			unsigned size = surf->dim.x * surf->dim.y;
+
+			out->dim = surf->dim;
+			out->colors.resize(size);
+			out->depth.resize(depth_buffer != nullptr ? size : 0);
+
+			if (surf->x_offsets != nullptr)
+			{
+				graphics::detile(surf, out->colors.data());
+				if (depth_buffer != nullptr)
+					graphics::detile(surf, reinterpret_cast<const uint32_t*>(depth_buffer), reinterpret_cast<uint32_t*>(out->depth.data()));
+			}
+			else
+			{
+				memcpy(out->colors.data(), surf->buffer, size << 2);
+				if (depth_buffer != nullptr)
+					memcpy(out->depth.data(), depth_buffer, size << 2);
+			}
+		}
+
+		// whole PPM file into out
+		void encode_ppm(const color_t* colors, upoint dim, std::vector<uint8_t>& out)
+		{
+			char header[32];
+			int header_size = snprintf(header, sizeof(header), "P6\n%u %u\n255\n", dim.x, dim.y);
+
+			out.resize(header_size + dim.x * dim.y * 3);
+			memcpy(out.data(), header, header_size);
+
+			uint8_t* o = out.data() + header_size;
+			for (unsigned y = dim.y; y-- > 0;)
+			{
+				const color_t* px = colors + y * dim.x;
+				for (unsigned x = 0; x < dim.x; x++, o += 3)
+				{
+					o[0] = static_cast<uint8_t>(px[x] >> 16);
+					o[1] = static_cast<uint8_t>(px[x] >> 8);
+					o[2] = static_cast<uint8_t>(px[x]);
+				}
+			}
+		}
+
+		// QOI chunks (no header, no end marker) of a width x height block appended to out,
+		// rows in the order first_row, first_row + stride, ... (negative stride for top row first)
+		void encode_qoi_chunks(const color_t* first_row, unsigned width, unsigned height, ptrdiff_t stride, std::vector<uint8_t>& out)
+		{
+			color_t index[64] = {};
+			color_t prev = 0;
+			unsigned run = 0, last = width * height - 1, i = 0;
+
+			for (unsigned y = 0; y < height; y++)
+			{
+				const color_t* px = first_row + y * stride;
+				for (unsigned x = 0; x < width; x++, i++)
+				{
+					color_t c = px[x] & 0xFFFFFF;
+
+					if (c == prev)
+					{
+						if (++run == 62 || i == last)
+						{
+							out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+							run = 0;
+						}
+						continue;
+					}
+
+					if (run != 0)
+					{
+						out.push_back(static_cast<uint8_t>(0xC0 | (run - 1)));
+						run = 0;
+					}
+
+					int r = c >> 16, g = (c >> 8) & 0xFF, b = c & 0xFF;
+					// alpha is always 255: 255 * 11 % 64 = 53
+					unsigned hash = (r * 3 + g * 5 + b * 7 + 53) & 63;
+
+					if (index[hash] == c)
+						out.push_back(static_cast<uint8_t>(hash));
+					else
+					{
+						index[hash] = c;
+
+						int8_t dr = static_cast<int8_t>(r - static_cast<int>(prev >> 16)),
+							dg = static_cast<int8_t>(g - static_cast<int>((prev >> 8) & 0xFF)),
+							db = static_cast<int8_t>(b - static_cast<int>(prev & 0xFF));
+						int dr_dg = dr - dg, db_dg = db - dg;
+
+						if (dr >= -2 && dr <= 1 && dg >= -2 && dg <= 1 && db >= -2 && db <= 1)
+							out.push_back(static_cast<uint8_t>(0x40 | (dr + 2) << 4 | (dg + 2) << 2 | (db + 2)));
+						else if (dg >= -32 && dg <= 31 && dr_dg >= -8 && dr_dg <= 7 && db_dg >= -8 && db_dg <= 7)
+						{
+							out.push_back(static_cast<uint8_t>(0x80 | (dg + 32)));
+							out.push_back(static_cast<uint8_t>((dr_dg + 8) << 4 | (db_dg + 8)));
+						}
+						else
+							out.insert(out.end(), { 0xFE, static_cast<uint8_t>(r), static_cast<uint8_t>(g), static_cast<uint8_t>(b) });
+					}
+
+					prev = c;
+				}
+			}
+		}
+
+		// pixel_amount pixels of QOI chunks into out (alpha set), false on truncated or bad data
+		bool decode_qoi_chunks(const uint8_t* bytes, size_t size, unsigned pixel_amount, color_t* out)
+		{
+			color_t index[64] = {};
+			color_t c = 0;
+			size_t p = 0;
+
+			for (unsigned i = 0; i < pixel_amount;)
+			{
+				if (p >= size)
+					return false;
+
+				uint8_t b = bytes[p++];
+				unsigned run = 1;
+
+				if (b == 0xFE)
+				{
+					if (p + 3 > size)
+						return false;
+					c = bytes[p] << 16 | bytes[p + 1] << 8 | bytes[p + 2];
+					p += 3;
+				}
+				else if (b == 0xFF)
+					return false;
+				else switch (b >> 6)
+				{
+				case 0:
+					c = index[b];
+					break;
+				case 1:
+					c = (((c >> 16) + ((b >> 4) & 3) - 2) & 0xFF) << 16 |
+						(((c >> 8 & 0xFF) + ((b >> 2) & 3) - 2) & 0xFF) << 8 |
+						(((c & 0xFF) + (b & 3) - 2) & 0xFF);
+					break;
+				case 2:
+				{
+					if (p >= size)
+						return false;
+					int dg = (b & 63) - 32, d2 = bytes[p++];
+					c = (((c >> 16) + dg - 8 + (d2 >> 4)) & 0xFF) << 16 |
+						(((c >> 8 & 0xFF) + dg) & 0xFF) << 8 |
+						(((c & 0xFF) + dg - 8 + (d2 & 15)) & 0xFF);
+					break;
+				}
+				default:
+					run = (b & 63) + 1;
+					break;
+				}
+
+				index[((c >> 16) * 3 + (c >> 8 & 0xFF) * 5 + (c & 0xFF) * 7 + 53) & 63] = c;
+
+				for (; run != 0 && i < pixel_amount; run--)
+					out[i++] = colors::alpha | c;
+			}
+
+			return true;
+		}
+
+		// whole QOI file into out (RGB, top row first, alpha ignored)
+		void encode_qoi(const color_t* colors, upoint dim, std::vector<uint8_t>& out)
+		{
+			out.clear();
+			out.reserve(14 + dim.x * dim.y + 8);
+
+			auto put32 = [&](unsigned v)
+			{
+				for (int shift = 24; shift >= 0; shift -= 8)
+					out.push_back(static_cast<uint8_t>(v >> shift));
+			};
+
+			out.insert(out.end(), { 'q', 'o', 'i', 'f' });
+			put32(dim.x);
+			put32(dim.y);
+			out.push_back(3);
+			out.push_back(0);
+
+			encode_qoi_chunks(colors + (dim.y - 1) * dim.x, dim.x, dim.y, -static_cast<ptrdiff_t>(dim.x), out);
+
+			out.insert(out.end(), { 0, 0, 0, 0, 0, 0, 0, 1 });
+		}
+
+		// YUV4MPEG2 stream header, 4:2:0 full range BT.601 (C420jpeg)
+		inline int y4m_header(char* buffer, size_t size, upoint dim, unsigned fps)
+		{
+			return snprintf(buffer, size, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n", dim.x, dim.y, fps);
+		}
+
+		// one "FRAME" of the stream into out, chroma averaged over 2x2 pixels
+		void encode_y4m_frame(const color_t* colors, upoint dim, std::vector<uint8_t>& out)
+		{
+			unsigned cw = (dim.x + 1) >> 1, ch = (dim.y + 1) >> 1;
+
+			out.resize(6 + dim.x * dim.y + 2 * cw * ch);
+			memcpy(out.data(), "FRAME\n", 6);
+
+			uint8_t* yp = out.data() + 6, * up = yp + dim.x * dim.y, * vp = up + cw * ch;
+
+			for (unsigned y = 0; y < dim.y; y++)
+			{
+				const color_t* px = colors + (dim.y - 1 - y) * dim.x;
+				for (unsigned x = 0; x < dim.x; x++)
+				{
+					int r = px[x] >> 16 & 0xFF, g = px[x] >> 8 & 0xFF, b = px[x] & 0xFF;
+					yp[y * dim.x + x] = static_cast<uint8_t>((77 * r + 150 * g + 29 * b + 128) >> 8);
+				}
+			}
+
+			for (unsigned cy = 0; cy < ch; cy++)
+				for (unsigned cx = 0; cx < cw; cx++)
+				{
+					int r = 0, g = 0, b = 0, n = 0;
+					for (unsigned y = cy * 2; y < (std::min)(cy * 2 + 2, dim.y); y++)
+						for (unsigned x = cx * 2; x < (std::min)(cx * 2 + 2, dim.x); x++, n++)
+						{
+							color_t c = colors[(dim.y - 1 - y) * dim.x + x];
+							r += c >> 16 & 0xFF;
+							g += c >> 8 & 0xFF;
+							b += c & 0xFF;
+						}
+
+					r /= n; g /= n; b /= n;
+					up[cy * cw + cx] = static_cast<uint8_t>(std::clamp((-43 * r - 85 * g + 128 * b + 128) / 256 + 128, 0, 255));
+					vp[cy * cw + cx] = static_cast<uint8_t>(std::clamp((128 * r - 107 * g - 21 * b + 128) / 256 + 128, 0, 255));
+				}
+		}
+
+		bool write_file(const char* file_name, const std::vector<uint8_t>& bytes)
+		{
+			FILE* file = fopen(file_name, "wb");
+			if (file == nullptr)
+				return false;
+
+			size_t written = fwrite(bytes.data(), 1, bytes.size(), file);
+			return (fclose(file) == 0) & (written == bytes.size());
+		}
+
+		bool write_ppm(const char* file_name, const color_t* colors, upoint dim)
+		{
+			std::vector<uint8_t> bytes;
+			encode_ppm(colors, dim, bytes);
+			return write_file(file_name, bytes);
+		}
+
+		bool write_pfm(const char* file_name, const float* depth, upoint dim)
+		{
+			FILE* file = fopen(file_name, "wb");
+			if (file == nullptr)
+				return false;
+
+			// negative scale = little endian
+			fprintf(file, "Pf\n%u %u\n-1.0\n", dim.x, dim.y);
+			fwrite(depth, sizeof(float), dim.x * dim.y, file);
+
+			return fclose(file) == 0;
+		}
+
+		inline bool write(const char* ppm_name, const char* pfm_name, const image* img)
+		{
+			return write_ppm(ppm_name, img->colors.data(), img->dim) &&
+				(img->depth.empty() || write_pfm(pfm_name, img->depth.data(), img->dim));
+		}
+
+		// "P6"/"Pf" header, returns false on anything else
+		bool read_header(FILE* file, const char* magic, upoint& dim, float& scale)
+		{
+			char m[3] = {};
+			if (fscanf(file, "%2s %u %u %f", m, &dim.x, &dim.y, &scale) != 4 || strcmp(m, magic) != 0)
+				return false;
+			// exactly one whitespace before the data
+			fgetc(file);
+			return true;
+		}
+
+		bool read_ppm(const char* file_name, image* out)
+		{
+			FILE* file = fopen(file_name, "rb");
+			if (file == nullptr)
+				return false;
+
+			float max_value;
+			bool ok = read_header(file, "P6", out->dim, max_value) && max_value == 255.0f;
+
+			if (ok)
+			{
+				out->colors.resize(out->dim.x * out->dim.y);
+				std::vector<uint8_t> row(out->dim.x * 3);
+
+				for (unsigned y = out->dim.y; ok && y-- > 0;)
+				{
+					ok = fread(row.data(), 1, row.size(), file) == row.size();
+					color_t* px = out->colors.data() + y * out->dim.x;
+					for (unsigned x = 0; x < out->dim.x; x++)
+						px[x] = colors::alpha | row[x * 3] << 16 | row[x * 3 + 1] << 8 | row[x * 3 + 2];
+				}
+			}
+
+			fclose(file);
+			return ok;
+		}
+
+		// little endian PFM only (what write_pfm makes)
+		bool read_pfm(const char* file_name, image* out)
+		{
+			FILE* file = fopen(file_name, "rb");
+			if (file == nullptr)
+				return false;
+
+			upoint dim;
+			float scale;
+			bool ok = read_header(file, "Pf", dim, scale) && scale < 0.0f && (out->colors.empty() || dim == out->dim);
+
+			if (ok)
+			{
+				out->dim = dim;
+				out->depth.resize(dim.x * dim.y);
+				ok = fread(out->depth.data(), sizeof(float), out->depth.size(), file) == out->depth.size();
+			}
+
+			fclose(file);
+			return ok;
+		}
+
+		struct tolerance
+		{
+			// largest accepted difference of a color channel
+			unsigned color;
+			// largest accepted relative depth error
+			float depth;
+			// pixels allowed over the tolerances before the compare fails
+			unsigned mismatches;
+		};
+
+		struct diff_result
+		{
+			unsigned pixels, color_mismatches, depth_mismatches;
+			unsigned max_color_delta;
+			float max_depth_error;
+			// first mismatching pixel (bottom-up), -1 when none
+			ipoint first;
+
+			inline unsigned mismatches() const
+			{
+				return (std::max)(color_mismatches, depth_mismatches);
+			}
+
+			inline bool passed(const tolerance& tol) const
+			{
+				return mismatches() <= tol.mismatches;
+			}
+		};
+
+		inline unsigned color_delta(color_t a, color_t b)
+		{
+			unsigned d = 0;
+			for (unsigned shift = 0; shift < 24; shift += 8)
+			{
+				int ca = (a >> shift) & 0xFF, cb = (b >> shift) & 0xFF;
+				d = (std::max)(d, static_cast<unsigned>(abs(ca - cb)));
+			}
+			return d;
+		}
+
+		// relative to the reference, untouched pixels (cleared depth) only match each other
+		inline float depth_error(float value, float reference)
+		{
+			if (value == reference)
+				return 0.0f;
+			return fabsf(value - reference) / (std::max)(fabsf(reference), 1e-6f);
+		}
+
+		// value against reference, depth only when both have it, mismatch_mask (optional) gets 1 per failing pixel
+		diff_result compare(const image* value, const image* reference, const tolerance& tol, std::vector<uint8_t>* mismatch_mask = nullptr)
+		{
+			assert(value->dim == reference->dim);
+
+			diff_result r = { value->dim.x * value->dim.y, 0, 0, 0, 0.0f, ipoint(-1, -1) };
+			bool depth = value->depth.empty() == false && reference->depth.empty() == false;
+
+			if (mismatch_mask != nullptr)
+				mismatch_mask->assign(r.pixels, 0);
+
+			for (unsigned i = 0; i < r.pixels; i++)
+			{
+				unsigned cd = color_delta(value->colors[i], reference->colors[i]);
+				float de = depth ? depth_error(value->depth[i], reference->depth[i]) : 0.0f;
+				bool color_fail = cd > tol.color, depth_fail = de > tol.depth;
+
+				r.max_color_delta = (std::max)(r.max_color_delta, cd);
+				r.max_depth_error = (std::max)(r.max_depth_error, de);
+				r.color_mismatches += color_fail;
+				r.depth_mismatches += depth_fail;
+
+				if (color_fail || depth_fail)
+				{
+					if (r.first.x < 0)
+						r.first = ipoint(i % value->dim.x, i / value->dim.x);
+					if (mismatch_mask != nullptr)
+						(*mismatch_mask)[i] = 1;
+				}
+			}
+
+			return r;
+		}
+
+		// darkened reference with the failing pixels in red
+		void diff_colors(const image* reference, const std::vector<uint8_t>& mismatch_mask, std::vector<color_t>& out)
+		{
+			out.resize(reference->colors.size());
+			for (size_t i = 0; i < out.size(); i++)
+				out[i] = mismatch_mask[i] ? colors::red : colors::alpha | ((reference->colors[i] >> 2) & 0x3F3F3F);
+		}
+	}
+}
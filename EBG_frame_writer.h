@@ -0,0 +1,213 @@
+#pragma once
+
+#include "EBG_capture.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+namespace ebg
+{
+	enum image_formats { fppm, fqoi, fy4m };
+
+	// image sequence writer: submit copies the frame into one of a fixed amount of slots,
+	// worker threads encode & write them, rendering only waits when every slot is still queued
+	// ppm/qoi: one file per frame (printf pattern with the frame index), y4m: one stream, frames in order
+	class frame_writer
+	{
+	public:
+		upoint dim;
+		uint8_t format;
+		// frames submitted / written, times submit had to wait for a slot, failed writes
+		unsigned submitted, written, stalls, errors;
+
+	private:
+		struct slot
+		{
+			std::vector<color_t> colors;
+			unsigned frame;
+		};
+
+		std::string pattern;
+		FILE* stream;
+		std::vector<slot> slots;
+		std::vector<unsigned> free_slots;
+		std::deque<unsigned> queued;
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable free_cv, work_cv, order_cv;
+		// next frame the stream waits for
+		unsigned next_write;
+		bool stopping;
+
+		void work()
+		{
+			std::vector<uint8_t> bytes;
+
+			while (true)
+			{
+				unsigned index;
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					work_cv.wait(lock, [&] { return stopping || queued.empty() == false; });
+
+					if (queued.empty())
+						return;
+					index = queued.front();
+					queued.pop_front();
+				}
+
+				slot& s = slots[index];
+				bool ok;
+
+				switch (format)
+				{
+				case fppm:
+					capture::encode_ppm(s.colors.data(), dim, bytes);
+					break;
+				case fqoi:
+					capture::encode_qoi(s.colors.data(), dim, bytes);
+					break;
+				default:
+					capture::encode_y4m_frame(s.colors.data(), dim, bytes);
+					break;
+				}
+
+				if (format == fy4m)
+				{
+					// its turn in the stream, written unlocked (submit never waits on the disk),
+					// no other worker writes before next_write moves on
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						order_cv.wait(lock, [&] { return next_write == s.frame; });
+					}
+
+					ok = stream != nullptr && fwrite(bytes.data(), 1, bytes.size(), stream) == bytes.size();
+
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						next_write++;
+					}
+					order_cv.notify_all();
+				}
+				else
+				{
+					char name[512];
+					snprintf(name, sizeof(name), pattern.c_str(), s.frame);
+					ok = capture::write_file(name, bytes);
+				}
+
+				std::lock_guard<std::mutex> lock(mutex);
+				written++;
+				errors += ok == false;
+				free_slots.push_back(index);
+				free_cv.notify_one();
+			}
+		}
+
+	public:
+		// out: printf pattern of the file names (ppm, qoi), file name or "-" for stdout (y4m)
+		// slot_amount: frames buffered between rendering & the workers
+		frame_writer(upoint dim, uint8_t format, const char* out, unsigned fps, unsigned worker_amount, unsigned slot_amount)
+			: dim(dim), format(format), submitted(0), written(0), stalls(0), errors(0), pattern(out), stream(nullptr), next_write(0), stopping(false)
+		{
+			if (format == fy4m)
+			{
+				if (strcmp(out, "-") == 0)
+				{
+#ifdef _WIN32
+					_setmode(_fileno(stdout), _O_BINARY);
+#endif
+					stream = stdout;
+				}
+				else
+					stream = fopen(out, "wb");
+
+				if (stream != nullptr)
+				{
+					char header[128];
+					fwrite(header, 1, capture::y4m_header(header, sizeof(header), dim, fps), stream);
+				}
+				else
+					errors++;
+			}
+
+			slots.resize((std::max)(slot_amount, 1U));
+			for (unsigned i = 0; i < slots.size(); i++)
+			{
+				slots[i].colors.resize(dim.x * dim.y);
+				free_slots.push_back(i);
+			}
+
+			for (unsigned i = 0; i < (std::max)(worker_amount, 1U); i++)
+				workers.emplace_back(&frame_writer::work, this);
+		}
+
+		~frame_writer()
+		{
+			finish();
+		}
+
+		inline bool failed() const
+		{
+			return errors != 0;
+		}
+
+		// row-major colors (dim.x * dim.y), y = 0 at the bottom
+		void submit(const color_t* colors)
+		{
+			unsigned index;
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				if (free_slots.empty())
+				{
+					stalls++;
+					free_cv.wait(lock, [&] { return free_slots.empty() == false; });
+				}
+
+				index = free_slots.back();
+				free_slots.pop_back();
+			}
+
+			memcpy(slots[index].colors.data(), colors, slots[index].colors.size() << 2);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				slots[index].frame = submitted++;
+				queued.push_back(index);
+			}
+			work_cv.notify_one();
+		}
+
+		// writes everything queued, then stops the workers
+		void finish()
+		{
+			if (workers.empty())
+				return;
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			work_cv.notify_all();
+
+			for (std::thread& t : workers)
+				t.join();
+			workers.clear();
+
+			if (stream != nullptr)
+			{
+				if ((stream == stdout ? fflush(stream) : fclose(stream)) != 0)
+					errors++;
+				stream = nullptr;
+			}
+		}
+	};
+}
@@ -1,6 +1,12 @@
 #pragma once
 
 #include "EBG_basics.h"
+#include "EBG_stats.h"
+#include "EBG_texture.h"
+
+#include <emmintrin.h>
+#include <array>
+#include <vector>
 
 #define EPSILON 0.125f
 
@@ -14,16 +20,54 @@ namespace ebg
 			return b | (g << 010) | (r << 020) | (a << 030);
 		}
 
+		// spreads the low 4 bits of x to the even bits (morton order inside a tile)
+		inline constexpr unsigned spread_bits(unsigned x)
+		{
+			x = (x | (x << 2)) & 0x33U;
+			return (x | (x << 1)) & 0x55U;
+		}
+
+		struct msaa_samples;
+
 		struct surface
 		{
 			color_t* buffer, * end;
 			upoint dim;
 			unsigned buffer_size;
 
-			constexpr surface() : buffer(nullptr), end(nullptr), dim(), buffer_size(0) {}
-			surface(upoint dimIn, bool alloc = true) : dim(dimIn)
+			// tiled layout: pixel (x, y) lives at x_offsets[x] + y_offsets[y]
+			// tiles are (1 << tile_log2) squares in Z-order, row-major between tiles
+			// nullptr on row-major surfaces
+			unsigned* x_offsets, * y_offsets;
+			unsigned tile_log2;
+
+			// rows [row_begin, row_end) the triangle rasterisers may write,
+			// copies of a surface with disjoint bands can be drawn from different threads
+			unsigned row_begin, row_end;
+
+			// dim the buffer & offset tables were allocated for, resize_surface stays inside it
+			upoint max_dim;
+
+			// 8x8 pixel blocks the triangle rasterisers may write (nonzero), (dim.x + 7) >> 3 per block row,
+			// nullptr = the whole surface (partial redraws, see EBG_reprojection.h)
+			const uint8_t* repaint;
+
+			// 4x multisampled target the triangle rasterisers draw into instead of buffer (resolve_msaa), nullptr = none
+			msaa_samples* msaa;
+
+			constexpr surface() : buffer(nullptr), end(nullptr), dim(), buffer_size(0), x_offsets(nullptr), y_offsets(nullptr), tile_log2(0), row_begin(0), row_end(0), max_dim(), repaint(nullptr), msaa(nullptr) {}
+			surface(upoint dimIn, bool alloc = true, unsigned tile_log2In = 0) : dim(dimIn), x_offsets(nullptr), y_offsets(nullptr), tile_log2(tile_log2In), row_begin(0), row_end(dimIn.y), max_dim(dimIn), repaint(nullptr), msaa(nullptr)
 			{
-				buffer_size = dim.x * dim.y;
+				if (tile_log2 != 0)
+				{
+					assert(tile_log2 <= 4);
+
+					x_offsets = TYPE_MALLOC(unsigned, dim.x);
+					y_offsets = TYPE_MALLOC(unsigned, dim.y);
+				}
+
+				layout();
+
 				if (alloc)
 				{
 					buffer = TYPE_MALLOC(color_t, buffer_size);
@@ -33,12 +77,55 @@ namespace ebg
 
 				buffer = end = nullptr;
 			}
+
+			// buffer_size & offset tables of the current dim
+			void layout()
+			{
+				buffer_size = dim.x * dim.y;
+
+				if (tile_log2 == 0)
+					return;
+
+				unsigned mask = (1U << tile_log2) - 1U,
+					tile_area_log2 = tile_log2 << 1,
+					tiles_x = (dim.x + mask) >> tile_log2,
+					tiles_y = (dim.y + mask) >> tile_log2;
+
+				// padded up to whole tiles, so clears also cover the padding
+				buffer_size = (tiles_x * tiles_y) << tile_area_log2;
+
+				for (unsigned x = 0; x < dim.x; x++)
+					x_offsets[x] = ((x >> tile_log2) << tile_area_log2) + spread_bits(x & mask);
+				for (unsigned y = 0; y < dim.y; y++)
+					y_offsets[y] = ((y >> tile_log2) * tiles_x << tile_area_log2) + (spread_bits(y & mask) << 1);
+			}
 		};
 
+		// same allocation, smaller (or back to the full) dim, the pixels are undefined after
+		inline void resize_surface(surface* surf, upoint dim)
+		{
+			assert(dim.x <= surf->max_dim.x && dim.y <= surf->max_dim.y);
+
+			surf->dim = dim;
+			surf->row_begin = 0;
+			surf->row_end = dim.y;
+			surf->layout();
+			surf->end = surf->buffer + surf->buffer_size;
+		}
+
+		inline unsigned pixel_offset(unsigned x, unsigned y, const surface* surf)
+		{
+			return surf->x_offsets == nullptr ? x + y * surf->dim.x : surf->x_offsets[x] + surf->y_offsets[y];
+		}
+
 		inline void delete_surface(surface* surf)
 		{
 			free(surf->buffer);
 			surf->buffer = nullptr;
+
+			free(surf->x_offsets);
+			free(surf->y_offsets);
+			surf->x_offsets = surf->y_offsets = nullptr;
 		}
 		inline void copy_surface(surface* src, surface* dest)
 		{
@@ -56,6 +143,364 @@ namespace ebg
 		{
 			memset(surf.buffer, c, surf.buffer_size << 2);
 		}
+		inline void fill(color_t c, surface* surf)
+		{
+			std::fill(surf->buffer, surf->buffer + surf->buffer_size, c);
+		}
+
+		// tiled -> row-major copy for presenting and capturing, dest holds dim.x * dim.y pixels
+		// buffer: any 4 byte per pixel buffer laid out like src (its colors, a depth buffer)
+		void detile(const surface* src, const uint32_t* buffer, uint32_t* dest)
+		{
+			unsigned w = src->dim.x, h = src->dim.y,
+				ew = w & ~1U, eh = h & ~1U;
+
+			// Z-order keeps every 2x2 quad in 4 consecutive pixels,
+			// two quads side by side make 4 pixels of two rows
+			for (unsigned y = 0; y < eh; y += 2)
+			{
+				const uint32_t* row = buffer + src->y_offsets[y];
+				uint32_t* d0 = dest + y * w, * d1 = d0 + w;
+				unsigned x = 0;
+
+				for (; x + 4 <= ew; x += 4)
+				{
+					__m128i q0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + src->x_offsets[x])),
+						q1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + src->x_offsets[x + 2]));
+
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(d0 + x), _mm_unpacklo_epi64(q0, q1));
+					_mm_storeu_si128(reinterpret_cast<__m128i*>(d1 + x), _mm_unpackhi_epi64(q0, q1));
+				}
+
+				if (x < ew)
+				{
+					__m128i q = _mm_loadu_si128(reinterpret_cast<const __m128i*>(row + src->x_offsets[x]));
+
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(d0 + x), q);
+					_mm_storel_epi64(reinterpret_cast<__m128i*>(d1 + x), _mm_unpackhi_epi64(q, q));
+				}
+			}
+
+			// odd width or height
+			if (ew != w)
+				for (unsigned y = 0; y < h; y++)
+					dest[y * w + ew] = buffer[pixel_offset(ew, y, src)];
+			if (eh != h)
+				for (unsigned x = 0; x < w; x++)
+					dest[eh * w + x] = buffer[pixel_offset(x, eh, src)];
+		}
+
+		inline void detile(const surface* src, color_t* dest)
+		{
+			detile(src, src->buffer, dest);
+		}
+
+		// source coordinate of every destination pixel center: 16.16 fixed point, clamped to the source
+		inline unsigned scale_position(unsigned d, unsigned src_size, unsigned dest_size)
+		{
+			long long p = ((2LL * d + 1) * src_size << 15) / dest_size - (1 << 15);
+			return static_cast<unsigned>(std::clamp(p, 0LL, static_cast<long long>(src_size - 1) << 16));
+		}
+
+		// row-major src (src_dim) stretched over row-major dest (dest_dim), nearest pixel
+		void upscale_nearest(const color_t* src, upoint src_dim, color_t* dest, upoint dest_dim)
+		{
+			std::vector<unsigned> xs(dest_dim.x);
+			for (unsigned x = 0; x < dest_dim.x; x++)
+				xs[x] = (scale_position(x, src_dim.x, dest_dim.x) + 0x8000) >> 16;
+
+			for (unsigned y = 0; y < dest_dim.y; y++)
+			{
+				const color_t* row = src + ((scale_position(y, src_dim.y, dest_dim.y) + 0x8000) >> 16) * src_dim.x;
+				color_t* d = dest + y * dest_dim.x;
+
+				for (unsigned x = 0; x < dest_dim.x; x++)
+					d[x] = row[xs[x]];
+			}
+		}
+
+		// row-major src (src_dim) stretched over row-major dest (dest_dim), bilinear with 7 bit weights:
+		// source rows are stretched horizontally once into 16 bit channel rows (2 pixels per SSE2 register),
+		// every destination row is then a vertical lerp of two of them (4 pixels per step)
+		void upscale_bilinear(const color_t* src, upoint src_dim, color_t* dest, upoint dest_dim)
+		{
+			if (src_dim == dest_dim)
+			{
+				if (src != dest)
+					memcpy(dest, src, (src_dim.x * src_dim.y) << 2);
+				return;
+			}
+
+			// pairs of destination pixels, padded to a multiple of 4 for the vertical pass
+			unsigned pairs = (dest_dim.x + 3) >> 2 << 1;
+			std::vector<unsigned> x0s(pairs * 2);
+			std::vector<short> weights(pairs * 2);
+			// weights of every pair, then the two stretched rows
+			__m128i* wxs = TYPE_MALLOC(__m128i, pairs * 3);
+			assert(wxs != nullptr);
+
+			// left source pixel & weight of the right one, the last column lerps
+			// from its left neighbour at full weight so both are always inside the row
+			for (unsigned x = 0; x < pairs * 2; x++)
+			{
+				unsigned p = scale_position((std::min)(x, dest_dim.x - 1), src_dim.x, dest_dim.x);
+				x0s[x] = p >> 16;
+				weights[x] = static_cast<short>((p & 0xFFFF) >> 9);
+
+				if (x0s[x] + 1 >= src_dim.x)
+				{
+					x0s[x] = src_dim.x - 2;
+					weights[x] = 128;
+				}
+			}
+			for (unsigned i = 0; i < pairs; i++)
+			{
+				short a = weights[i * 2], b = weights[i * 2 + 1];
+				wxs[i] = _mm_set_epi16(b, b, b, b, a, a, a, a);
+			}
+
+			__m128i zero = _mm_setzero_si128();
+			__m128i* lower = wxs + pairs, * upper = lower + pairs;
+			unsigned lower_y = ~0U, upper_y = ~0U;
+
+			auto stretch_row = [&](unsigned y, __m128i* out)
+			{
+				const color_t* row = src + y * src_dim.x;
+				for (unsigned i = 0; i < pairs; i++)
+				{
+					// [left, right] source pixels of both destination pixels -> [left 1, left 2] & [right 1, right 2]
+					__m128i p1 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + x0s[i * 2])), zero),
+						p2 = _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(row + x0s[i * 2 + 1])), zero),
+						a = _mm_unpacklo_epi64(p1, p2),
+						b = _mm_unpackhi_epi64(p1, p2);
+
+					out[i] = _mm_add_epi16(a, _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(b, a), wxs[i]), 7));
+				}
+			};
+
+			for (unsigned y = 0; y < dest_dim.y; y++)
+			{
+				unsigned p = scale_position(y, src_dim.y, dest_dim.y),
+					y0 = p >> 16, y1 = (std::min)(y0 + 1, src_dim.y - 1);
+
+				if (lower_y != y0)
+				{
+					// moving up one source row: the upper row becomes the lower one
+					if (upper_y == y0)
+						std::swap(lower, upper);
+					else
+						stretch_row(y0, lower);
+					lower_y = y0;
+					upper_y = ~0U;
+				}
+				if (upper_y != y1)
+				{
+					stretch_row(y1, upper);
+					upper_y = y1;
+				}
+
+				__m128i wy = _mm_set1_epi16(static_cast<short>((p & 0xFFFF) >> 9));
+				color_t* d = dest + y * dest_dim.x;
+				unsigned x = 0;
+
+				for (unsigned i = 0; i < pairs; i += 2, x += 4)
+				{
+					__m128i v0 = _mm_add_epi16(lower[i], _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(upper[i], lower[i]), wy), 7)),
+						v1 = _mm_add_epi16(lower[i + 1], _mm_srai_epi16(_mm_mullo_epi16(_mm_sub_epi16(upper[i + 1], lower[i + 1]), wy), 7)),
+						packed = _mm_packus_epi16(v0, v1);
+
+					if (x + 4 <= dest_dim.x)
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(d + x), packed);
+					else
+					{
+						color_t last[4];
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(last), packed);
+						memcpy(d + x, last, (dest_dim.x - x) << 2);
+					}
+				}
+			}
+
+			free(wxs);
+		}
+
+		/*
+		4x multisampled target of the triangle rasterisers (surface::msaa), resolved into a surface after drawing
+
+		samples are a 2x2 grid in every pixel, sample (sx, sy) of the doubled grid is sample (sy & 1) * 2 + (sx & 1)
+		of pixel (sx >> 1, sy >> 1), kept in 8x8 pixel tiles in one of the states
+		mclear: nothing drawn, nothing stored (a clear only resets the states)
+		mplane: every sample is one triangle's, the tile keeps its depth plane & one color per pixel (sample 0)
+		mexpanded: the depth & color of every sample, colors of samples still at the clear depth are undefined (resolved as 0)
+		colors of a tile are 4 planes of its 64 pixels (sample 0 of all of them, then 1 ...), depths the 4 samples of a pixel together
+		*/
+		enum msaa_tile_states { mclear, mplane, mexpanded };
+
+		constexpr unsigned msaa_tile_samples = 256;
+
+		// depth at the first sample of a tile & its change per sample along x & y
+		struct msaa_plane
+		{
+			float z, dx, dy;
+		};
+
+		struct msaa_samples
+		{
+			// dim: the surface's, tiles: 8x8 pixel tiles covering it
+			upoint dim, tiles;
+			uint8_t* states;
+			msaa_plane* planes;
+			color_t* colors;
+			float* depths;
+			// tiles allocated
+			unsigned capacity;
+		};
+
+		inline void delete_msaa_samples(msaa_samples* m)
+		{
+			free(m->states);
+			free(m->planes);
+			free(m->colors);
+			free(m->depths);
+			m->states = nullptr;
+			m->planes = nullptr;
+			m->colors = nullptr;
+			m->depths = nullptr;
+			m->capacity = 0;
+		}
+
+		// samples of a surface of dim (a zero initialized msaa_samples at first), grows to the largest dim seen
+		void resize_msaa_samples(msaa_samples* m, upoint dim)
+		{
+			m->dim = dim;
+			m->tiles = upoint((dim.x + 7) >> 3, (dim.y + 7) >> 3);
+
+			unsigned amount = m->tiles.x * m->tiles.y;
+			if (amount <= m->capacity)
+				return;
+
+			delete_msaa_samples(m);
+			m->capacity = amount;
+			m->states = TYPE_MALLOC(uint8_t, amount);
+			m->planes = TYPE_MALLOC(msaa_plane, amount);
+			m->colors = TYPE_MALLOC(color_t, amount * msaa_tile_samples);
+			m->depths = TYPE_MALLOC(float, amount * msaa_tile_samples);
+			assert(m->states != nullptr && m->planes != nullptr && m->colors != nullptr && m->depths != nullptr);
+		}
+
+		inline void clear_msaa_samples(msaa_samples* m)
+		{
+			memset(m->states, mclear, m->tiles.x * m->tiles.y);
+		}
+
+		// every sample of tile t stored, for a triangle covering only some of them
+		void expand_msaa_tile(msaa_samples* m, unsigned t)
+		{
+			color_t* colors = m->colors + t * msaa_tile_samples;
+			float* depths = m->depths + t * msaa_tile_samples;
+
+			if (m->states[t] == mclear)
+				memset(depths, 0b01111111, msaa_tile_samples << 2);
+			else if (m->states[t] == mplane)
+			{
+				for (unsigned s = 1; s < 4; s++)
+					memcpy(colors + (s << 6), colors, 64 << 2);
+
+				msaa_plane p = m->planes[t];
+				__m128 offsets = _mm_setr_ps(0.0f, p.dx, p.dy, p.dx + p.dy);
+				for (unsigned y = 0; y < 8; y++)
+					for (unsigned x = 0; x < 8; x++)
+						_mm_storeu_ps(depths + (((y << 3) + x) << 2),
+							_mm_add_ps(_mm_set1_ps(p.z + p.dx * float(x << 1) + p.dy * float(y << 1)), offsets));
+			}
+
+			m->states[t] = mexpanded;
+		}
+
+		/*
+		rows [row_begin, row_end) of the samples into surf (the same dim, either layout), 4 pixels at a time:
+		the average of the samples' colors & the nearest sample's depth into depth_buffer (laid out like surf, nullptr = colors only),
+		samples nothing was drawn on are clear_color
+		*/
+		void resolve_msaa(const msaa_samples* m, surface* surf, float* depth_buffer, color_t clear_color, unsigned row_begin, unsigned row_end)
+		{
+			assert(m->dim == surf->dim);
+
+			__m128i zero = _mm_setzero_si128(), two = _mm_set1_epi16(2), clear = _mm_set1_epi32(static_cast<int>(clear_color));
+			__m128 far_depth = _mm_castsi128_ps(_mm_set1_epi8(0b01111111)), steps = _mm_setr_ps(0.0f, 2.0f, 4.0f, 6.0f);
+
+			for (unsigned y = row_begin; y < row_end; y++)
+			{
+				const uint8_t* states = m->states + (y >> 3) * m->tiles.x;
+
+				for (unsigned x = 0; x < m->dim.x; x += 4)
+				{
+					unsigned t = (y >> 3) * m->tiles.x + (x >> 3), p = ((y & 7) << 3) + (x & 7);
+					const color_t* colors = m->colors + t * msaa_tile_samples + p;
+					__m128i c;
+					__m128 z;
+
+					if (states[x >> 3] == mclear)
+					{
+						c = clear;
+						z = far_depth;
+					}
+					else if (states[x >> 3] == mplane)
+					{
+						c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(colors));
+
+						// the nearest of a pixel's samples is a step along x & y away where the plane falls
+						msaa_plane q = m->planes[t];
+						float first = q.z + q.dx * float((x & 7) << 1) + q.dy * float((y & 7) << 1) + (std::min)(q.dx, 0.0f) + (std::min)(q.dy, 0.0f);
+						z = _mm_add_ps(_mm_set1_ps(first), _mm_mul_ps(steps, _mm_set1_ps(q.dx)));
+					}
+					else
+					{
+						// after the transpose d0 - d3 are samples 0 - 3 of the 4 pixels, like the color planes
+						const float* d = m->depths + ((t * msaa_tile_samples) + (p << 2));
+						__m128 d0 = _mm_loadu_ps(d), d1 = _mm_loadu_ps(d + 4), d2 = _mm_loadu_ps(d + 8), d3 = _mm_loadu_ps(d + 12);
+						_MM_TRANSPOSE4_PS(d0, d1, d2, d3);
+						z = _mm_min_ps(_mm_min_ps(d0, d1), _mm_min_ps(d2, d3));
+
+						// samples nothing was drawn on are clear_color
+						auto drawn = [clear, far_depth](const color_t* sample_colors, __m128 d)
+						{
+							__m128i covered = _mm_castps_si128(_mm_cmplt_ps(d, far_depth));
+							return _mm_or_si128(_mm_and_si128(covered, _mm_loadu_si128(reinterpret_cast<const __m128i*>(sample_colors))), _mm_andnot_si128(covered, clear));
+						};
+						__m128i s0 = drawn(colors, d0), s1 = drawn(colors + 64, d1), s2 = drawn(colors + 128, d2), s3 = drawn(colors + 192, d3);
+
+						// channel sums of 2 pixels in 16 bit lanes, rounded / 4
+						__m128i lo = _mm_add_epi16(_mm_add_epi16(_mm_unpacklo_epi8(s0, zero), _mm_unpacklo_epi8(s1, zero)),
+							_mm_add_epi16(_mm_unpacklo_epi8(s2, zero), _mm_unpacklo_epi8(s3, zero)));
+						__m128i hi = _mm_add_epi16(_mm_add_epi16(_mm_unpackhi_epi8(s0, zero), _mm_unpackhi_epi8(s1, zero)),
+							_mm_add_epi16(_mm_unpackhi_epi8(s2, zero), _mm_unpackhi_epi8(s3, zero)));
+						c = _mm_packus_epi16(_mm_srli_epi16(_mm_add_epi16(lo, two), 2), _mm_srli_epi16(_mm_add_epi16(hi, two), 2));
+					}
+
+					if (surf->x_offsets == nullptr && x + 4 <= m->dim.x)
+					{
+						unsigned o = y * m->dim.x + x;
+						_mm_storeu_si128(reinterpret_cast<__m128i*>(surf->buffer + o), c);
+						if (depth_buffer != nullptr)
+							_mm_storeu_ps(depth_buffer + o, z);
+						continue;
+					}
+
+					// tiled or the last pixels of a row
+					alignas(16) color_t cs[4];
+					alignas(16) float zs[4];
+					_mm_store_si128(reinterpret_cast<__m128i*>(cs), c);
+					_mm_store_ps(zs, z);
+					for (unsigned i = 0; i < 4 && x + i < m->dim.x; i++)
+					{
+						unsigned o = pixel_offset(x + i, y, surf);
+						surf->buffer[o] = cs[i];
+						if (depth_buffer != nullptr)
+							depth_buffer[o] = zs[i];
+					}
+				}
+			}
+		}
 	}
 
 	namespace data
@@ -69,12 +514,13 @@ namespace ebg
 			cs.buffer_size = cb_size >> 2;
 			cs.end = cs.buffer + cs.buffer_size;
 			cs.dim = upoint(cs.buffer_size, 1);
+			cs.row_end = 1;
 		}
 	}
 
 	namespace graphics
 	{
-#define GET_PIXEL(p, s) s->buffer[p.x + p.y * s->dim.x]
+#define GET_PIXEL(p, s) s->buffer[pixel_offset(p.x, p.y, s)]
 
 		inline color_t* get_raw_pixel(upoint p, surface* surf)
 		{
@@ -131,6 +577,16 @@ namespace ebg
 				if (d1 == d2) return;
 				if (d1 > d2) std::swap(d1, d2);
 
+				if (surf->x_offsets != nullptr)
+				{
+					unsigned* along = slope ? surf->y_offsets : surf->x_offsets;
+					unsigned across = slope ? surf->x_offsets[s] : surf->y_offsets[s];
+
+					for (int d = d1; d < d2; d++)
+						surf->buffer[along[d] + across] = color;
+					return;
+				}
+
 				unsigned offset_temp = s * steps.y;
 
 				for (color_t* px = &surf->buffer[d1 * steps.x + offset_temp],
@@ -265,6 +721,32 @@ namespace ebg
 				else
 					step = ipoint(1, idim.x);
 
+				if (surf->x_offsets != nullptr)
+				{
+					// tiled surfaces can't be walked with constant steps, look up every pixel
+					unsigned* major = slope ? surf->y_offsets : surf->x_offsets,
+						* minor = slope ? surf->x_offsets : surf->y_offsets;
+					int m = start.y, m_step = get_sign(d.y);
+
+					d.y = abs(d.y);
+
+					int err = d.x;
+					d <<= 1;
+
+					for (int x = start.x; x < end.x; x++)
+					{
+						surf->buffer[major[x] + minor[m]] = color;
+
+						err -= d.y;
+						if (err <= 0)
+						{
+							m += m_step;
+							err += d.x;
+						}
+					}
+					return;
+				}
+
 				color_t* px = surf->buffer + dot(start, step);
 
 				step.y *= get_sign(d.y);
@@ -293,186 +775,783 @@ namespace ebg
 				line(a, c, color, surf);
 			}
 
-			inline void sure_x_line(int xs, int xb, int y, color_t color, surface* surf)
+			// any repaint block under the inclusive pixel rect, within the surface & its row band
+			inline bool repaints(const surface* surf, ipoint lo, ipoint hi)
 			{
-				color_t* px = surf->buffer + y * surf->dim.x;
-				for (int x = xs; x <= xb; x++)
-					px[x] = color;
+				int right = (std::min)(hi.x, int(surf->dim.x) - 1), top = (std::min)(hi.y, int(surf->row_end) - 1);
+				lo = ipoint((std::max)(lo.x, 0), (std::max)(lo.y, int(surf->row_begin)));
+
+				if (lo.x > right || lo.y > top)
+					return false;
+
+				unsigned blocks_x = (surf->dim.x + 7) >> 3;
+				for (int by = lo.y >> 3; by <= top >> 3; by++)
+				{
+					const uint8_t* blocks = surf->repaint + by * blocks_x;
+					for (int bx = lo.x >> 3; bx <= right >> 3; bx++)
+						if (blocks[bx] != 0)
+							return true;
+				}
+
+				return false;
 			}
 
-			void rasterisation(ipoint a, ipoint b, ipoint c, color_t c1, color_t c2, surface* surf)
+			/*
+			Triangle raster core: one template, specialised at compile time on
+			depth_mode   znone: colors only, ztest: depth test & write (smaller z is nearer)
+			shade_mode   hflat: one color, hgouraud: vertex colors (r, g, b in 0 - 255) linear in screen space,
+			             stepped by a slope per pixel, htextured: the texture at vertex (u, v) perspective correct
+			             (u / z, v / z & 1 / z linear, z is the view depth) times the color, a mip level per span
+			blend_mode   bopaque, balpha: the color's alpha over the surface
+			layout       lrow: row-major, ltiled: x_offsets + y_offsets, lmasked: repaint blocks only (either layout)
+
+			every combination gets its own span loop without branches on the modes,
+			rasterise picks the layout once per triangle, the other modes are the caller's
+			*/
+			enum depth_modes { znone, ztest };
+			enum shade_modes { hflat, hgouraud, htextured };
+			enum blend_modes { bopaque, balpha };
+			enum pixel_layouts { lrow, ltiled, lmasked };
+
+			// values interpolated over the triangle besides z
+			template <uint8_t shade_mode>
+			constexpr unsigned attribute_amount = shade_mode == hgouraud ? 3 : shade_mode == htextured ? 2 : 0;
+
+			template <uint8_t shade_mode>
+			struct raster_vertex
+			{
+				ipoint p;
+				float z;
+				std::array<float, attribute_amount<shade_mode>> attributes;
+			};
+
+			// attributes in registers while walking the triangle, the lanes of one vector:
+			// hgouraud's b, g, r & 0, htextured's u / z, v / z, 1 / z & 0
+			template <uint8_t shade_mode>
+			struct raster_attributes
 			{
-				if (a.y > b.y)
-					std::swap(a, b);
-				if (b.y > c.y)
-					std::swap(b, c);
-				if (a.y > b.y)
-					std::swap(a, b);
+				typedef __m128 type;
+			};
 
-				ipoint dab = b - a,
-					dbc = c - b,
-					dac = c - a,
-					idim(surf->dim.x - 1, surf->dim.y);
+			template <>
+			struct raster_attributes<hflat>
+			{
+				struct type {};
+			};
 
-				int y = max(a.y, 0), sx, bx, t,
-					byl = min(b.y, idim.y),
-					cyl = min(c.y, idim.y);
+			// one half of a triangle by rows: from vertex o along the left (1) & right (2) edge, t = y - o.y rows away,
+			// z & the attributes at t * sign (1: down from the top vertex, -1: up from the bottom one)
+			template <uint8_t shade_mode>
+			struct raster_half
+			{
+				ipoint o, u1, u2;
+				float z, uz1, uz2, sign;
+				typename raster_attributes<shade_mode>::type pa, ua1, ua2;
+			};
+
+			// a triangle by rows: halves[0] over rows [y[0], y[1]), halves[1] over [y[1], y[2]),
+			// dy: change of the attributes per row (htextured's mip level),
+			// the walks of hgouraud & htextured are both raster_walk<hgouraud> (one vector of attributes)
+			template <uint8_t shade_mode>
+			struct raster_walk
+			{
+				raster_half<shade_mode> halves[2];
+				int y[3];
+				typename raster_attributes<shade_mode>::type dy;
+			};
 
-				ipoint u1, u2;
+			// same for a whole draw call, color: hflat's color, htextured's tint & balpha's alpha
+			struct raster_target
+			{
+				surface* surf;
+				float* depth_buffer;
+				color_t color;
+				const texture* tex;
+			};
+
+			// channels of texel * (color + 1) / 256, white keeps the texel, the alpha of color
+			inline color_t modulate(color_t texel, color_t color)
+			{
+				__m128i zero = _mm_setzero_si128();
+				__m128i t = _mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(texel)), zero),
+					c = _mm_add_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(color)), zero), _mm_set1_epi16(1));
+				t = _mm_srli_epi16(_mm_mullo_epi16(t, c), 8);
+				return (static_cast<color_t>(_mm_cvtsi128_si32(_mm_packus_epi16(t, t))) & 0xFFFFFFU) | (color & 0xFF000000U);
+			}
 
-				if (dac.x * dab.y > dab.x * dac.y)
-					u1 = dac, u2 = dab;
-				else
-					u1 = dab, u2 = dac;
+			// src over dst by the alpha of src, dst keeps its alpha
+			inline color_t blend_over(color_t dst, color_t src)
+			{
+				unsigned a = src >> 24, ia = 255 - a;
+				return (((src & 0xFF00FFU) * a + (dst & 0xFF00FFU) * ia) >> 8 & 0xFF00FFU) |
+					(((src & 0xFF00U) * a + (dst & 0xFF00U) * ia) >> 8 & 0xFF00U) |
+					(dst & 0xFF000000U);
+			}
 
-				while (y < byl)
-				{
-					t = y - a.y;
-					sx = std::clamp(a.x + t * u2.x / u2.y, 0, idim.x);
-					bx = std::clamp(a.x + t * u1.x / u1.y, 0, idim.x);
+			template <uint8_t depth_mode, uint8_t shade_mode, uint8_t blend_mode, uint8_t layout>
+			struct raster
+			{
+				typedef raster_vertex<shade_mode> vertex;
+				typedef raster_half<shade_mode == hflat ? hflat : hgouraud> half;
+				typedef raster_walk<shade_mode == hflat ? hflat : hgouraud> walk;
+				typedef typename raster_attributes<shade_mode>::type attributes;
 
-					sure_x_line(sx, bx, y++, c1, surf);
+				// of a span: htextured's mip level
+				struct no_sampler {};
+				typedef std::conditional_t<shade_mode == htextured, texture_sampler, no_sampler> sampler;
+
+				static inline unsigned row_offset(unsigned y, const surface* surf)
+				{
+					if constexpr (layout == lrow)
+						return y * surf->dim.x;
+					else if constexpr (layout == ltiled)
+						return surf->y_offsets[y];
+					else
+						return surf->x_offsets == nullptr ? y * surf->dim.x : surf->y_offsets[y];
 				}
 
-				if (dac.x * dbc.y > dbc.x * dac.y)
-					u1 = dac, u2 = dbc;
-				else
-					u1 = dbc, u2 = dac;
+				// inside the row, x_offsets of the surface (nullptr on row-major ones)
+				static inline unsigned offset(unsigned x, const unsigned* x_offsets)
+				{
+					if constexpr (layout == lrow)
+						return x;
+					else if constexpr (layout == ltiled)
+						return x_offsets[x];
+					else
+						return x_offsets == nullptr ? x : x_offsets[x];
+				}
 
-				while (y < cyl)
+				// raster_vertex::attributes into the lanes
+				static inline attributes pack(const vertex& v)
 				{
-					t = y - c.y;
-					sx = std::clamp(c.x + t * u1.x / u1.y, 0, idim.x);
-					bx = std::clamp(c.x + t * u2.x / u2.y, 0, idim.x);
+					if constexpr (shade_mode == hgouraud)
+						return _mm_setr_ps(v.attributes[2], v.attributes[1], v.attributes[0], 0.0f);
+					else if constexpr (shade_mode == htextured)
+					{
+						float q = 1.0f / v.z;
+						return _mm_setr_ps(v.attributes[0] * q, v.attributes[1] * q, q, 0.0f);
+					}
+					else
+						return {};
+				}
 
-					sure_x_line(sx, bx, y++, c2, surf);
+				// base + f * slope
+				static inline attributes along(attributes base, attributes slope, float f)
+				{
+					if constexpr (shade_mode != hflat)
+						return _mm_add_ps(base, _mm_mul_ps(slope, _mm_set1_ps(f)));
+					else
+						return {};
 				}
-			}
 
-			// I forgot how to sleep
-			// FUCK
-			void depth_sure_x_line(unsigned xs, unsigned xb, unsigned y, float z1, float z2, float* depth_buffer, color_t color, surface* surf)
-			{
-				unsigned offset = y * surf->dim.x;
-				color_t* px = surf->buffer + offset;
-				depth_buffer += offset;
+				// change per step of (to - from) over steps, 0 without steps
+				static inline attributes slopes(attributes from, attributes to, float steps)
+				{
+					if constexpr (shade_mode != hflat)
+						return _mm_mul_ps(_mm_sub_ps(to, from), _mm_set1_ps(steps != 0.0f ? 1.0f / steps : 0.0f));
+					else
+						return {};
+				}
 
-				if (xs == xb)
+				// change per row over the plane of the triangle for the mip level of htextured, dab & dac: b - a & c - a on the surface
+				static inline attributes gradient_y(attributes pa, attributes pb, attributes pc, ipoint dab, ipoint dac)
 				{
-					if (xs != 0 && xs != surf->dim.x - 1 && depth_buffer[xs] > z1)
+					if constexpr (shade_mode == htextured)
 					{
-						px[xs] = color;
-						depth_buffer[xs] = z1;
+						float det = float(dab.x) * float(dac.y) - float(dac.x) * float(dab.y);
+						return _mm_mul_ps(_mm_sub_ps(
+							_mm_mul_ps(_mm_sub_ps(pc, pa), _mm_set1_ps(float(dab.x))),
+							_mm_mul_ps(_mm_sub_ps(pb, pa), _mm_set1_ps(float(dac.x)))),
+							_mm_set1_ps(det != 0.0f ? 1.0f / det : 0.0f));
 					}
-					return;
+					else
+						return attributes();
 				}
 
-				float z, t = (z2 - z1) / float(xb - xs);
-				for (unsigned x = xs; x < xb; x++)
+				// a += slope, the incremental step of the span loops
+				static inline void step(attributes& a, attributes slope)
 				{
-					z = z1 + float(x - xs) * t;
+					if constexpr (shade_mode != hflat)
+						a = _mm_add_ps(a, slope);
+				}
+
+				// a1 & ta: start & step of a span of length + 1 pixels, dy: step per row of the triangle
+				static inline sampler begin_span(const raster_target& target, attributes a1, attributes ta, attributes dy, float length)
+				{
+					if constexpr (shade_mode == htextured)
+						return sampler_of(target.tex, texture_level(target.tex, along(a1, ta, length * 0.5f), ta, dy));
+					else
+						return {};
+				}
 
-					if (depth_buffer[x] > z)
+				// color: raster_target::color (a local copy, pixel stores could alias it)
+				static inline color_t shade(color_t color, attributes a, const sampler& s)
+				{
+					if constexpr (shade_mode == hgouraud)
 					{
-						px[x] = color;
-						depth_buffer[x] = z;
+						// truncated & saturated to bytes, the low 3 are b, g & r
+						__m128i c = _mm_cvttps_epi32(a);
+						c = _mm_packs_epi32(c, c);
+						return static_cast<color_t>(_mm_cvtsi128_si32(_mm_packus_epi16(c, c))) | (color & 0xFF000000U);
 					}
+					else if constexpr (shade_mode == htextured)
+						return modulate(sample(s, _mm_div_ps(a, _mm_shuffle_ps(a, a, _MM_SHUFFLE(2, 2, 2, 2)))), color);
+					else
+						return color;
 				}
 
-				if (depth_buffer[xb] > z2 + EPSILON)
+				static inline void put(color_t& px, color_t color)
 				{
-					px[xb] = color;
-					depth_buffer[xb] = z2;
+					if constexpr (blend_mode == balpha)
+						EBG_STATS_WRITE(px, blend_over(px, color));
+					else
+						EBG_STATS_WRITE(px, color);
 				}
-			}
 
-			void depth_rasterisation(ipoint a, ipoint b, ipoint c, float azIn, float bzIn, float czIn, float* depth_buffer, color_t c1, color_t c2, surface* surf)
-			{
-				if (a.y > b.y)
+				// depth tested pixels [x, end) of a span from xs, px & depth_buffer at the row, returns the passed ones
+				static inline unsigned run(unsigned x, unsigned end, unsigned xs, color_t* px, float* depth_buffer, float z1, float t,
+					attributes a1, attributes ta, const sampler& s, const raster_target& target)
 				{
-					std::swap(a, b);
-					std::swap(azIn, bzIn);
+					color_t color = target.color;
+					const unsigned* x_offsets = target.surf->x_offsets;
+					unsigned passed = 0;
+					attributes a = along(a1, ta, float(x - xs));
+
+					for (; x < end; x++, step(a, ta))
+					{
+						float z = z1 + float(x - xs) * t;
+						unsigned o = offset(x, x_offsets);
+
+						if (depth_buffer[o] > z)
+						{
+							passed++;
+							put(px[o], shade(color, a, s));
+							depth_buffer[o] = z;
+						}
+					}
+
+					return passed;
 				}
 
-				if (b.y > c.y)
+				/*
+				ztest: [xs, xb) against z linear from z1, the end pixel xb against z2 + EPSILON,
+				a single pixel span (xs == xb) against z1 and never on the first & last column
+				znone: all of [xs, xb]
+				dy: change of the attributes per row (htextured's mip level)
+				*/
+				static void span(unsigned xs, unsigned xb, unsigned y, float z1, float z2, attributes a1, attributes a2, attributes dy, const raster_target& target)
 				{
-					std::swap(b, c);
-					std::swap(bzIn, czIn);
+					surface* surf = target.surf;
+					unsigned row = row_offset(y, surf), o;
+					color_t* px = surf->buffer + row, color = target.color;
+					const unsigned* x_offsets = surf->x_offsets;
+					float* depth_buffer = target.depth_buffer + row;
+
+					const uint8_t* blocks = nullptr;
+					if constexpr (layout == lmasked)
+						blocks = surf->repaint + (y >> 3) * ((surf->dim.x + 7) >> 3);
+
+					if constexpr (depth_mode == znone)
+					{
+						if (xs > xb)
+							return;
+
+						attributes a = a1, ta = slopes(a1, a2, float(xb - xs));
+						sampler s = begin_span(target, a1, ta, dy, float(xb - xs));
+						for (unsigned x = xs; x <= xb; x++, step(a, ta))
+						{
+							if constexpr (layout == lmasked)
+								if (blocks[x >> 3] == 0)
+									continue;
+
+							put(px[offset(x, x_offsets)], shade(color, a, s));
+						}
+					}
+					else
+					{
+						if (xs == xb)
+						{
+							if constexpr (layout == lmasked)
+								if (blocks[xs >> 3] == 0)
+									return;
+
+							EBG_STATS_ADD(pixels_tested, 1);
+
+							o = offset(xs, x_offsets);
+							if (xs != 0 && xs != surf->dim.x - 1 && depth_buffer[o] > z1)
+							{
+								EBG_STATS_ADD(pixels_passed, 1);
+								put(px[o], shade(color, a1, begin_span(target, a1, slopes(a1, a2, 0.0f), dy, 0.0f)));
+								depth_buffer[o] = z1;
+							}
+							return;
+						}
+
+						unsigned passed = 0, tested = 0;
+
+						float t = (z2 - z1) / float(xb - xs);
+						attributes ta = slopes(a1, a2, float(xb - xs));
+						sampler s = begin_span(target, a1, ta, dy, float(xb - xs));
+
+						if constexpr (layout == lmasked)
+						{
+							for (unsigned bx = xs >> 3; bx <= xb >> 3; bx++)
+							{
+								if (blocks[bx] == 0)
+									continue;
+
+								unsigned x = (std::max)(bx << 3, xs), end = (std::min)((bx << 3) + 8, xb);
+								tested += end - x;
+								passed += run(x, end, xs, px, depth_buffer, z1, t, a1, ta, s, target);
+							}
+						}
+						else
+						{
+							tested = xb - xs;
+							passed = run(xs, xb, xs, px, depth_buffer, z1, t, a1, ta, s, target);
+						}
+
+						if (layout != lmasked || blocks[xb >> 3] != 0)
+						{
+							tested++;
+
+							o = offset(xb, x_offsets);
+							if (depth_buffer[o] > z2 + EPSILON)
+							{
+								passed++;
+								put(px[o], shade(color, a2, s));
+								depth_buffer[o] = z2;
+							}
+						}
+
+						EBG_STATS_ADD(pixels_tested, tested);
+						EBG_STATS_ADD(pixels_passed, passed);
+					}
 				}
 
-				if (a.y > b.y)
+				// the halves of a triangle, from & along which edges its rows are walked
+				static inline walk setup(vertex a, vertex b, vertex c)
 				{
-					std::swap(a, b);
-					std::swap(azIn, bzIn);
+					if (a.p.y > b.p.y)
+						std::swap(a, b);
+					if (b.p.y > c.p.y)
+						std::swap(b, c);
+					if (a.p.y > b.p.y)
+						std::swap(a, b);
+
+					walk w;
+					attributes pa = pack(a), pb = pack(b), pc = pack(c);
+					ipoint dab = b.p - a.p,
+						dbc = c.p - b.p,
+						dac = c.p - a.p;
+					w.dy = gradient_y(pa, pb, pc, dab, dac);
+					w.y[0] = a.p.y, w.y[1] = b.p.y, w.y[2] = c.p.y;
+
+					half& h1 = w.halves[0];
+					h1.o = a.p, h1.z = a.z, h1.sign = 1.0f, h1.pa = pa;
+
+					if (dac.x * dab.y < dab.x * dac.y)
+					{
+						h1.u1 = dac, h1.u2 = dab;
+						h1.uz1 = (c.z - a.z) / float(dac.y);
+						h1.uz2 = (b.z - a.z) / float(dab.y);
+						h1.ua1 = slopes(pa, pc, float(dac.y));
+						h1.ua2 = slopes(pa, pb, float(dab.y));
+					}
+					else
+					{
+						h1.u1 = dab, h1.u2 = dac;
+						h1.uz1 = (b.z - a.z) / float(dab.y);
+						h1.uz2 = (c.z - a.z) / float(dac.y);
+						h1.ua1 = slopes(pa, pb, float(dab.y));
+						h1.ua2 = slopes(pa, pc, float(dac.y));
+					}
+
+					// from c upwards
+					half& h2 = w.halves[1];
+					h2.o = c.p, h2.z = c.z, h2.sign = -1.0f, h2.pa = pc;
+
+					if (dac.x * dbc.y > dbc.x * dac.y)
+					{
+						h2.u1 = dac, h2.u2 = dbc;
+						h2.uz1 = (a.z - c.z) / float(dac.y);
+						h2.uz2 = (b.z - c.z) / float(dbc.y);
+						h2.ua1 = slopes(pc, pa, float(dac.y));
+						h2.ua2 = slopes(pc, pb, float(dbc.y));
+					}
+					else
+					{
+						h2.u1 = dbc, h2.u2 = dac;
+						h2.uz1 = (b.z - c.z) / float(dbc.y);
+						h2.uz2 = (a.z - c.z) / float(dac.y);
+						h2.ua1 = slopes(pc, pb, float(dbc.y));
+						h2.ua2 = slopes(pc, pa, float(dac.y));
+					}
+
+					return w;
 				}
 
-				ipoint dab = b - a,
-					dbc = c - b,
-					dac = c - a,
-					idim(surf->dim.x - 1, surf->dim.y);
+				// the span of row y of a half, the ends clamped to columns [0, right], z & the attributes at them
+				static inline void row(const half& h, int y, int right, unsigned& xs, unsigned& xb, float& z1, float& z2,
+					attributes& a1, attributes& a2)
+				{
+					int t = y - h.o.y;
+					float ft = float(t) * h.sign;
+
+					xs = std::clamp(h.o.x + t * h.u1.x / h.u1.y, 0, right);
+					xb = std::clamp(h.o.x + t * h.u2.x / h.u2.y, 0, right);
+					z1 = h.z + ft * h.uz1;
+					z2 = h.z + ft * h.uz2;
+					a1 = along(h.pa, h.ua1, ft);
+					a2 = along(h.pa, h.ua2, ft);
+				}
+
+				// rows [row_begin, row_end) of the surface, spans clamped to its columns
+				static void triangle(vertex a, vertex b, vertex c, const raster_target& target)
+				{
+					walk w = setup(a, b, c);
+					const surface* surf = target.surf;
+					int right = surf->dim.x - 1, y = (std::max)(w.y[0], int(surf->row_begin));
+
+					for (unsigned i = 0; i < 2; i++)
+						for (int end = (std::min)(w.y[i + 1], int(surf->row_end)); y < end; y++)
+						{
+							unsigned xs, xb;
+							float z1, z2;
+							attributes a1, a2;
+
+							row(w.halves[i], y, right, xs, xb, z1, z2, a1, a2);
+							span(xs, xb, y, z1, z2, a1, a2, w.dy, target);
+						}
+				}
+			};
+
+			/*
+			4x multisampled triangles (surface::msaa), ztest & bopaque: the vertices are on the sample grid
+			(mapped at twice the surface size), every sample row gets the span the forward raster would give it,
+			z is a plane over the samples & the attributes are shaded once per pixel at its center
+			a tile the triangle covers becomes its plane (clear tiles, planes behind it at the 4 corners) or is skipped
+			(a plane in front), other tiles are expanded & tested sample by sample
+			*/
+			template <uint8_t shade_mode>
+			struct msaa_raster
+			{
+				typedef raster<ztest, shade_mode, bopaque, lrow> pixel;
+				typedef typename pixel::vertex vertex;
+				typedef typename pixel::attributes attributes;
+				typedef typename pixel::sampler sampler;
 
-				int y = max(a.y, 0), t,
-					byl = min(b.y, idim.y),
-					cyl = min(c.y, idim.y);
+				// no sample of a row
+				static constexpr int empty_left = 1 << 30, empty_right = -1;
 
-				ipoint u1, u2;
-				float uz1, uz2, ft;
+				// planes over the samples from vertex a: z & the attributes, change per sample along x & y
+				struct planes
+				{
+					ipoint a;
+					float z, zx, zy;
+					attributes pa, ax, ay;
+					color_t color;
+					const texture* tex;
+					msaa_samples* m;
+				};
+
+				static inline float depth(const planes& s, int x, int y)
+				{
+					return s.z + s.zx * float(x - s.a.x) + s.zy * float(y - s.a.y);
+				}
 
-				if (dac.x * dab.y < dab.x * dac.y)
+				// at the center of pixel (x, y)
+				static inline attributes attributes_at(const planes& s, int x, int y)
 				{
-					u1 = dac, u2 = dab;
-					uz1 = (czIn - azIn) / float(dac.y);
-					uz2 = (bzIn - azIn) / float(dab.y);
+					if constexpr (shade_mode != hflat)
+						return _mm_add_ps(s.pa, _mm_add_ps(
+							_mm_mul_ps(s.ax, _mm_set1_ps(float(x << 1) + 0.5f - float(s.a.x))),
+							_mm_mul_ps(s.ay, _mm_set1_ps(float(y << 1) + 0.5f - float(s.a.y)))));
+					else
+						return {};
 				}
-				else
+
+				// htextured's mip level at pixel (x, y)
+				static inline sampler sampler_at(const planes& s, int x, int y)
 				{
-					u1 = dab, u2 = dac;
-					uz1 = (bzIn - azIn) / float(dab.y);
-					uz2 = (czIn - azIn) / float(dac.y);
+					if constexpr (shade_mode == htextured)
+					{
+						__m128 two = _mm_set1_ps(2.0f);
+						return sampler_of(s.tex, texture_level(s.tex, attributes_at(s, x, y), _mm_mul_ps(s.ax, two), _mm_mul_ps(s.ay, two)));
+					}
+					else
+						return {};
 				}
 
-				while (y < byl)
+				// tile t at (tx, ty) inside the triangle: its plane now or left as it is (true), or to be tested by samples
+				static bool cover_tile(const planes& s, unsigned t, unsigned tx, unsigned ty)
 				{
-					t = y - a.y;
-					ft = float(t);
+					msaa_samples* m = s.m;
+					msaa_plane p = { depth(s, int(tx << 4), int(ty << 4)), s.zx, s.zy };
+
+					if (m->states[t] == mexpanded)
+						return false;
+
+					if (m->states[t] == mplane)
+					{
+						// planes are linear, nearer at the corners is nearer everywhere
+						msaa_plane q = m->planes[t];
+						__m128 cx = _mm_setr_ps(0.0f, 15.0f, 0.0f, 15.0f), cy = _mm_setr_ps(0.0f, 0.0f, 15.0f, 15.0f);
+						__m128 pz = _mm_add_ps(_mm_set1_ps(p.z), _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(p.dx)), _mm_mul_ps(cy, _mm_set1_ps(p.dy)))),
+							qz = _mm_add_ps(_mm_set1_ps(q.z), _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(q.dx)), _mm_mul_ps(cy, _mm_set1_ps(q.dy))));
+
+						int nearer = _mm_movemask_ps(_mm_cmplt_ps(pz, qz));
+						EBG_STATS_ADD(pixels_tested, 64);
+						if (nearer == 0)
+							return true;
+						if (nearer != 0b1111)
+							return false;
+					}
+					else
+						EBG_STATS_ADD(pixels_tested, 64);
+
+					EBG_STATS_ADD(pixels_passed, 64);
+					m->states[t] = mplane;
+					m->planes[t] = p;
+
+					color_t* colors = m->colors + t * msaa_tile_samples;
+					if constexpr (shade_mode == hflat)
+					{
+						__m128i c = _mm_set1_epi32(static_cast<int>(s.color));
+						for (unsigned i = 0; i < 64; i += 4)
+							_mm_storeu_si128(reinterpret_cast<__m128i*>(colors + i), c);
+					}
+					else
+					{
+						int x = int(tx << 3), y = int(ty << 3);
+						sampler smp = sampler_at(s, x + 4, y + 4);
+						attributes dx = _mm_add_ps(s.ax, s.ax);
+
+						for (int py = 0; py < 8; py++)
+						{
+							attributes a = attributes_at(s, x, y + py);
+							for (int px = 0; px < 8; px++, a = _mm_add_ps(a, dx))
+								colors[(py << 3) + px] = pixel::shade(s.color, a, smp);
+						}
+					}
 
-					depth_sure_x_line(
-						std::clamp(a.x + t * u1.x / u1.y, 0, idim.x),
-						std::clamp(a.x + t * u2.x / u2.y, 0, idim.x),
-						y++,
-						azIn + ft * uz1,
-						azIn + ft * uz2,
-						depth_buffer, c1, surf
-					);
+					return true;
 				}
 
-				if (dac.x * dbc.y > dbc.x * dac.y)
+				// pixel rows [y0, y1) of tile t at (tx, ty) sample by sample, l & r: the sample spans of the tile's rows
+				static void cover_samples(const planes& s, unsigned t, unsigned tx, const int* l, const int* r, int y0, int y1)
 				{
-					u1 = dac, u2 = dbc;
-					uz1 = (azIn - czIn) / float(dac.y);
-					uz2 = (bzIn - czIn) / float(dbc.y);
+					msaa_samples* m = s.m;
+					expand_msaa_tile(m, t);
+
+					color_t* colors = m->colors + t * msaa_tile_samples;
+					float* depths = m->depths + t * msaa_tile_samples;
+					// per pixel along x: the sample x & depth of its 4 samples, the attributes
+					__m128i x_step = _mm_set1_epi32(2);
+					__m128 z_step = _mm_set1_ps(s.zx * 2.0f);
+					attributes a_step = {};
+					if constexpr (shade_mode != hflat)
+						a_step = _mm_add_ps(s.ax, s.ax);
+					int left = int(tx << 4), right = left + 15;
+					unsigned tested = 0, passed = 0;
+
+					for (int y = y0; y < y1; y++)
+					{
+						unsigned i = (y & 7) << 1;
+						int xs = (std::max)((std::min)(l[i], l[i + 1]), left) >> 1, xe = (std::min)((std::max)(r[i], r[i + 1]), right) >> 1;
+						if (xs > xe)
+							continue;
+
+						// samples inside the spans: lanes of sample x over (l, r) of their row
+						__m128i ls = _mm_setr_epi32(l[i] - 1, l[i] - 1, l[i + 1] - 1, l[i + 1] - 1),
+							rs = _mm_setr_epi32(r[i] + 1, r[i] + 1, r[i + 1] + 1, r[i + 1] + 1),
+							sx = _mm_add_epi32(_mm_set1_epi32(xs << 1), _mm_setr_epi32(0, 1, 0, 1));
+						__m128 z = _mm_add_ps(_mm_set1_ps(depth(s, xs << 1, y << 1)), _mm_setr_ps(0.0f, s.zx, s.zy, s.zx + s.zy));
+						attributes a = attributes_at(s, xs, y);
+						sampler smp = sampler_at(s, (xs + xe) >> 1, y);
+						float* d = depths + ((((y & 7) << 3) + (xs & 7)) << 2);
+						color_t* px = colors + ((y & 7) << 3) + (xs & 7);
+
+						for (int x = xs; x <= xe; x++, d += 4, px++)
+						{
+							__m128 covered = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(sx, ls), _mm_cmplt_epi32(sx, rs)));
+							__m128 old = _mm_loadu_ps(d), mask = _mm_and_ps(covered, _mm_cmplt_ps(z, old));
+							unsigned pass = unsigned(_mm_movemask_ps(mask));
+
+							tested += _mm_movemask_ps(covered) != 0;
+							if (pass != 0)
+							{
+								passed++;
+								_mm_storeu_ps(d, _mm_or_ps(_mm_and_ps(mask, z), _mm_andnot_ps(mask, old)));
+
+								// shaded once for all its samples
+								color_t c = pixel::shade(s.color, a, smp);
+								if (pass == 0b1111)
+									px[0] = px[64] = px[128] = px[192] = c;
+								else
+									for (unsigned k = 0; k < 4; k++)
+										if (pass >> k & 1)
+											px[k << 6] = c;
+							}
+
+							sx = _mm_add_epi32(sx, x_step);
+							z = _mm_add_ps(z, z_step);
+							if constexpr (shade_mode != hflat)
+								a = _mm_add_ps(a, a_step);
+						}
+					}
+
+					EBG_STATS_ADD(pixels_tested, tested);
+					EBG_STATS_ADD(pixels_passed, passed);
 				}
-				else
+
+				// the forward raster's edge from p along d at sample row y, in 64 bits only for vertices far off the surface
+				static inline int64_t edge_x(ipoint p, ipoint d, int y)
 				{
-					u1 = dbc, u2 = dac;
-					uz1 = (bzIn - czIn) / float(dbc.y);
-					uz2 = (azIn - czIn) / float(dac.y);
+					int t = y - p.y;
+					if (std::abs(t) < 1 << 15 && std::abs(d.x) < 1 << 15)
+						return p.x + t * d.x / d.y;
+					return p.x + int64_t(t) * d.x / d.y;
 				}
 
-				while (y < cyl)
+				// pixel rows [row_begin, row_end) of the surface, the last band to the end of its tiles
+				static void triangle(vertex a, vertex b, vertex c, const raster_target& target)
 				{
-					t = y - c.y;
-					ft = float(t);
+					if (a.p.y > b.p.y)
+						std::swap(a, b);
+					if (b.p.y > c.p.y)
+						std::swap(b, c);
+					if (a.p.y > b.p.y)
+						std::swap(a, b);
+
+					ipoint dab = b.p - a.p,
+						dbc = c.p - b.p,
+						dac = c.p - a.p;
+					float det = float(dab.x) * float(dac.y) - float(dac.x) * float(dab.y);
+					// no area, no samples
+					if (det == 0.0f)
+						return;
 
-					depth_sure_x_line(
-						std::clamp(c.x + t * u1.x / u1.y, 0, idim.x),
-						std::clamp(c.x + t * u2.x / u2.y, 0, idim.x),
-						y++,
-						czIn - ft * uz1,
-						czIn - ft * uz2,
-						depth_buffer, c2, surf
-					);
+					const surface* surf = target.surf;
+					planes s;
+					s.a = a.p;
+					s.z = a.z;
+					s.zx = ((b.z - a.z) * float(dac.y) - (c.z - a.z) * float(dab.y)) / det;
+					s.zy = ((c.z - a.z) * float(dab.x) - (b.z - a.z) * float(dac.x)) / det;
+					if constexpr (shade_mode != hflat)
+					{
+						attributes pa = pixel::pack(a), pb = pixel::pack(b), pc = pixel::pack(c), inv = _mm_set1_ps(1.0f / det);
+						s.pa = pa;
+						s.ax = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_sub_ps(pb, pa), _mm_set1_ps(float(dac.y))), _mm_mul_ps(_mm_sub_ps(pc, pa), _mm_set1_ps(float(dab.y)))), inv);
+						s.ay = _mm_mul_ps(_mm_sub_ps(_mm_mul_ps(_mm_sub_ps(pc, pa), _mm_set1_ps(float(dab.x))), _mm_mul_ps(_mm_sub_ps(pb, pa), _mm_set1_ps(float(dac.x)))), inv);
+					}
+					s.color = target.color;
+					s.tex = target.tex;
+					s.m = surf->msaa;
+
+					msaa_samples* m = s.m;
+					int right = int(m->tiles.x << 4) - 1,
+						row_end = surf->row_end == surf->dim.y ? int(m->tiles.y << 3) : int(surf->row_end);
+					// pixel rows with sample rows in [a.y, c.y)
+					int y_begin = (std::max)(a.p.y >> 1, int(surf->row_begin)),
+						y_end = (std::min)(((c.p.y - 1) >> 1) + 1, row_end);
+
+					for (int ty = y_begin >> 3; (ty << 3) < y_end; ty++)
+					{
+						int y0 = (std::max)(ty << 3, y_begin), y1 = (std::min)((ty << 3) + 8, y_end);
+						int l[16], r[16];
+						// over the rows: smallest & largest left & right end
+						int min_left = empty_left, max_left = 0, min_right = right, max_right = empty_right;
+
+						for (int i = 0; i < 16; i++)
+						{
+							int sy = (ty << 4) + i;
+							l[i] = empty_left;
+							r[i] = empty_right;
+
+							if (sy >> 1 >= y0 && sy >> 1 < y1 && sy >= a.p.y && sy < c.p.y)
+							{
+								int64_t x1, x2;
+								if (sy < b.p.y)
+								{
+									x1 = edge_x(a.p, dac, sy);
+									x2 = edge_x(a.p, dab, sy);
+								}
+								else
+								{
+									x1 = edge_x(c.p, dac, sy);
+									x2 = edge_x(c.p, dbc, sy);
+								}
+
+								int64_t lo = (std::max)((std::min)(x1, x2), int64_t(0)), hi = (std::min)((std::max)(x1, x2), int64_t(right));
+								if (lo <= hi)
+									l[i] = int(lo), r[i] = int(hi);
+							}
+
+							min_left = (std::min)(min_left, l[i]);
+							max_left = (std::max)(max_left, l[i]);
+							min_right = (std::min)(min_right, r[i]);
+							max_right = (std::max)(max_right, r[i]);
+						}
+
+						if (max_right == empty_right)
+							continue;
+
+						// tiles every sample row covers, none if a row is empty
+						int full_begin = (max_left + 15) >> 4, full_end = min_right >= 0 ? (min_right + 1) >> 4 : 0;
+						unsigned tile_row = unsigned(ty) * m->tiles.x;
+
+						for (int tx = min_left >> 4; tx <= max_right >> 4; tx++)
+						{
+							unsigned t = tile_row + unsigned(tx);
+							if (tx >= full_begin && tx < full_end && cover_tile(s, t, unsigned(tx), unsigned(ty)))
+								continue;
+							cover_samples(s, t, unsigned(tx), l, r, y0, y1);
+						}
+					}
 				}
+			};
+
+			// the layout of the surface, once per triangle
+			template <uint8_t depth_mode, uint8_t shade_mode, uint8_t blend_mode>
+			inline void rasterise(const raster_vertex<shade_mode>& a, const raster_vertex<shade_mode>& b, const raster_vertex<shade_mode>& c, const raster_target& target)
+			{
+				if constexpr (depth_mode == ztest && blend_mode == bopaque)
+					if (target.surf->msaa != nullptr)
+					{
+						msaa_raster<shade_mode>::triangle(a, b, c, target);
+						return;
+					}
+				assert(target.surf->msaa == nullptr);
+
+				if (target.surf->repaint != nullptr)
+					raster<depth_mode, shade_mode, blend_mode, lmasked>::triangle(a, b, c, target);
+				else if (target.surf->x_offsets != nullptr)
+					raster<depth_mode, shade_mode, blend_mode, ltiled>::triangle(a, b, c, target);
+				else
+					raster<depth_mode, shade_mode, blend_mode, lrow>::triangle(a, b, c, target);
+			}
+
+			inline void rasterisation(ipoint a, ipoint b, ipoint c, color_t color, surface* surf)
+			{
+				rasterise<znone, hflat, bopaque>({ a, 0.0f, {} }, { b, 0.0f, {} }, { c, 0.0f, {} }, { surf, nullptr, color, nullptr });
+			}
+
+			inline void depth_rasterisation(ipoint a, ipoint b, ipoint c, float az, float bz, float cz, float* depth_buffer, color_t color, surface* surf)
+			{
+				rasterise<ztest, hflat, bopaque>({ a, az, {} }, { b, bz, {} }, { c, cz, {} }, { surf, depth_buffer, color, nullptr });
+			}
+
+			// one flat depth tested span
+			inline void depth_sure_x_line(unsigned xs, unsigned xb, unsigned y, float z1, float z2, float* depth_buffer, color_t color, surface* surf)
+			{
+				raster_target target = { surf, depth_buffer, color, nullptr };
+				if (surf->repaint != nullptr)
+					raster<ztest, hflat, bopaque, lmasked>::span(xs, xb, y, z1, z2, {}, {}, {}, target);
+				else if (surf->x_offsets != nullptr)
+					raster<ztest, hflat, bopaque, ltiled>::span(xs, xb, y, z1, z2, {}, {}, {}, target);
+				else
+					raster<ztest, hflat, bopaque, lrow>::span(xs, xb, y, z1, z2, {}, {}, {}, target);
 			}
 
 			void depth_line(ipoint start, ipoint end, float* depth_buffer, color_t color, surface* surf)
@@ -589,6 +1668,33 @@ namespace ebg
 				else
 					step = ipoint(1, idim.x);
 
+				if (surf->x_offsets != nullptr)
+				{
+					unsigned* major = slope ? surf->y_offsets : surf->x_offsets,
+						* minor = slope ? surf->x_offsets : surf->y_offsets;
+					int m = start.y, m_step = get_sign(d.y);
+
+					d.y = abs(d.y);
+
+					int err = d.x;
+					d <<= 1;
+
+					for (int x = start.x; x < end.x; x++)
+					{
+						unsigned offset = major[x] + minor[m];
+						surf->buffer[offset] = color;
+						depth_buffer[offset] = 0.0f;
+
+						err -= d.y;
+						if (err <= 0)
+						{
+							m += m_step;
+							err += d.x;
+						}
+					}
+					return;
+				}
+
 				int offset = dot(start, step);
 				color_t* px = surf->buffer + offset;
 				float* z = depth_buffer + offset;
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "EBG_3d.h"
+
+/*
+4x multisample anti-aliasing of a frame (graphics::msaa_samples)
+
+the meshes are drawn into the samples in bands like draw_parallel, mapped at twice the surface size,
+then every band resolves its rows into the surface & the depth buffer (the nearest sample of each pixel)
+edges get 4 coverage samples, a pixel is still shaded once per triangle,
+a clear only resets the tile states & tiles one triangle covers keep a plane instead of their samples
+*/
+
+namespace eb3d
+{
+	class msaa_buffer
+	{
+	private:
+		graphics::msaa_samples samples;
+
+	public:
+		msaa_buffer() : samples() {}
+
+		msaa_buffer(const msaa_buffer&) = delete;
+
+		~msaa_buffer()
+		{
+			graphics::delete_msaa_samples(&samples);
+		}
+
+		// replaces the clear & draw_parallel of a frame, the surface & depth buffer need no clear (the resolve writes every pixel,
+		// clear_color where nothing was drawn)
+		void draw(compound_mesh** meshes, const uint8_t* update_types, unsigned mesh_amount, camera* cam, basic_engine* engine, thread_pool* pool,
+			color_t clear_color = 0)
+		{
+			graphics::surface& surf = engine->surface;
+			assert(engine->depth_buffer != nullptr && surf.repaint == nullptr);
+
+			graphics::resize_msaa_samples(&samples, surf.dim);
+
+			{
+				EBG_PROFILE_SCOPE(sclear);
+
+				graphics::clear_msaa_samples(&samples);
+			}
+
+			update_parallel(meshes, update_types, mesh_amount, cam, pool);
+
+			unsigned threads = pool->amount;
+			// bands are whole 8 row blocks as in draw_bands, a band's tiles are its own
+			unsigned blocks = (surf.dim.y + 7) >> 3;
+
+			pool->run([&](unsigned index)
+			{
+				unsigned row_begin = min((blocks * index / threads) << 3, surf.dim.y), row_end = min((blocks * (index + 1) / threads) << 3, surf.dim.y);
+
+				// vertices mapped onto the sample grid
+				basic_engine band = *engine;
+				band.hdim = engine->hdim << 1U;
+				band.fhdim = engine->fhdim * 2.0f;
+				band.surface.msaa = &samples;
+				band.surface.row_begin = row_begin;
+				band.surface.row_end = row_end;
+
+				for (unsigned m = 0; m < mesh_amount; m++)
+					meshes[m]->draw(cam, &band);
+
+				{
+					EBG_PROFILE_SCOPE(sresolve);
+
+					graphics::resolve_msaa(&samples, &surf, engine->depth_buffer, clear_color, row_begin, row_end);
+				}
+			});
+		}
+	};
+}
@@ -2,6 +2,8 @@
 
 #include <ostream>
 #include <algorithm>
+#include <cmath>
+#include <emmintrin.h>
 
 #include "EBG_point_op_macros.h"
 
@@ -47,6 +49,49 @@ namespace ebg
 	typedef vec3<unsigned> uvec3;
 	typedef vec3<float> fvec3;
 
+	/*
+	fvec3 in an SSE register (16 bytes, 16 aligned), w is padding: 0 from the fvec3 conversions,
+	ignored by dot, cross, magnitude & ==
+	same operators & functions as fvec3, converts both ways, so math written for fvec3 can switch to it,
+	min & max are declared as (min) & (max) (Windows macros), call them as (min)(a, b),
+	the lanes are read by x(), y(), z() & w()
+	*/
+	struct alignas(16) fvec4
+	{
+		__m128 v;
+
+		fvec4() : v(_mm_setzero_ps()) {}
+		fvec4(__m128 vIn) : v(vIn) {}
+		fvec4(float xIn, float yIn, float zIn, float wIn = 0.0f) : v(_mm_setr_ps(xIn, yIn, zIn, wIn)) {}
+		fvec4(fvec3 v3) : v(_mm_setr_ps(v3.x, v3.y, v3.z, 0.0f)) {}
+
+		float x() const
+		{
+			return _mm_cvtss_f32(v);
+		}
+		float y() const
+		{
+			return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+		}
+		float z() const
+		{
+			return _mm_cvtss_f32(_mm_movehl_ps(v, v));
+		}
+		float w() const
+		{
+			return _mm_cvtss_f32(_mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+		}
+
+		operator fvec3() const
+		{
+			alignas(16) float f[4];
+			_mm_store_ps(f, v);
+			return fvec3(f[0], f[1], f[2]);
+		}
+	};
+
+	typedef fvec4 simd_vec3;
+
 	inline constexpr float magnitude_square(fvec2 v)
 	{
 		return v.x * v.x + v.y * v.y;
@@ -150,6 +195,7 @@ namespace ebg
 
 	ALL_OPS2
 	ALL_OPS3
+	ALL_OPS4
 
 	inline constexpr bool is_inside(ipoint p, upoint hi)
 	{
@@ -160,6 +206,83 @@ namespace ebg
 	{
 		return v / magnitude(v);
 	}
+
+	// x + y + z in every lane
+	inline __m128 dot_splat(fvec4 a, fvec4 b)
+	{
+		__m128 m = _mm_mul_ps(a.v, b.v);
+		__m128 s = _mm_add_ss(_mm_add_ss(m, _mm_shuffle_ps(m, m, _MM_SHUFFLE(1, 1, 1, 1))), _mm_movehl_ps(m, m));
+		return _mm_shuffle_ps(s, s, _MM_SHUFFLE(0, 0, 0, 0));
+	}
+
+	inline float dot(fvec4 a, fvec4 b)
+	{
+		return _mm_cvtss_f32(dot_splat(a, b));
+	}
+
+	inline fvec4 cross(fvec4 a, fvec4 b)
+	{
+		// a.yzx * b.zxy - a.zxy * b.yzx
+		__m128 a_yzx = _mm_shuffle_ps(a.v, a.v, _MM_SHUFFLE(3, 0, 2, 1)), b_yzx = _mm_shuffle_ps(b.v, b.v, _MM_SHUFFLE(3, 0, 2, 1));
+		__m128 c = _mm_sub_ps(_mm_mul_ps(a.v, b_yzx), _mm_mul_ps(a_yzx, b.v));
+		return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+	}
+
+	inline float magnitude_square(fvec4 v)
+	{
+		return dot(v, v);
+	}
+	inline float magnitude(fvec4 v)
+	{
+		return _mm_cvtss_f32(_mm_sqrt_ss(dot_splat(v, v)));
+	}
+
+	inline fvec4 normalize(fvec4 v)
+	{
+		return _mm_div_ps(v.v, _mm_sqrt_ps(dot_splat(v, v)));
+	}
+
+	// rsqrt & a Newton step: relative error ~1e-6 instead of exact, no divide
+	inline fvec4 normalize_fast(fvec4 v)
+	{
+		__m128 d = dot_splat(v, v), r = _mm_rsqrt_ps(d);
+		r = _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(0.5f), r), _mm_sub_ps(_mm_set1_ps(3.0f), _mm_mul_ps(_mm_mul_ps(d, r), r)));
+		return _mm_mul_ps(v.v, r);
+	}
+
+	inline fvec4 (min)(fvec4 a, fvec4 b)
+	{
+		return _mm_min_ps(a.v, b.v);
+	}
+	inline fvec4 (max)(fvec4 a, fvec4 b)
+	{
+		return _mm_max_ps(a.v, b.v);
+	}
+
+	inline fvec4 round(fvec4 v)
+	{
+		return fvec4(roundf(v.x()), roundf(v.y()), roundf(v.z()), roundf(v.w()));
+	}
+
+	inline fvec4 operator -(fvec4 v)
+	{
+		return _mm_xor_ps(v.v, _mm_set1_ps(-0.0f));
+	}
+
+	inline bool operator ==(fvec4 a, fvec4 b)
+	{
+		return (_mm_movemask_ps(_mm_cmpeq_ps(a.v, b.v)) & 7) == 7;
+	}
+	inline bool operator !=(fvec4 a, fvec4 b)
+	{
+		return (a == b) == false;
+	}
+
+	inline std::ostream& operator <<(std::ostream& os, fvec4 v)
+	{
+		os << '(' << v.x() << ", " << v.y() << ", " << v.z() << ')';
+		return os;
+	}
 }
 
 #include "EBG_point_op_undef.h"
@@ -51,13 +51,13 @@ constexpr bool operator S(point<T> a, point<T> b) {			\
 
 #define tPPEAOP2(S)											\
 template <typename T>										\
-void operator S=(point<T>& a, point<T> b) {					\
-	a.x S= b.x; a.y S= b.y;									\
+void operator S##=(point<T>& a, point<T> b) {					\
+	a.x S##= b.x; a.y S##= b.y;									\
 }
 
 #define TPIEAOP2(S, T)										\
-void operator S=(point<T>& a, T b) {						\
-	a.x S= b; a.y S= b;										\
+void operator S##=(point<T>& a, T b) {						\
+	a.x S##= b; a.y S##= b;										\
 }
 
 #define tPIEAOP2(S) template <typename T> TPIEAOP2(S, T)
@@ -100,13 +100,13 @@ constexpr bool operator S(vec3<T> a, vec3<T> b) {			\
 
 #define tPPEAOP3(S)											\
 template <typename T>										\
-void operator S=(vec3<T>& a, vec3<T> b) {					\
-	a.x S= b.x; a.y S= b.y; a.z S= b.z;						\
+void operator S##=(vec3<T>& a, vec3<T> b) {					\
+	a.x S##= b.x; a.y S##= b.y; a.z S##= b.z;						\
 }
 
 #define TPIEAOP3(S, T)										\
-void operator S=(vec3<T>& a, T b) {							\
-	a.x S= b; a.y S= b; a.z S= b;							\
+void operator S##=(vec3<T>& a, T b) {							\
+	a.x S##= b; a.y S##= b; a.z S##= b;							\
 }
 
 #define tPIEAOP3(S) template <typename T> TPIEAOP3(S, T)
@@ -120,4 +120,28 @@ tPPLOP3(==, &&) tPPLOP3(!=, ||) tPPLOP3(<, &&)				\
 tPPLOP3(>, &&) tPPLOP3(<=, &&) tPPLOP3(>=, &&)				\
 tPPEAOP3(+) tPPEAOP3(-)										\
 tPIEAOP3(+) tPIEAOP3(-) tPIEAOP3(*) tPIEAOP3(/)				\
-iPIEAOP3(%) iPIEAOP3(&) iPIEAOP3(<<) iPIEAOP3(>>)
\ No newline at end of file
+iPIEAOP3(%) iPIEAOP3(&) iPIEAOP3(<<) iPIEAOP3(>>)
+
+// fvec4 (SSE), F: the _mm_*_ps of S
+
+#define F4AOP(S, F)											\
+inline fvec4 operator S(fvec4 a, fvec4 b) {					\
+	return F(a.v, b.v);										\
+}															\
+inline fvec4 operator S(fvec4 a, float b) {					\
+	return F(a.v, _mm_set1_ps(b));							\
+}
+
+#define F4EAOP(S, F)										\
+inline void operator S##=(fvec4& a, fvec4 b) {				\
+	a.v = F(a.v, b.v);										\
+}															\
+inline void operator S##=(fvec4& a, float b) {				\
+	a.v = F(a.v, _mm_set1_ps(b));							\
+}
+
+#define ALL_OPS4											\
+F4AOP(+, _mm_add_ps) F4AOP(-, _mm_sub_ps)					\
+F4AOP(*, _mm_mul_ps) F4AOP(/, _mm_div_ps)					\
+F4EAOP(+, _mm_add_ps) F4EAOP(-, _mm_sub_ps)					\
+F4EAOP(*, _mm_mul_ps) F4EAOP(/, _mm_div_ps)
@@ -43,3 +43,9 @@
 
 #undef TPIdAOP2
 #undef iPIdAOP2
+
+
+#undef ALL_OPS4
+
+#undef F4EAOP
+#undef F4AOP
@@ -0,0 +1,305 @@
+#pragma once
+
+/*
+Hot-path profiler
+
+compiled out completely unless EBG_PROFILE is defined
+
+EBG_PROFILE_SCOPE(stage): times the enclosing block as one timeline event
+EBG_PROFILE_LAP_START(), EBG_PROFILE_LAP(stage):
+	for per-triangle code, adds time since the previous lap to the stage total of this thread,
+	totals become events on EBG_PROFILE_FLUSH() (laid back to back from the first lap)
+EBG_PROFILE_FRAME_BEGIN(), EBG_PROFILE_FRAME_END(): frame event & frame counter
+EBG_PROFILE_DUMP(trace, summary): Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev)
+	and CSV summary (per stage & thread: min/avg/p95/p99 of frame totals)
+
+every thread writes only its own ring buffer (registered lock-free on first use),
+dump when render threads are idle or oldest events may be torn
+*/
+
+#ifdef EBG_PROFILE
+
+#include <Windows.h>
+#include <atomic>
+#include <vector>
+#include <fstream>
+#include <iomanip>
+#include <algorithm>
+
+namespace ebg
+{
+	namespace profiler
+	{
+		enum stages : uint8_t
+		{
+			sframe = 0,
+			sclear,
+			smesh_update,
+			sclipping,
+			slighting,
+			sprojection,
+			sraster,
+			// deferred shading of EBG_visibility.h
+			sshade,
+			// multisample resolve of EBG_msaa.h
+			sresolve,
+			spresent,
+			ssleep,
+			stage_amount
+		};
+
+		const char* stage_names[stage_amount] = {
+			"frame", "clear", "mesh_update", "clipping", "lighting", "projection", "raster", "shade", "resolve", "present", "sleep"
+		};
+
+		struct event
+		{
+			long long start, duration;
+			unsigned frame;
+			uint8_t stage;
+		};
+
+		constexpr unsigned ring_size = 1U << 16, ring_mask = ring_size - 1U;
+
+		struct thread_ring
+		{
+			event events[ring_size];
+			// only the owner thread writes, readers acquire
+			std::atomic<unsigned> head;
+			unsigned thread_id;
+			thread_ring* next;
+
+			long long accumulated[stage_amount];
+			long long batch_start, frame_start;
+		};
+
+		std::atomic<thread_ring*> rings = nullptr;
+		std::atomic<unsigned> thread_amount = 0, frame = 0;
+
+		inline long long now()
+		{
+			LARGE_INTEGER t;
+			QueryPerformanceCounter(&t);
+			return t.QuadPart;
+		}
+
+		inline double to_us(long long ticks)
+		{
+			static const double us_per_tick = [] {
+				LARGE_INTEGER f;
+				QueryPerformanceFrequency(&f);
+				return 1000000.0 / static_cast<double>(f.QuadPart);
+			}();
+			return static_cast<double>(ticks) * us_per_tick;
+		}
+
+		thread_ring* register_ring()
+		{
+			thread_ring* ring = new thread_ring;
+			ring->head.store(0, std::memory_order_relaxed);
+			ring->thread_id = thread_amount.fetch_add(1, std::memory_order_relaxed);
+			memset(ring->accumulated, 0, sizeof(ring->accumulated));
+			ring->batch_start = ring->frame_start = 0;
+
+			ring->next = rings.load(std::memory_order_relaxed);
+			while (rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed) == false);
+
+			return ring;
+		}
+
+		inline thread_ring* local_ring()
+		{
+			thread_local thread_ring* ring = register_ring();
+			return ring;
+		}
+
+		inline void record(uint8_t stage, long long start, long long end)
+		{
+			thread_ring* ring = local_ring();
+			unsigned head = ring->head.load(std::memory_order_relaxed);
+
+			ring->events[head & ring_mask] = { start, end - start, frame.load(std::memory_order_relaxed), stage };
+			ring->head.store(head + 1, std::memory_order_release);
+		}
+
+		struct scope
+		{
+			long long start;
+			uint8_t stage;
+
+			scope(uint8_t stage) : start(now()), stage(stage) {}
+			~scope() { record(stage, start, now()); }
+		};
+
+		inline long long lap_start()
+		{
+			long long t = now();
+			thread_ring* ring = local_ring();
+			if (ring->batch_start == 0)
+				ring->batch_start = t;
+			return t;
+		}
+
+		inline void lap(uint8_t stage, long long& last)
+		{
+			long long t = now();
+			local_ring()->accumulated[stage] += t - last;
+			last = t;
+		}
+
+		void flush()
+		{
+			thread_ring* ring = local_ring();
+			if (ring->batch_start == 0)
+				return;
+
+			long long t = ring->batch_start;
+			for (uint8_t i = 0; i < stage_amount; i++)
+			{
+				if (ring->accumulated[i] == 0)
+					continue;
+
+				record(i, t, t + ring->accumulated[i]);
+				t += ring->accumulated[i];
+				ring->accumulated[i] = 0;
+			}
+
+			ring->batch_start = 0;
+		}
+
+		inline void frame_begin()
+		{
+			local_ring()->frame_start = now();
+		}
+
+		inline void frame_end()
+		{
+			flush();
+			record(sframe, local_ring()->frame_start, now());
+			frame.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		// oldest to newest events still in the ring
+		void collect(thread_ring* ring, std::vector<event>& out)
+		{
+			unsigned head = ring->head.load(std::memory_order_acquire),
+				first = head > ring_size ? head - ring_size : 0;
+
+			out.clear();
+			for (unsigned i = first; i < head; i++)
+				out.push_back(ring->events[i & ring_mask]);
+		}
+
+		bool write_trace(const char* file_name)
+		{
+			std::ofstream file(file_name);
+			if (file.is_open() == false)
+				return false;
+
+			std::vector<event> events;
+			bool first = true;
+
+			file << std::fixed << std::setprecision(3);
+
+			file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+			for (thread_ring* ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+			{
+				collect(ring, events);
+				for (const event& e : events)
+				{
+					if (first == false)
+						file << ",\n";
+					first = false;
+
+					file << "{\"name\":\"" << stage_names[e.stage]
+						<< "\",\"cat\":\"ebg\",\"ph\":\"X\",\"pid\":1,\"tid\":" << ring->thread_id
+						<< ",\"ts\":" << to_us(e.start) << ",\"dur\":" << to_us(e.duration)
+						<< ",\"args\":{\"frame\":" << e.frame << "}}";
+				}
+			}
+			file << "\n]}\n";
+
+			return true;
+		}
+
+		// nearest-rank percentile of a sorted list
+		inline double percentile(const std::vector<double>& sorted, unsigned p)
+		{
+			size_t rank = (sorted.size() * p + 99) / 100;
+			return sorted[rank == 0 ? 0 : rank - 1];
+		}
+
+		bool write_summary(const char* file_name)
+		{
+			std::ofstream file(file_name);
+			if (file.is_open() == false)
+				return false;
+
+			std::vector<event> events;
+			std::vector<double> totals;
+
+			file << std::fixed << std::setprecision(4);
+
+			file << "stage,thread,frames,min_ms,avg_ms,p95_ms,p99_ms\n";
+			for (thread_ring* ring = rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next)
+			{
+				collect(ring, events);
+				std::sort(events.begin(), events.end(), [](const event& a, const event& b) { return a.frame < b.frame; });
+
+				for (uint8_t stage = 0; stage < stage_amount; stage++)
+				{
+					// one total per frame the stage appeared in
+					totals.clear();
+					unsigned last_frame = 0;
+					for (const event& e : events)
+					{
+						if (e.stage != stage)
+							continue;
+
+						if (totals.empty() || e.frame != last_frame)
+							totals.push_back(0.0);
+						totals.back() += to_us(e.duration) * 0.001;
+						last_frame = e.frame;
+					}
+
+					if (totals.empty())
+						continue;
+
+					double sum = 0.0;
+					for (double t : totals)
+						sum += t;
+					std::sort(totals.begin(), totals.end());
+
+					file << stage_names[stage] << ',' << ring->thread_id << ',' << totals.size() << ','
+						<< totals.front() << ',' << sum / static_cast<double>(totals.size()) << ','
+						<< percentile(totals, 95) << ',' << percentile(totals, 99) << '\n';
+				}
+			}
+
+			return true;
+		}
+	}
+}
+
+#define EBG_PROFILE_CONCAT_(a, b) a##b
+#define EBG_PROFILE_CONCAT(a, b) EBG_PROFILE_CONCAT_(a, b)
+
+#define EBG_PROFILE_SCOPE(stage) ebg::profiler::scope EBG_PROFILE_CONCAT(profile_scope_, __LINE__)(ebg::profiler::stage)
+#define EBG_PROFILE_LAP_START() long long profile_lap = ebg::profiler::lap_start()
+#define EBG_PROFILE_LAP(stage) ebg::profiler::lap(ebg::profiler::stage, profile_lap)
+#define EBG_PROFILE_FLUSH() ebg::profiler::flush()
+#define EBG_PROFILE_FRAME_BEGIN() ebg::profiler::frame_begin()
+#define EBG_PROFILE_FRAME_END() ebg::profiler::frame_end()
+#define EBG_PROFILE_DUMP(trace, summary) (ebg::profiler::write_trace(trace), ebg::profiler::write_summary(summary))
+
+#else
+
+#define EBG_PROFILE_SCOPE(stage)
+#define EBG_PROFILE_LAP_START()
+#define EBG_PROFILE_LAP(stage)
+#define EBG_PROFILE_FLUSH()
+#define EBG_PROFILE_FRAME_BEGIN()
+#define EBG_PROFILE_FRAME_END()
+#define EBG_PROFILE_DUMP(trace, summary)
+
+#endif
@@ -0,0 +1,539 @@
+#pragma once
+
+#include "EBG_3d.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <climits>
+
+/*
+Temporal reprojection: reuses the previous frame under small camera motion
+
+the previous colors & depths are warped into the new camera (forward splat, the nearest depth wins),
+then only the 8x8 blocks the warp couldn't fill are cleared & drawn again (surface.repaint):
+	holes: disocclusions, the edges the camera turned towards, background, cracks wider than a pixel
+	pixels failing the confidence test: depth edges of the previous frame, behind the near plane
+	old & new screen rects of the dynamic meshes (tdynamic, tonly_pos) that moved or changed color
+a redrawn block is the same as in a full frame, the other blocks are off by the accumulated rounding,
+so every full_interval frames (and after big turns or a resize) the frame is drawn from scratch
+
+the previous frame is the engine's own: its color & depth buffers are swapped with spare ones
+every frame, so every frame must go through reprojector::draw and nothing else may draw onto
+the surface (it would be reprojected)
+*/
+
+namespace eb3d
+{
+	class reprojector
+	{
+	public:
+		// frames between full frames, camera turn (radians) that forces a full frame,
+		// relative depth step between neighbours that counts as an edge
+		unsigned full_interval;
+		float max_turn, edge_tolerance;
+
+		// last frame: drawn from scratch, 8x8 blocks drawn & all blocks
+		bool last_full;
+		unsigned redrawn_blocks, total_blocks;
+
+	private:
+		struct mesh_state
+		{
+			fvec3 position, rotation;
+			// rotation_data::version (quaternion rotations leave the euler angles)
+			unsigned rotation_version;
+			basic_color_conversation_data bccd;
+			// inclusive screen rect in the previous frame, empty when lo.x > hi.x
+			ipoint lo, hi;
+		};
+
+		static constexpr uint64_t empty = ~0ULL;
+		// memset(0b01111111) depth of the clears, anything above is background
+		static constexpr float background = 1e30f;
+
+		// previous frame once swapped in
+		color_t* colors;
+		float* depths;
+		// nearest splat of every pixel: depth bits << 32 | source offset
+		uint64_t* splats;
+		unsigned capacity;
+
+		std::vector<uint8_t> repaint, skip;
+		// offset tables of row-major surfaces, the surface's own on tiled ones
+		std::vector<unsigned> row_x, row_y;
+		const unsigned* x_table, * y_table;
+		std::vector<mesh_state> states;
+
+		fvec3 last_position;
+		reverse_inverse_rotation_data last_rotation;
+		upoint last_dim;
+		unsigned since_full;
+		bool has_history;
+
+		// inclusive pixel rect of what camera::draw_triangle can draw of the mesh: union of the
+		// front facing triangles (visible), each clipped at its near plane & to the surface
+		static void screen_rect(const compound_mesh* mesh, const camera* cam, const basic_engine* engine, ipoint& lo, ipoint& hi)
+		{
+			float s = cam->h * engine->fhdim.x, hx = static_cast<float>(engine->hdim.x), hy = static_cast<float>(engine->hdim.y),
+				w = static_cast<float>(engine->surface.dim.x), h = static_cast<float>(engine->surface.dim.y);
+			// a pixel of margin for the truncation of mapto_engine
+			float x_lo = w, x_hi = -1.0f, y_lo = h, y_hi = -1.0f;
+
+			for (unsigned i = 0; i < mesh->visible_amount; i++)
+			{
+				const triangle& tri = mesh->triangles[mesh->visible[i]];
+				vertex_t v[3] = { mesh->world_vertices[tri.a], mesh->world_vertices[tri.b], mesh->world_vertices[tri.c] };
+
+				float clip = cam->near + magnitude(v[0]) * EPSILON, t_lo = FLT_MAX, t_hi = -FLT_MAX, u_lo = FLT_MAX, u_hi = -FLT_MAX;
+				auto add = [&](vertex_t p)
+				{
+					float t = s / p.z, x = p.x * t, y = p.y * t;
+					t_lo = (std::min)(t_lo, x);
+					t_hi = (std::max)(t_hi, x);
+					u_lo = (std::min)(u_lo, y);
+					u_hi = (std::max)(u_hi, y);
+				};
+
+				// the projection of a segment is monotonic, so the clipped triangle stays inside the
+				// rect of its vertices in front & the points where its edges cross the clip plane
+				for (unsigned e = 0; e < 3; e++)
+				{
+					vertex_t p = v[e], q = v[e == 2 ? 0 : e + 1];
+
+					if (p.z >= clip)
+						add(p);
+					if ((p.z < clip) != (q.z < clip))
+					{
+						vertex_t c = p + (q - p) * ((clip - p.z) / (q.z - p.z));
+						c.z = clip;
+						add(c);
+					}
+				}
+
+				t_lo += hx - 1.0f;
+				t_hi += hx + 1.0f;
+				u_lo += hy - 1.0f;
+				u_hi += hy + 1.0f;
+
+				if (t_lo > t_hi || t_hi < 0.0f || u_hi < 0.0f || t_lo >= w || u_lo >= h)
+					continue;
+
+				x_lo = (std::min)(x_lo, t_lo);
+				x_hi = (std::max)(x_hi, t_hi);
+				y_lo = (std::min)(y_lo, u_lo);
+				y_hi = (std::max)(y_hi, u_hi);
+			}
+
+			if (x_lo > x_hi)
+			{
+				lo = ipoint(1, 1);
+				hi = ipoint(0, 0);
+				return;
+			}
+
+			lo = ipoint(int((std::max)(x_lo, 0.0f)), int((std::max)(y_lo, 0.0f)));
+			hi = ipoint(int((std::min)(x_hi, w - 1.0f)), int((std::min)(y_hi, h - 1.0f)));
+		}
+
+		static void mark(std::vector<uint8_t>& blocks, unsigned blocks_x, ipoint lo, ipoint hi)
+		{
+			for (int by = lo.y >> 3; by <= hi.y >> 3 && lo.x <= hi.x; by++)
+				memset(&blocks[by * blocks_x + (lo.x >> 3)], 1, (hi.x >> 3) - (lo.x >> 3) + 1);
+		}
+
+		inline bool similar(float a, float b) const
+		{
+			return fabsf(a - b) <= edge_tolerance * (std::min)(a, b);
+		}
+
+		static inline float splat_depth(uint64_t s)
+		{
+			return std::bit_cast<float>(static_cast<uint32_t>(s >> 32));
+		}
+
+		// the engine draws into the spare buffers, the previous frame becomes colors & depths
+		void swap_buffers(basic_engine* engine)
+		{
+			graphics::surface& surf = engine->surface;
+			bool aliased = engine->present_buffer == surf.buffer;
+
+			std::swap(surf.buffer, colors);
+			std::swap(engine->depth_buffer, depths);
+			surf.end = surf.buffer + surf.buffer_size;
+
+			if (aliased)
+				engine->present_buffer = surf.buffer;
+		}
+
+		// moving & recolored meshes: their previous pixels aren't reprojected, their new rect is redrawn
+		void track_meshes(compound_mesh** meshes, const uint8_t* update_types, unsigned mesh_amount, camera* cam, basic_engine* engine, unsigned blocks_x)
+		{
+			if (states.size() != mesh_amount)
+			{
+				states.resize(mesh_amount);
+				has_history = false;
+			}
+
+			for (unsigned m = 0; m < mesh_amount; m++)
+			{
+				const compound_mesh* mesh = meshes[m];
+				uint8_t type = mesh->resolve_update_type(update_types[m]);
+				if (type == tstatic)
+					continue;
+
+				mesh_state& s = states[m];
+				fvec3 rotation = type == tdynamic ? mesh->rotation->rotation : fvec3(0.0f, 0.0f, 0.0f);
+				unsigned rotation_version = type == tdynamic ? mesh->rotation->version : 0;
+				ipoint lo, hi;
+				screen_rect(mesh, cam, engine, lo, hi);
+
+				if (has_history && (s.position != mesh->position || s.rotation != rotation || s.rotation_version != rotation_version || memcmp(&s.bccd, &mesh->bccd, sizeof(s.bccd)) != 0))
+				{
+					mark(skip, blocks_x, s.lo, s.hi);
+					mark(repaint, blocks_x, lo, hi);
+				}
+
+				s.position = mesh->position;
+				s.rotation = rotation;
+				s.rotation_version = rotation_version;
+				s.bccd = mesh->bccd;
+				s.lo = lo;
+				s.hi = hi;
+			}
+		}
+
+		// pixel (x, y) at x_table[x] + y_table[y] on both layouts
+		void update_tables(const graphics::surface& surf)
+		{
+			if (surf.x_offsets != nullptr)
+			{
+				x_table = surf.x_offsets;
+				y_table = surf.y_offsets;
+				return;
+			}
+
+			for (unsigned i = 0; i < surf.dim.y; i++)
+				row_y[i] = i * surf.dim.x;
+
+			x_table = row_x.data();
+			y_table = row_y.data();
+		}
+
+		// previous frame -> splats (nearest depth wins), source row bands in two rounds (even, odd bands)
+		// so no two threads write the same splat: a splat may move at most half a band vertically
+		void scatter(const fvec3* m, fvec3 translation, const camera* cam, const basic_engine* engine, thread_pool* pool)
+		{
+			const graphics::surface& surf = engine->surface;
+			const unsigned* xt = x_table, * yt = y_table;
+			int w = surf.dim.x, h = surf.dim.y;
+			unsigned blocks_x = (surf.dim.x + 7) >> 3, threads = pool->amount, bands = threads == 1 ? 1 : threads << 1;
+			int max_move = threads == 1 ? INT_MAX : int(h / bands) >> 1;
+			float hx = static_cast<float>(engine->hdim.x), hy = static_cast<float>(engine->hdim.y),
+				k = 1.0f / (cam->h * engine->fhdim.x), project = cam->h * engine->fhdim.x, fw = static_cast<float>(w), fh = static_cast<float>(h);
+			float near = cam->near, edge_hi = 1.0f + edge_tolerance, edge_lo = 1.0f / edge_hi;
+			fvec3 step = m[0] * k;
+			bool tiled = surf.x_offsets != nullptr;
+
+			const __m128 lanes = _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f), zero = _mm_setzero_ps(),
+				step_x = _mm_set1_ps(step.x), step_y = _mm_set1_ps(step.y), step_z = _mm_set1_ps(step.z),
+				t_x = _mm_set1_ps(translation.x), t_y = _mm_set1_ps(translation.y), t_z = _mm_set1_ps(translation.z),
+				v_background = _mm_set1_ps(background), v_edge_lo = _mm_set1_ps(edge_lo), v_edge_hi = _mm_set1_ps(edge_hi),
+				v_near = _mm_set1_ps(near), v_project = _mm_set1_ps(project), v_hx = _mm_set1_ps(hx + 0.5f), v_hy = _mm_set1_ps(hy + 0.5f),
+				v_w = _mm_set1_ps(fw), v_h = _mm_set1_ps(fh);
+
+			for (unsigned round = 0; round < (bands == 1 ? 1U : 2U); round++)
+				pool->run([&](unsigned index)
+				{
+					unsigned band = bands == 1 ? 0 : (index << 1) + round;
+
+					for (int y = h * band / bands; y < int(h * (band + 1) / bands); y++)
+					{
+						const uint8_t* skip_row = &skip[(y >> 3) * blocks_x];
+						unsigned row = yt[y], up = y + 1 < h ? yt[y + 1] : row, down = y > 0 ? yt[y - 1] : row;
+						// camera space direction of (0, y) at z = 1, rotated into the new camera
+						fvec3 dir = m[1] * ((static_cast<float>(y) - hy) * k) + m[2] - step * hx;
+
+						auto splat = [&](uint64_t s, int px, int py)
+						{
+							uint64_t& dest = splats[xt[px] + yt[py]];
+							if (s < dest)
+								dest = s;
+						};
+
+						// first & last pixels of the row, the 4 wide loop reads a pixel left & right
+						auto one = [&](int x)
+						{
+							unsigned xo = xt[x], o = xo + row;
+							float z = depths[o];
+
+							if (z > background || skip_row[x >> 3] != 0)
+								return;
+
+							// confidence: no depth edge around the pixel (silhouettes move by their own parallax),
+							// |n - z| <= edge_tolerance * min(n, z)
+							float l = depths[xt[x > 0 ? x - 1 : x] + row], r = depths[xt[x + 1 < w ? x + 1 : x] + row], u = depths[xo + up], d = depths[xo + down];
+							if ((std::min)((std::min)(l, r), (std::min)(u, d)) < z * edge_lo || (std::max)((std::max)(l, r), (std::max)(u, d)) > z * edge_hi)
+								return;
+
+							float fx = static_cast<float>(x),
+								vx = (dir.x + step.x * fx) * z + translation.x,
+								vy = (dir.y + step.y * fx) * z + translation.y,
+								vz = (dir.z + step.z * fx) * z + translation.z;
+							if (vz < near)
+								return;
+
+							float t = project / vz, px = vx * t + hx + 0.5f, py = vy * t + hy + 0.5f;
+							if (px < 0.0f || py < 0.0f || px >= fw || py >= fh || abs(int(py) - y) > max_move)
+								return;
+
+							splat(static_cast<uint64_t>(std::bit_cast<uint32_t>(vz)) << 32 | o, int(px), int(py));
+						};
+
+						auto load = [&](unsigned offset, int x)
+						{
+							return tiled ? _mm_setr_ps(depths[xt[x] + offset], depths[xt[x + 1] + offset], depths[xt[x + 2] + offset], depths[xt[x + 3] + offset]) :
+								_mm_loadu_ps(depths + offset + x);
+						};
+
+						__m128 dir_x = _mm_set1_ps(dir.x), dir_y = _mm_set1_ps(dir.y), dir_z = _mm_set1_ps(dir.z);
+						__m128i move_lo = _mm_set1_epi32(y - max_move - 1), move_hi = _mm_set1_epi32(y > INT_MAX - max_move ? INT_MAX : y + max_move + 1);
+
+						int x = 0;
+						for (; x < 4 && x < w; x++)
+							one(x);
+
+						for (; x + 4 < w; x += 4)
+						{
+							// 4 pixels share the 8x8 block
+							if (skip_row[x >> 3] != 0)
+								continue;
+
+							__m128 z = load(row, x), l = load(row, x - 1), r = load(row, x + 1), u = load(up, x), d = load(down, x);
+							__m128 valid = _mm_and_ps(_mm_cmple_ps(z, v_background),
+								_mm_and_ps(_mm_cmpge_ps(_mm_min_ps(_mm_min_ps(l, r), _mm_min_ps(u, d)), _mm_mul_ps(z, v_edge_lo)),
+									_mm_cmple_ps(_mm_max_ps(_mm_max_ps(l, r), _mm_max_ps(u, d)), _mm_mul_ps(z, v_edge_hi))));
+							if (_mm_movemask_ps(valid) == 0)
+								continue;
+
+							__m128 fx = _mm_add_ps(_mm_set1_ps(static_cast<float>(x)), lanes),
+								vx = _mm_add_ps(_mm_mul_ps(_mm_add_ps(dir_x, _mm_mul_ps(step_x, fx)), z), t_x),
+								vy = _mm_add_ps(_mm_mul_ps(_mm_add_ps(dir_y, _mm_mul_ps(step_y, fx)), z), t_y),
+								vz = _mm_add_ps(_mm_mul_ps(_mm_add_ps(dir_z, _mm_mul_ps(step_z, fx)), z), t_z);
+							valid = _mm_and_ps(valid, _mm_cmpge_ps(vz, v_near));
+
+							__m128 t = _mm_div_ps(v_project, vz),
+								px = _mm_add_ps(_mm_mul_ps(vx, t), v_hx), py = _mm_add_ps(_mm_mul_ps(vy, t), v_hy);
+							valid = _mm_and_ps(valid, _mm_and_ps(
+								_mm_and_ps(_mm_cmpge_ps(px, zero), _mm_cmpge_ps(py, zero)),
+								_mm_and_ps(_mm_cmplt_ps(px, v_w), _mm_cmplt_ps(py, v_h))));
+
+							__m128i ipx = _mm_cvttps_epi32(px), ipy = _mm_cvttps_epi32(py);
+							valid = _mm_and_ps(valid, _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(ipy, move_lo), _mm_cmplt_epi32(ipy, move_hi))));
+
+							alignas(16) int dest_x[4], dest_y[4];
+							alignas(16) uint32_t keys[4];
+							_mm_store_si128(reinterpret_cast<__m128i*>(dest_x), ipx);
+							_mm_store_si128(reinterpret_cast<__m128i*>(dest_y), ipy);
+							_mm_store_si128(reinterpret_cast<__m128i*>(keys), _mm_castps_si128(vz));
+
+							for (unsigned bits = _mm_movemask_ps(valid), i; bits != 0; bits &= bits - 1)
+							{
+								i = std::countr_zero(bits);
+								splat(static_cast<uint64_t>(keys[i]) << 32 | (xt[x + i] + row), dest_x[i], dest_y[i]);
+							}
+						}
+
+						for (; x < w; x++)
+							one(x);
+					}
+				});
+		}
+
+		// splats -> surface & depth buffer, 8x8 blocks with a hole are cleared & marked for repainting
+		void resolve(basic_engine* engine, thread_pool* pool)
+		{
+			graphics::surface& surf = engine->surface;
+			const unsigned* xt = x_table, * yt = y_table;
+			int w = surf.dim.x, h = surf.dim.y;
+			unsigned blocks_x = (surf.dim.x + 7) >> 3, blocks_y = (surf.dim.y + 7) >> 3, threads = pool->amount;
+			uint32_t* depth_bits = reinterpret_cast<uint32_t*>(engine->depth_buffer);
+			std::vector<unsigned> redrawn(threads, 0);
+
+			pool->run([&](unsigned index)
+			{
+				auto splat = [&](int x, int y) { return x < 0 || y < 0 || x >= w || y >= h ? empty : splats[xt[x] + yt[y]]; };
+				// a one pixel crack between two similar splats takes the nearer one
+				auto fill = [&](uint64_t a, uint64_t b) { return a != empty && b != empty && similar(splat_depth(a), splat_depth(b)) ? (std::min)(a, b) : empty; };
+
+				uint64_t block[64];
+
+				for (unsigned by = blocks_y * index / threads; by < blocks_y * (index + 1) / threads; by++)
+					for (unsigned bx = 0; bx < blocks_x; bx++)
+					{
+						uint8_t& dirty = repaint[by * blocks_x + bx];
+						int x_begin = bx << 3, y_begin = by << 3, x_end = (std::min)(x_begin + 8, w), y_end = (std::min)(y_begin + 8, h);
+						uint64_t* b = block;
+
+						for (int y = y_begin; y < y_end && dirty == 0; y++)
+							for (int x = x_begin; x < x_end; x++)
+							{
+								uint64_t s = splats[xt[x] + yt[y]];
+								if (s == empty)
+								{
+									s = fill(splat(x - 1, y), splat(x + 1, y));
+									if (s == empty)
+										s = fill(splat(x, y - 1), splat(x, y + 1));
+									if (s == empty)
+									{
+										dirty = 1;
+										break;
+									}
+								}
+								*b++ = s;
+							}
+
+						b = block;
+						for (int y = y_begin; y < y_end; y++)
+						{
+							unsigned row = yt[y];
+
+							for (int x = x_begin; x < x_end; x++)
+							{
+								unsigned o = xt[x] + row;
+
+								if (dirty != 0)
+								{
+									surf.buffer[o] = 0;
+									depth_bits[o] = 0x7f7f7f7fU;
+								}
+								else
+								{
+									uint64_t s = *b++;
+									surf.buffer[o] = colors[static_cast<uint32_t>(s)];
+									depth_bits[o] = static_cast<uint32_t>(s >> 32);
+								}
+							}
+						}
+
+						redrawn[index] += dirty;
+					}
+			});
+
+			redrawn_blocks = 0;
+			for (unsigned r : redrawn)
+				redrawn_blocks += r;
+		}
+
+	public:
+		reprojector(const basic_engine* engine, unsigned full_interval = 8, float max_turn = 0.1f, float edge_tolerance = 0.1f)
+			: full_interval(full_interval), max_turn(max_turn), edge_tolerance(edge_tolerance), last_full(true), redrawn_blocks(0), total_blocks(0),
+			last_position(0.0f, 0.0f, 0.0f), last_rotation(), last_dim(), since_full(0), has_history(false)
+		{
+			const graphics::surface& surf = engine->surface;
+			assert(engine->depth_buffer != nullptr);
+
+			// room for the largest dim the surface can be resized to
+			unsigned mask = (1U << surf.tile_log2) - 1U;
+			capacity = surf.tile_log2 == 0 ? surf.max_dim.x * surf.max_dim.y :
+				(((surf.max_dim.x + mask) >> surf.tile_log2) * ((surf.max_dim.y + mask) >> surf.tile_log2)) << (surf.tile_log2 << 1);
+
+			colors = TYPE_MALLOC(color_t, capacity);
+			depths = TYPE_MALLOC(float, capacity);
+			splats = TYPE_MALLOC(uint64_t, capacity);
+			assert(colors != nullptr && depths != nullptr && splats != nullptr);
+
+			if (surf.x_offsets == nullptr)
+			{
+				row_x.resize(surf.max_dim.x);
+				row_y.resize(surf.max_dim.y);
+				for (unsigned i = 0; i < surf.max_dim.x; i++)
+					row_x[i] = i;
+			}
+		}
+
+		reprojector(const reprojector&) = delete;
+
+		~reprojector()
+		{
+			free(colors);
+			free(depths);
+			free(splats);
+		}
+
+		// the next frame is drawn from scratch (camera cut, scene change)
+		inline void reset()
+		{
+			has_history = false;
+		}
+
+		// replaces the clear & draw_parallel of a frame
+		void draw(compound_mesh** meshes, const uint8_t* update_types, unsigned mesh_amount, camera* cam, basic_engine* engine, thread_pool* pool)
+		{
+			graphics::surface& surf = engine->surface;
+			assert(surf.buffer_size <= capacity);
+
+			swap_buffers(engine);
+			update_parallel(meshes, update_types, mesh_amount, cam, pool);
+
+			unsigned blocks_x = (surf.dim.x + 7) >> 3;
+			total_blocks = blocks_x * ((surf.dim.y + 7) >> 3);
+			repaint.assign(total_blocks, 0);
+			skip.assign(total_blocks, 0);
+
+			if (surf.dim != last_dim)
+				has_history = false;
+			track_meshes(meshes, update_types, mesh_amount, cam, engine, blocks_x);
+
+			// previous camera space -> new camera space: v' = m * v + translation
+			// columns of the previous rotation, its rows are the inverse
+			fvec3 c0 = last_rotation.rotate_vertex({ 1.0f, 0.0f, 0.0f }),
+				c1 = last_rotation.rotate_vertex({ 0.0f, 1.0f, 0.0f }),
+				c2 = last_rotation.rotate_vertex({ 0.0f, 0.0f, 1.0f });
+			fvec3 m[3] = {
+				cam->rotation.rotate_vertex({ c0.x, c1.x, c2.x }),
+				cam->rotation.rotate_vertex({ c0.y, c1.y, c2.y }),
+				cam->rotation.rotate_vertex({ c0.z, c1.z, c2.z })
+			};
+			fvec3 translation = cam->rotation.rotate_vertex(last_position - cam->position);
+
+			// trace = 1 + 2 cos(turn)
+			bool turned = (m[0].x + m[1].y + m[2].z - 1.0f) * 0.5f < cosf(max_turn);
+			// moving meshes already over every block: nothing to reuse
+			bool covered = std::find(repaint.begin(), repaint.end(), 0) == repaint.end();
+			last_full = has_history == false || since_full + 1 >= full_interval || turned || covered;
+
+			if (last_full)
+			{
+				EBG_PROFILE_SCOPE(sclear);
+
+				0 >> surf;
+				memset(engine->depth_buffer, 0b01111111, surf.buffer_size << 2);
+				since_full = 0;
+				redrawn_blocks = total_blocks;
+			}
+			else
+			{
+				unsigned threads = pool->amount;
+				pool->run([&](unsigned index)
+				{
+					size_t begin = size_t(surf.buffer_size) * index / threads, end = size_t(surf.buffer_size) * (index + 1) / threads;
+					memset(splats + begin, 0xFF, (end - begin) << 3);
+				});
+
+				update_tables(surf);
+				scatter(m, translation, cam, engine, pool);
+				resolve(engine, pool);
+				surf.repaint = repaint.data();
+				since_full++;
+			}
+
+			draw_bands(meshes, mesh_amount, cam, engine, pool);
+			surf.repaint = nullptr;
+
+			last_position = cam->position;
+			last_rotation = cam->rotation;
+			last_dim = surf.dim;
+			has_history = true;
+		}
+	};
+}
@@ -0,0 +1,231 @@
+#pragma once
+
+#include "EBG_camera_path.h"
+#include "EBG_reprojection.h"
+#include "EBG_visibility.h"
+#include "EBG_msaa.h"
+
+/*
+Scripted scenes over the bundled meshes
+
+everything is a function of the frame index (no clocks, no input),
+so frame N of a scene is the same on every run and machine
+*/
+
+namespace eb3d
+{
+	namespace scenes
+	{
+		struct scene
+		{
+			const char* name;
+			std::vector<compound_mesh*> meshes;
+			std::vector<uint8_t> update_types;
+			camera_path path;
+			// moves the dynamic meshes to frame t in [0, 1]
+			void (*animate)(scene* s, float t);
+
+			unsigned triangle_amount() const
+			{
+				unsigned amount = 0;
+				for (compound_mesh* m : meshes)
+					amount += m->triangle_amount;
+				return amount;
+			}
+
+			compound_mesh* add(compound_mesh* mesh, uint8_t update_type, basic_color_conversation_data bccd, camera* cam)
+			{
+				mesh->setup(cam);
+				mesh->bccd = bccd;
+				meshes.push_back(mesh);
+				update_types.push_back(update_type);
+				return mesh;
+			}
+		};
+
+		inline void delete_scene(scene* s)
+		{
+			for (compound_mesh* m : s->meshes)
+			{
+				delete_compound_mesh(m);
+				delete m;
+			}
+
+			s->meshes.clear();
+			s->update_types.clear();
+		}
+
+		// landscape of test.cpp, low flyover then a climb looking down
+		scene terrain(camera* cam)
+		{
+			scene s;
+			s.name = "terrain";
+
+			s.add(new compound_mesh("lan.txt", { 5.0f, 2.0f, 5.0f }), tstatic, { 0.7f, 0.0f, 0.5f, 0.5f, -0.2f, 0.5f }, cam);
+			s.add(new compound_mesh("sphere.txt", { 0.0f, 3.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }, 5.0f), tonly_pos, { 1.0f, 0.0f, -0.1f, 0.1f, 1.0f, 0.0f }, cam);
+			s.add(new compound_mesh("sphere.txt", { 1500.0f, 700.0f, 700.0f }, { 0.0f, 0.0f, 0.0f }, 1000.0f), tonly_pos, { 1.0f, 0.0f, 0.7f, 0.3f, 0.0f, 0.0f }, cam);
+			s.add(new compound_mesh("unk3.txt", { 1.0f, 10.0f, 1.0f }, { 0.0f, 0.0f, 0.0f }, 4.0f), tdynamic, { -1.0f, 1.0f, 0.7f, 0.3f, 0.7f, 0.0f }, cam);
+
+			s.path.add(0.0f, { -40.0f, 4.0f, -45.0f }, { 0.1f, 0.6f, 0.0f });
+			s.path.add(0.4f, { 0.0f, 6.0f, -20.0f }, { 0.2f, 0.2f, 0.0f });
+			s.path.add(0.7f, { 30.0f, 12.0f, 10.0f }, { 0.3f, -0.8f, 0.0f });
+			s.path.add(1.0f, { 0.0f, 60.0f, -60.0f }, { 0.7f, 0.0f, 0.0f });
+
+			s.animate = [](scene* s, float t)
+			{
+				s->meshes[1]->position.y = 3.0f + 2.0f * t;
+				s->meshes[3]->rotation->rotation = fvec3(0.0f, static_cast<float>(M_2PI) * t, 0.0f);
+			};
+
+			return s;
+		}
+
+		// spinning teapot, camera slowly closing in
+		scene teapot(camera* cam)
+		{
+			scene s;
+			s.name = "teapot";
+
+			s.add(new compound_mesh("utahTeapot.txt", { 0.0f, -1.5f, 7.0f }, { 0.0f, 0.0f, 0.0f }), tdynamic, { 0.8f, 0.2f, 0.8f, 0.2f, 0.8f, 0.2f }, cam);
+
+			s.path.add(0.0f, { 0.0f, 1.0f, 1.0f }, { 0.2f, 0.0f, 0.0f });
+			s.path.add(1.0f, { 0.0f, 0.5f, 3.5f }, { 0.2f, 0.0f, 0.0f });
+
+			s.animate = [](scene* s, float t)
+			{
+				s->meshes[0]->rotation->rotation = fvec3(0.0f, static_cast<float>(M_2PI) * t, 0.0f);
+			};
+
+			return s;
+		}
+
+		// every small mesh, rotating, camera walking past them
+		scene objects(camera* cam)
+		{
+			scene s;
+			s.name = "objects";
+
+			s.add(new compound_mesh("cube.txt", { -6.0f, 0.0f, 10.0f }, { 0.0f, 0.0f, 0.0f }), tdynamic, { 1.0f, 0.0f, 0.2f, 0.2f, 0.2f, 0.2f }, cam);
+			s.add(new compound_mesh("sphere.txt", { -3.0f, 0.0f, 12.0f }, { 0.0f, 0.0f, 0.0f }), tonly_pos, { 0.2f, 0.2f, 1.0f, 0.0f, 0.2f, 0.2f }, cam);
+			s.add(new compound_mesh("spaceship.txt", { 0.0f, 0.0f, 14.0f }, { 0.0f, 0.0f, 0.0f }), tdynamic, { 0.5f, 0.3f, 0.5f, 0.3f, 0.8f, 0.2f }, cam);
+			s.add(new compound_mesh("unk.txt", { 4.0f, -2.0f, 12.0f }, { 0.0f, 0.0f, 0.0f }), tdynamic, { 0.8f, 0.2f, 0.5f, 0.1f, 0.1f, 0.1f }, cam);
+			s.add(new compound_mesh("unk2.txt", { 10.0f, -4.0f, 25.0f }, { 0.0f, 0.0f, 0.0f }), tdynamic, { 0.3f, 0.3f, 0.8f, 0.2f, 0.3f, 0.3f }, cam);
+			s.add(new compound_mesh("unk3.txt", { 0.0f, -10.0f, 70.0f }, { 0.0f, 0.0f, 0.0f }), tdynamic, { -1.0f, 1.0f, 0.7f, 0.3f, 0.7f, 0.0f }, cam);
+
+			s.path.add(0.0f, { 0.0f, 1.0f, -5.0f }, { 0.0f, 0.0f, 0.0f });
+			s.path.add(0.5f, { -2.0f, 2.0f, 4.0f }, { 0.1f, 0.3f, 0.0f });
+			s.path.add(1.0f, { 2.0f, 3.0f, 8.0f }, { 0.1f, -0.3f, 0.0f });
+
+			s.animate = [](scene* s, float t)
+			{
+				float a = static_cast<float>(M_2PI) * t;
+
+				s->meshes[0]->rotation->rotation = fvec3(a, a * 2.0f, 0.0f);
+				s->meshes[1]->position.y = sinf(a * 3.0f);
+				s->meshes[2]->rotation->rotation = fvec3(0.0f, a, 0.0f);
+				s->meshes[3]->rotation->rotation = fvec3(0.0f, -a, a);
+				s->meshes[4]->rotation->rotation = fvec3(0.0f, a * 0.5f, 0.0f);
+				s->meshes[5]->rotation->rotation = fvec3(0.0f, a * 0.25f, 0.0f);
+			};
+
+			return s;
+		}
+
+		scene by_name(const char* name, camera* cam)
+		{
+			if (strcmp(name, "teapot") == 0)
+				return teapot(cam);
+			if (strcmp(name, "objects") == 0)
+				return objects(cam);
+			return terrain(cam);
+		}
+
+		// every mesh drawn with shading (graphics::draw::hflat or hgouraud, htextured needs set_texture)
+		inline void set_shading(scene* s, uint8_t shading)
+		{
+			for (compound_mesh* m : s->meshes)
+				m->shading = shading;
+		}
+
+		// texture of the --textured options: light & dark squares of cell texels, size a power of two,
+		// a line every 4 squares so the mip levels show
+		graphics::texture checker_texture(unsigned size = 1024, unsigned cell = 64, uint8_t filter = graphics::fbilinear, bool mipmaps = true)
+		{
+			std::vector<color_t> pixels(size * size);
+
+			for (unsigned y = 0; y < size; y++)
+				for (unsigned x = 0; x < size; x++)
+				{
+					color_t c = ((x / cell + y / cell) & 1) ? 0xFFFFFF : 0x909090;
+					if (x % (cell << 2) == 0 || y % (cell << 2) == 0)
+						c = 0x303030;
+					pixels[y * size + x] = c;
+				}
+
+			return graphics::create_texture(pixels.data(), upoint(size, size), filter, mipmaps);
+		}
+
+		// every mesh textured by tex (tinted by its lighting), planar uvs: a repeat of the texture every scale units
+		// along x & y, z shears them so no side is a single line of texels
+		inline void set_texture(scene* s, const graphics::texture* tex, float scale = 4.0f)
+		{
+			for (compound_mesh* m : s->meshes)
+			{
+				m->calc_planar_uvs(fvec3(1.0f, 0.0f, 0.5f) / scale, fvec3(0.0f, 1.0f, 0.5f) / scale);
+				m->texture = tex;
+				m->shading = graphics::draw::htextured;
+			}
+		}
+
+		// lights = the rig of the --lights options: light_direction, a dim fill from the other side & below,
+		// a point light at the first camera key
+		inline void set_lights(const scene* s)
+		{
+			lights.clear();
+			lights.push_back({ light_direction, 0.8f, 0.0f, ldirectional });
+			lights.push_back({ normalize(fvec3(1.0f, -0.5f, 1.0f)), 0.3f, 0.0f, ldirectional });
+			if (s->path.keys.empty() == false)
+				lights.push_back({ s->path.keys.front().position, 1.5f, 0.02f, lpoint });
+		}
+
+		const char* names[] = { "terrain", "teapot", "objects" };
+		constexpr unsigned scene_amount = 3;
+
+		// frame_index of frame_amount: clear, animate, band parallel draw, detile (tiled surfaces)
+		// reproject: reuse the previous frame of the engine instead of clearing & drawing everything,
+		// visibility: deferred shading (ids, then every pixel shaded once) instead of forward,
+		// msaa: 4x multisampled & resolved, one of the three at most, clear_color: background of the frame (not reproject)
+		void render_frame(scene* s, unsigned frame_index, unsigned frame_amount, camera* cam, basic_engine* engine, thread_pool* pool,
+			reprojector* reproject = nullptr, visibility_buffer* visibility = nullptr, msaa_buffer* msaa = nullptr, color_t clear_color = 0)
+		{
+			float t = frame_amount > 1 ? static_cast<float>(frame_index) / static_cast<float>(frame_amount - 1) : 0.0f;
+			assert((reproject != nullptr) + (visibility != nullptr) + (msaa != nullptr) <= 1);
+
+			if (reproject == nullptr && visibility == nullptr && msaa == nullptr)
+			{
+				EBG_PROFILE_SCOPE(sclear);
+
+				graphics::fill(clear_color, &engine->surface);
+				memset(engine->depth_buffer, 0b01111111, engine->surface.buffer_size << 2);
+			}
+
+			s->path.sample(t * s->path.duration(), cam);
+			s->animate(s, t);
+
+			if (reproject != nullptr)
+				reproject->draw(s->meshes.data(), s->update_types.data(), static_cast<unsigned>(s->meshes.size()), cam, engine, pool);
+			else if (visibility != nullptr)
+				visibility->draw(s->meshes.data(), s->update_types.data(), static_cast<unsigned>(s->meshes.size()), cam, engine, pool, clear_color);
+			else if (msaa != nullptr)
+				msaa->draw(s->meshes.data(), s->update_types.data(), static_cast<unsigned>(s->meshes.size()), cam, engine, pool, clear_color);
+			else
+				draw_parallel(s->meshes.data(), s->update_types.data(), static_cast<unsigned>(s->meshes.size()), cam, engine, pool);
+
+			if (engine->surface.x_offsets != nullptr)
+			{
+				EBG_PROFILE_SCOPE(spresent);
+				graphics::detile(&engine->surface, engine->present_buffer);
+			}
+		}
+	}
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include "EBG_3d.h"
+
+/*
+Static layer cache: the meshes that don't change are drawn once & reused while the camera stands still
+
+the colors & depths of the static meshes alone are kept in a retained buffer, a frame restores it
+(memcpy instead of clear, transform & raster of the static meshes) and only the dynamic meshes are drawn on top
+the cache is drawn again when the camera, the surface size or a static mesh (position, rotation, bccd) changed
+(euler angles or a rotation_data::set, seen as its version),
+invalidate() covers anything else (edited vertices, triangles or uvs, shading, texture, light_direction or lights)
+on a restored frame the world vertices of the static meshes are left as they were
+*/
+
+namespace eb3d
+{
+	class static_layer
+	{
+	public:
+		compound_mesh** meshes;
+		unsigned mesh_amount;
+
+		// last draw restored the cache, frames restored & drawn so far
+		bool last_hit;
+		unsigned hits, misses;
+
+	private:
+		struct mesh_state
+		{
+			fvec3 position, rotation;
+			unsigned rotation_version;
+			basic_color_conversation_data bccd;
+		};
+
+		color_t* colors;
+		float* depths;
+		unsigned capacity;
+
+		std::vector<uint8_t> update_types;
+		std::vector<mesh_state> states;
+		fvec3 last_position, last_rotation;
+		unsigned last_version;
+		upoint last_dim;
+		bool valid;
+
+		static inline mesh_state state_of(const compound_mesh* mesh)
+		{
+			if (mesh->rotation == nullptr)
+				return { mesh->position, fvec3(0.0f, 0.0f, 0.0f), 0, mesh->bccd };
+			return { mesh->position, mesh->rotation->rotation, mesh->rotation->version, mesh->bccd };
+		}
+
+		bool unchanged(const camera* cam, const graphics::surface& surf) const
+		{
+			if (valid == false || cam->position != last_position || cam->rotation.rotation != last_rotation ||
+				cam->rotation.version != last_version || surf.dim != last_dim)
+				return false;
+
+			for (unsigned m = 0; m < mesh_amount; m++)
+			{
+				mesh_state s = state_of(meshes[m]);
+				if (s.position != states[m].position || s.rotation != states[m].rotation || s.rotation_version != states[m].rotation_version ||
+					memcmp(&s.bccd, &states[m].bccd, sizeof(s.bccd)) != 0)
+					return false;
+			}
+
+			return true;
+		}
+
+	public:
+		// meshes must outlive the layer, update_types nullptr = tauto for all
+		static_layer(compound_mesh** meshes, const uint8_t* update_types, unsigned mesh_amount)
+			: meshes(meshes), mesh_amount(mesh_amount), last_hit(false), hits(0), misses(0),
+			colors(nullptr), depths(nullptr), capacity(0), update_types(mesh_amount, tauto), states(mesh_amount),
+			last_position(0.0f, 0.0f, 0.0f), last_rotation(0.0f, 0.0f, 0.0f), last_version(0), last_dim(), valid(false)
+		{
+			if (update_types != nullptr)
+				this->update_types.assign(update_types, update_types + mesh_amount);
+		}
+
+		static_layer(const static_layer&) = delete;
+
+		~static_layer()
+		{
+			free(colors);
+			free(depths);
+		}
+
+		// the next draw redraws the static meshes
+		inline void invalidate()
+		{
+			valid = false;
+		}
+
+		// replaces the clear of a frame: restores the static meshes or clears, draws & caches them,
+		// pool: band parallel (draw_parallel) instead of a serial update & draw
+		void draw(camera* cam, basic_engine* engine, thread_pool* pool = nullptr)
+		{
+			graphics::surface& surf = engine->surface;
+			assert(engine->depth_buffer != nullptr);
+
+			last_hit = unchanged(cam, surf);
+
+			if (last_hit)
+			{
+				EBG_PROFILE_SCOPE(sclear);
+
+				memcpy(surf.buffer, colors, surf.buffer_size << 2);
+				memcpy(engine->depth_buffer, depths, surf.buffer_size << 2);
+				hits++;
+				return;
+			}
+
+			{
+				EBG_PROFILE_SCOPE(sclear);
+
+				0 >> surf;
+				memset(engine->depth_buffer, 0b01111111, surf.buffer_size << 2);
+			}
+
+			if (pool != nullptr)
+				draw_parallel(meshes, update_types.data(), mesh_amount, cam, engine, pool);
+			else
+			{
+				for (unsigned m = 0; m < mesh_amount; m++)
+				{
+					meshes[m]->update(cam, update_types[m]);
+					meshes[m]->draw(cam, engine);
+				}
+			}
+
+			// grows to the largest buffer_size seen (dynamic resolution)
+			if (surf.buffer_size > capacity)
+			{
+				free(colors);
+				free(depths);
+				capacity = surf.buffer_size;
+				colors = TYPE_MALLOC(color_t, capacity);
+				depths = TYPE_MALLOC(float, capacity);
+				assert(colors != nullptr && depths != nullptr);
+			}
+
+			memcpy(colors, surf.buffer, surf.buffer_size << 2);
+			memcpy(depths, engine->depth_buffer, surf.buffer_size << 2);
+
+			for (unsigned m = 0; m < mesh_amount; m++)
+				states[m] = state_of(meshes[m]);
+			last_position = cam->position;
+			last_rotation = cam->rotation.rotation;
+			last_version = cam->rotation.version;
+			last_dim = surf.dim;
+			valid = true;
+			misses++;
+		}
+	};
+}
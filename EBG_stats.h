@@ -0,0 +1,133 @@
+#pragma once
+
+/*
+Pipeline statistics
+
+compiled out unless EBG_STATS is defined
+
+every thread counts into its own counters, stats::end_frame() merges them into stats::frame
+(call it at frame end, when no other thread is drawing)
+
+overdraw mode: depth passing writes increment the pixel instead of setting the color,
+clear the surface to 0 and end_frame() turns the counts into a heatmap
+*/
+
+#ifdef EBG_STATS
+
+#include "EBG_colors.h"
+
+#include <atomic>
+#include <cstdio>
+
+namespace ebg
+{
+	namespace stats
+	{
+		struct counters
+		{
+			unsigned long long
+				triangles_submitted,
+				backface_rejected,
+				near_rejected,
+				clipped_to_one,
+				clipped_to_two,
+				triangles_rasterized,
+				pixels_tested,
+				pixels_passed;
+
+			void operator+=(const counters& c)
+			{
+				triangles_submitted += c.triangles_submitted;
+				backface_rejected += c.backface_rejected;
+				near_rejected += c.near_rejected;
+				clipped_to_one += c.clipped_to_one;
+				clipped_to_two += c.clipped_to_two;
+				triangles_rasterized += c.triangles_rasterized;
+				pixels_tested += c.pixels_tested;
+				pixels_passed += c.pixels_passed;
+			}
+		};
+
+		struct thread_counters
+		{
+			counters c;
+			thread_counters* next;
+		};
+
+		std::atomic<thread_counters*> threads = nullptr;
+
+		// merged totals of the last finished frame
+		counters frame = {};
+		bool overdraw = false;
+
+		thread_counters* register_counters()
+		{
+			thread_counters* t = new thread_counters{};
+
+			t->next = threads.load(std::memory_order_relaxed);
+			while (threads.compare_exchange_weak(t->next, t, std::memory_order_release, std::memory_order_relaxed) == false);
+
+			return t;
+		}
+
+		inline counters& local()
+		{
+			thread_local thread_counters* t = register_counters();
+			return t->c;
+		}
+
+		// black, blue, cyan, green, yellow, orange, red, magenta, white (8+ writes)
+		constexpr color_t heatmap[9] = {
+			0xFF000000, 0xFF0000FF, 0xFF00FFFF, 0xFF00FF00, 0xFFFFFF00,
+			0xFFFF8000, 0xFFFF0000, 0xFFFF00FF, 0xFFFFFFFF
+		};
+
+		// per-pixel write counts -> heatmap colors, count_amount is surface.buffer_size
+		void apply_heatmap(color_t* buffer, unsigned count_amount)
+		{
+			for (color_t* px = buffer, * end = buffer + count_amount; px < end; px++)
+				*px = heatmap[*px < 8 ? *px : 8];
+		}
+
+		void end_frame(color_t* buffer = nullptr, unsigned count_amount = 0)
+		{
+			frame = {};
+			for (thread_counters* t = threads.load(std::memory_order_acquire); t != nullptr; t = t->next)
+			{
+				frame += t->c;
+				t->c = {};
+			}
+
+			if (overdraw && buffer != nullptr)
+				apply_heatmap(buffer, count_amount);
+		}
+
+		// one line summary of stats::frame, for titles and consoles
+		int format(char* buffer, size_t size, unsigned screen_pixels)
+		{
+			return snprintf(buffer, size,
+				"tris %llu back %llu near %llu clip1 %llu clip2 %llu raster %llu | px tested %llu passed %llu overdraw %.2f",
+				frame.triangles_submitted, frame.backface_rejected, frame.near_rejected,
+				frame.clipped_to_one, frame.clipped_to_two, frame.triangles_rasterized,
+				frame.pixels_tested, frame.pixels_passed,
+				static_cast<double>(frame.pixels_passed) / static_cast<double>(screen_pixels));
+		}
+	}
+}
+
+#define EBG_STATS_ADD(counter, n) (ebg::stats::local().counter += (n))
+// per triangle & per mesh counts of band parallel draws: every band sees every triangle,
+// only the band from row 0 (the whole surface when serial) counts them
+#define EBG_STATS_BAND_ADD(surf, counter, n) ((surf).row_begin == 0 ? void(EBG_STATS_ADD(counter, n)) : void())
+// color write that counts instead while overdraw mode is on
+#define EBG_STATS_WRITE(px, color) (ebg::stats::overdraw ? void(++(px)) : void((px) = (color)))
+#define EBG_STATS_FRAME_END(buffer, count_amount) ebg::stats::end_frame(buffer, count_amount)
+
+#else
+
+#define EBG_STATS_ADD(counter, n) ((void)0)
+#define EBG_STATS_BAND_ADD(surf, counter, n) ((void)0)
+#define EBG_STATS_WRITE(px, color) ((px) = (color))
+#define EBG_STATS_FRAME_END(buffer, count_amount) ((void)0)
+
+#endif
@@ -0,0 +1,567 @@
+#pragma once
+
+#include "EBG_capture.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+#ifdef _WIN32
+// Windows.h may already have pulled in winsock 1.1, everything used here is in both
+#ifndef _WINSOCKAPI_
+#include <winsock2.h>
+#endif
+#pragma comment(lib, "ws2_32.lib")
+#else
+#include <sys/socket.h>
+#include <sys/select.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#endif
+
+/*
+Framebuffer streaming over TCP
+
+little endian, server -> client:
+	hello: "EBGS" u32 version, u32 width, u32 height, u32 tile size
+	frame: "FRME" u32 frame index, u32 tile amount, u32 payload bytes, then per changed tile:
+		u16 tile x, u16 tile y, u8 encoding, u32 bytes, encoded pixels
+client -> server:
+	ack: "ACK " u32 frame index, after the frame is applied (latency = submit -> ack)
+
+tiles are tile_size x tile_size (smaller on the right & top edges), pixels row by row
+from the tile's lowest surface row, like the surface (y = 0 at the bottom)
+encodings: raw (r, g, b per pixel), rle (u8 run - 1, r, g, b), qoi (QOI chunks of the tile),
+a tile falls back to raw when its encoding isn't smaller
+*/
+
+namespace ebg
+{
+	namespace stream
+	{
+		constexpr unsigned version = 1, tile_size = 16;
+
+		enum tile_encodings { eraw, erle, eqoi };
+
+#ifdef _WIN32
+		typedef SOCKET socket_t;
+		constexpr socket_t invalid_socket = INVALID_SOCKET;
+
+		inline void close_socket(socket_t s) { closesocket(s); }
+
+		inline bool init_sockets()
+		{
+			WSADATA wsa;
+			return WSAStartup(MAKEWORD(2, 2), &wsa) == 0;
+		}
+
+		inline void free_sockets() { WSACleanup(); }
+		constexpr int send_flags = 0;
+#else
+		typedef int socket_t;
+		constexpr socket_t invalid_socket = -1;
+
+		inline void close_socket(socket_t s) { close(s); }
+		inline bool init_sockets() { return true; }
+		inline void free_sockets() {}
+		// a closed viewer must not kill the renderer
+		constexpr int send_flags = MSG_NOSIGNAL;
+#endif
+
+		inline bool send_all(socket_t s, const uint8_t* bytes, size_t size)
+		{
+			while (size != 0)
+			{
+				int sent = send(s, reinterpret_cast<const char*>(bytes), static_cast<int>((std::min)(size, size_t(1) << 30)), send_flags);
+				if (sent <= 0)
+					return false;
+				bytes += sent;
+				size -= sent;
+			}
+			return true;
+		}
+
+		inline bool recv_all(socket_t s, uint8_t* bytes, size_t size)
+		{
+			while (size != 0)
+			{
+				int got = recv(s, reinterpret_cast<char*>(bytes), static_cast<int>(size), 0);
+				if (got <= 0)
+					return false;
+				bytes += got;
+				size -= got;
+			}
+			return true;
+		}
+
+		// waits up to timeout_ms for s to be readable
+		inline bool readable(socket_t s, unsigned timeout_ms)
+		{
+			fd_set set;
+			FD_ZERO(&set);
+			FD_SET(s, &set);
+			timeval t = { static_cast<long>(timeout_ms / 1000), static_cast<long>(timeout_ms % 1000 * 1000) };
+			return select(static_cast<int>(s + 1), &set, nullptr, nullptr, &t) > 0;
+		}
+
+		inline void put16(std::vector<uint8_t>& out, unsigned v)
+		{
+			out.push_back(static_cast<uint8_t>(v));
+			out.push_back(static_cast<uint8_t>(v >> 8));
+		}
+
+		inline void put32(std::vector<uint8_t>& out, unsigned v)
+		{
+			put16(out, v);
+			put16(out, v >> 16);
+		}
+
+		inline void put32_at(uint8_t* p, unsigned v)
+		{
+			for (unsigned i = 0; i < 4; i++)
+				p[i] = static_cast<uint8_t>(v >> (i * 8));
+		}
+
+		inline unsigned get32(const uint8_t* p)
+		{
+			return p[0] | p[1] << 8 | p[2] << 16 | static_cast<unsigned>(p[3]) << 24;
+		}
+
+		inline unsigned get16(const uint8_t* p)
+		{
+			return p[0] | p[1] << 8;
+		}
+
+		// appends one tile (w x h pixels, rows stride apart) with the chosen encoding, or raw when that's smaller
+		void encode_tile(const color_t* first_row, unsigned w, unsigned h, unsigned stride, uint8_t encoding, std::vector<uint8_t>& out)
+		{
+			size_t header = out.size(), raw_size = w * h * 3;
+			out.push_back(encoding);
+			out.resize(out.size() + 4);
+			size_t start = out.size();
+
+			if (encoding == erle)
+			{
+				color_t run_color = first_row[0] & 0xFFFFFF;
+				unsigned run = 0;
+
+				auto flush = [&]
+				{
+					out.insert(out.end(), { static_cast<uint8_t>(run - 1), static_cast<uint8_t>(run_color >> 16),
+						static_cast<uint8_t>(run_color >> 8), static_cast<uint8_t>(run_color) });
+				};
+
+				for (unsigned y = 0; y < h; y++)
+					for (unsigned x = 0; x < w; x++)
+					{
+						color_t c = first_row[y * stride + x] & 0xFFFFFF;
+						if (c != run_color || run == 256)
+						{
+							flush();
+							run_color = c;
+							run = 0;
+						}
+						run++;
+					}
+				flush();
+			}
+			else if (encoding == eqoi)
+				capture::encode_qoi_chunks(first_row, w, h, stride, out);
+
+			if (encoding == eraw || out.size() - start >= raw_size)
+			{
+				out.resize(start);
+				out[header] = eraw;
+				for (unsigned y = 0; y < h; y++)
+					for (unsigned x = 0; x < w; x++)
+					{
+						color_t c = first_row[y * stride + x];
+						out.insert(out.end(), { static_cast<uint8_t>(c >> 16), static_cast<uint8_t>(c >> 8), static_cast<uint8_t>(c) });
+					}
+			}
+
+			put32_at(out.data() + header + 1, static_cast<unsigned>(out.size() - start));
+		}
+
+		// one encoded tile into the w x h block at first_row of a frame, false on bad data
+		bool decode_tile(const uint8_t* bytes, size_t size, uint8_t encoding, color_t* first_row, unsigned w, unsigned h, unsigned stride)
+		{
+			color_t block[tile_size * tile_size];
+			unsigned amount = w * h;
+
+			if (encoding == eqoi)
+			{
+				if (capture::decode_qoi_chunks(bytes, size, amount, block) == false)
+					return false;
+			}
+			else if (encoding == erle)
+			{
+				unsigned i = 0;
+				for (size_t p = 0; p + 4 <= size && i < amount; p += 4)
+					for (unsigned run = bytes[p] + 1; run != 0 && i < amount; run--)
+						block[i++] = colors::alpha | bytes[p + 1] << 16 | bytes[p + 2] << 8 | bytes[p + 3];
+				if (i != amount)
+					return false;
+			}
+			else
+			{
+				if (size != amount * 3)
+					return false;
+				for (unsigned i = 0; i < amount; i++)
+					block[i] = colors::alpha | bytes[i * 3] << 16 | bytes[i * 3 + 1] << 8 | bytes[i * 3 + 2];
+			}
+
+			for (unsigned y = 0; y < h; y++)
+				memcpy(first_row + y * stride, block + y * w, w << 2);
+			return true;
+		}
+
+		struct counters
+		{
+			unsigned long long frames_submitted, frames_sent, frames_dropped, tiles_sent, bytes_sent;
+			// last second
+			double bytes_per_second, frames_per_second;
+			// encode time of the last frame, submit -> ack of the last acknowledged frame & its average
+			double encode_ms, latency_ms, average_latency_ms;
+			bool client_connected;
+		};
+
+		inline double now_ms()
+		{
+			return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+		}
+
+		// serves the latest submitted frame to one viewer at a time, a new viewer replaces the old one,
+		// the encoder thread sends only the tiles that changed since the last sent frame,
+		// frames submitted while it's busy replace each other (counted as dropped)
+		class server
+		{
+		public:
+			upoint dim;
+			uint8_t encoding;
+
+		private:
+			socket_t listener, client;
+			std::thread accept_thread, encode_thread, ack_thread;
+			std::mutex mutex;
+			std::condition_variable frame_cv, sent_cv;
+			std::atomic<bool> stopping;
+
+			// pending: latest submitted frame, sent: what the viewer has
+			std::vector<color_t> pending, current, sent;
+			bool has_pending, full_refresh;
+			unsigned pending_frame;
+			double pending_time;
+
+			counters c;
+			double window_start, window_bytes, window_frames, latency_sum;
+			unsigned long long acks;
+			// submit times of the frames in flight, by frame index
+			double submit_times[64];
+			unsigned frame_index;
+
+			void accept_loop()
+			{
+				while (stopping == false)
+				{
+					if (readable(listener, 100) == false)
+						continue;
+
+					socket_t s = accept(listener, nullptr, nullptr);
+					if (s == invalid_socket)
+						continue;
+
+					int one = 1;
+					setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&one), sizeof(one));
+
+					std::vector<uint8_t> hello = { 'E', 'B', 'G', 'S' };
+					put32(hello, version);
+					put32(hello, dim.x);
+					put32(hello, dim.y);
+					put32(hello, tile_size);
+
+					if (send_all(s, hello.data(), hello.size()) == false)
+					{
+						close_socket(s);
+						continue;
+					}
+
+					std::lock_guard<std::mutex> lock(mutex);
+					if (client != invalid_socket)
+						close_socket(client);
+					client = s;
+					full_refresh = true;
+					c.client_connected = true;
+					// a new viewer gets the last frame at once (pending keeps it)
+					if (frame_index != 0)
+					{
+						has_pending = true;
+						pending_time = now_ms();
+					}
+					frame_cv.notify_one();
+				}
+			}
+
+			// s unless a new viewer replaced it already
+			void drop_client(socket_t s)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (client == s && s != invalid_socket)
+				{
+					close_socket(client);
+					client = invalid_socket;
+					c.client_connected = false;
+					sent_cv.notify_all();
+				}
+			}
+
+			// reads the acks that arrived, false when the viewer is gone
+			bool read_acks(socket_t s)
+			{
+				while (readable(s, 0))
+				{
+					uint8_t ack[8];
+					if (recv_all(s, ack, 8) == false || memcmp(ack, "ACK ", 4) != 0)
+						return false;
+
+					unsigned frame = get32(ack + 4);
+					double arrived = now_ms();
+
+					std::lock_guard<std::mutex> lock(mutex);
+					double latency = arrived - submit_times[frame & 63];
+					acks++;
+					latency_sum += latency;
+					c.latency_ms = latency;
+					c.average_latency_ms = latency_sum / static_cast<double>(acks);
+				}
+				return true;
+			}
+
+			// acks as soon as they arrive, apart from the sends (the latency isn't held up by the encoder)
+			void ack_loop()
+			{
+				while (stopping == false)
+				{
+					socket_t s;
+					{
+						std::lock_guard<std::mutex> lock(mutex);
+						s = client;
+					}
+
+					if (s == invalid_socket)
+					{
+						std::this_thread::sleep_for(std::chrono::milliseconds(10));
+						continue;
+					}
+
+					if (readable(s, 10) && read_acks(s) == false)
+						drop_client(s);
+				}
+			}
+
+			void encode_loop()
+			{
+				std::vector<uint8_t> message;
+				unsigned tiles_x = (dim.x + tile_size - 1) / tile_size, tiles_y = (dim.y + tile_size - 1) / tile_size;
+
+				while (true)
+				{
+					socket_t s;
+					bool full;
+					unsigned frame;
+					{
+						std::unique_lock<std::mutex> lock(mutex);
+						frame_cv.wait(lock, [&] { return stopping || (has_pending && client != invalid_socket); });
+
+						if (stopping)
+							return;
+
+						s = client;
+
+						// pending stays a full frame for a viewer connecting later
+						memcpy(current.data(), pending.data(), current.size() << 2);
+						has_pending = false;
+						full = full_refresh;
+						full_refresh = false;
+						frame = pending_frame;
+						submit_times[frame & 63] = pending_time;
+					}
+
+					double start = now_ms();
+
+					message.assign({ 'F', 'R', 'M', 'E' });
+					put32(message, frame);
+					message.resize(16);
+					unsigned tiles = 0;
+
+					for (unsigned ty = 0; ty < tiles_y; ty++)
+						for (unsigned tx = 0; tx < tiles_x; tx++)
+						{
+							unsigned x0 = tx * tile_size, y0 = ty * tile_size,
+								w = (std::min)(tile_size, dim.x - x0), h = (std::min)(tile_size, dim.y - y0);
+							const color_t* now = current.data() + y0 * dim.x + x0, * before = sent.data() + y0 * dim.x + x0;
+
+							bool changed = full;
+							for (unsigned y = 0; y < h && changed == false; y++)
+								changed = memcmp(now + y * dim.x, before + y * dim.x, w << 2) != 0;
+
+							if (changed == false)
+								continue;
+
+							put16(message, tx);
+							put16(message, ty);
+							encode_tile(now, w, h, dim.x, encoding, message);
+							tiles++;
+
+							for (unsigned y = 0; y < h; y++)
+								memcpy(sent.data() + (y0 + y) * dim.x + x0, now + y * dim.x, w << 2);
+						}
+
+					put32_at(message.data() + 8, tiles);
+					put32_at(message.data() + 12, static_cast<unsigned>(message.size() - 16));
+
+					double encoded = now_ms();
+					bool ok = send_all(s, message.data(), message.size());
+
+					if (ok == false)
+						drop_client(s);
+
+					std::lock_guard<std::mutex> lock(mutex);
+					sent_cv.notify_all();
+					c.encode_ms = encoded - start;
+					if (ok)
+					{
+						c.frames_sent++;
+						c.tiles_sent += tiles;
+						c.bytes_sent += message.size();
+						window_bytes += static_cast<double>(message.size());
+						window_frames++;
+					}
+
+					if (encoded - window_start >= 1000.0)
+					{
+						c.bytes_per_second = window_bytes * 1000.0 / (encoded - window_start);
+						c.frames_per_second = window_frames * 1000.0 / (encoded - window_start);
+						window_start = encoded;
+						window_bytes = window_frames = 0.0;
+					}
+				}
+			}
+
+		public:
+			// listens on port (127.0.0.1 unless any_address), encoding: erle or eqoi
+			server(upoint dim, uint16_t port, uint8_t encoding = eqoi, bool any_address = false)
+				: dim(dim), encoding(encoding), listener(invalid_socket), client(invalid_socket), stopping(false),
+				has_pending(false), full_refresh(true), pending_frame(0), pending_time(0.0),
+				window_bytes(0.0), window_frames(0.0), latency_sum(0.0), acks(0), frame_index(0)
+			{
+				memset(&c, 0, sizeof(c));
+				memset(submit_times, 0, sizeof(submit_times));
+				window_start = now_ms();
+
+				pending.resize(dim.x * dim.y);
+				current.resize(dim.x * dim.y);
+				sent.resize(dim.x * dim.y);
+
+				if (init_sockets() == false)
+					return;
+
+				listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+				if (listener == invalid_socket)
+					return;
+
+				int one = 1;
+				setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&one), sizeof(one));
+
+				sockaddr_in address = {};
+				address.sin_family = AF_INET;
+				address.sin_port = htons(port);
+				address.sin_addr.s_addr = htonl(any_address ? INADDR_ANY : INADDR_LOOPBACK);
+
+				if (bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listener, 1) != 0)
+				{
+					close_socket(listener);
+					listener = invalid_socket;
+					return;
+				}
+
+				accept_thread = std::thread(&server::accept_loop, this);
+				encode_thread = std::thread(&server::encode_loop, this);
+				ack_thread = std::thread(&server::ack_loop, this);
+			}
+
+			~server()
+			{
+				stop();
+			}
+
+			inline bool listening() const
+			{
+				return listener != invalid_socket;
+			}
+
+			void stop()
+			{
+				if (listener == invalid_socket)
+					return;
+
+				{
+					std::lock_guard<std::mutex> lock(mutex);
+					stopping = true;
+				}
+				frame_cv.notify_one();
+				accept_thread.join();
+				encode_thread.join();
+				ack_thread.join();
+
+				drop_client(client);
+				close_socket(listener);
+				listener = invalid_socket;
+				free_sockets();
+			}
+
+			// row-major colors (dim.x * dim.y), y = 0 at the bottom, never waits for the network
+			void submit(const color_t* colors)
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+
+				c.frames_submitted++;
+				// without a viewer the frame is only kept for the next one
+				if (has_pending && client != invalid_socket)
+					c.frames_dropped++;
+
+				memcpy(pending.data(), colors, pending.size() << 2);
+				pending_frame = frame_index++;
+				pending_time = now_ms();
+				has_pending = true;
+				frame_cv.notify_one();
+			}
+
+			// waits until the latest frame went out (or timeout_ms passed), false on timeout
+			bool drain(unsigned timeout_ms)
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				return sent_cv.wait_for(lock, std::chrono::milliseconds(timeout_ms), [&] { return has_pending == false || client == invalid_socket; });
+			}
+
+			counters stats()
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				return c;
+			}
+		};
+
+		// basic_engine frame sink, data: the server, frames of another size than the server's are rejected
+		inline void sink(void* data, const color_t* colors, upoint dim)
+		{
+			server* s = static_cast<server*>(data);
+			assert(dim == s->dim);
+			if (dim == s->dim)
+				s->submit(colors);
+		}
+	}
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "EBG_basics.h"
+
+#include <emmintrin.h>
+#include <vector>
+
+/*
+Mipmapped textures in 4x4 texel blocks
+
+every level is stored as blocks of 4x4 texels (64 bytes, one cache line each), blocks row-major,
+texels row-major inside, so a bilinear footprint touches 1 to 4 lines and the next row of a span mostly the same ones
+levels go down to 1x1 by 2x2 box filter, dimensions are powers of two & coordinates wrap (repeat)
+*/
+
+namespace ebg
+{
+	namespace graphics
+	{
+		enum texture_filters { fnearest, fbilinear };
+
+		constexpr unsigned max_texture_levels = 16;
+
+		struct texture
+		{
+			upoint dim;
+			unsigned levels;
+			uint8_t filter;
+			// blocks of every level, cache line aligned, level l from level_offsets[l]
+			color_t* texels;
+			unsigned level_offsets[max_texture_levels];
+			void* allocation;
+		};
+
+		// one level ready to sample
+		struct texture_sampler
+		{
+			const color_t* texels;
+			// width & height of the level
+			__m128 size;
+			unsigned x_mask, y_mask, row_shift;
+			uint8_t filter;
+		};
+
+		// width of a level padded to whole blocks
+		inline unsigned padded_dim(unsigned d)
+		{
+			return (std::max)(d, 4U);
+		}
+
+		// offset of texel x, y (wrapped) in a level of the width row_shift was made from
+		inline unsigned texel_offset(unsigned x, unsigned y, unsigned x_mask, unsigned y_mask, unsigned row_shift)
+		{
+			x &= x_mask;
+			y &= y_mask;
+			return ((y >> 2) << row_shift) + ((x >> 2) << 4) + ((y & 3) << 2) + (x & 3);
+		}
+
+		// the texture & its mip chain from dim (powers of two) row-major pixels, mipmaps false: level 0 only
+		texture create_texture(const color_t* pixels, upoint dim, uint8_t filter = fbilinear, bool mipmaps = true)
+		{
+			assert(std::has_single_bit(dim.x) && std::has_single_bit(dim.y));
+
+			texture t;
+			t.dim = dim;
+			t.filter = filter;
+			t.levels = mipmaps ? std::bit_width((std::max)(dim.x, dim.y)) : 1;
+			assert(t.levels <= max_texture_levels);
+
+			unsigned total = 0;
+			for (unsigned l = 0; l < t.levels; l++)
+			{
+				t.level_offsets[l] = total;
+				total += padded_dim((std::max)(dim.x >> l, 1U)) * padded_dim((std::max)(dim.y >> l, 1U));
+			}
+
+			// 15 more for the 64 byte alignment
+			t.allocation = TYPE_MALLOC(color_t, total + 15);
+			assert(t.allocation != nullptr);
+			t.texels = reinterpret_cast<color_t*>((reinterpret_cast<uintptr_t>(t.allocation) + 63) & ~uintptr_t(63));
+			memset(t.texels, 0, total * sizeof(color_t));
+
+			std::vector<color_t> level(pixels, pixels + dim.x * dim.y), next;
+			upoint d = dim;
+
+			for (unsigned l = 0; l < t.levels; l++)
+			{
+				unsigned row_shift = std::bit_width(padded_dim(d.x)) + 1;
+				color_t* blocks = t.texels + t.level_offsets[l];
+
+				for (unsigned y = 0; y < d.y; y++)
+					for (unsigned x = 0; x < d.x; x++)
+						blocks[texel_offset(x, y, d.x - 1, d.y - 1, row_shift)] = level[y * d.x + x];
+
+				if (l + 1 == t.levels)
+					break;
+
+				// 2x2 box filter, a side of 1 averages the same texels twice
+				upoint h((std::max)(d.x >> 1, 1U), (std::max)(d.y >> 1, 1U));
+				next.resize(h.x * h.y);
+
+				for (unsigned y = 0; y < h.y; y++)
+					for (unsigned x = 0; x < h.x; x++)
+					{
+						unsigned x0 = (std::min)(x << 1, d.x - 1), x1 = (std::min)((x << 1) + 1, d.x - 1),
+							y0 = (std::min)(y << 1, d.y - 1), y1 = (std::min)((y << 1) + 1, d.y - 1);
+						color_t c[4] = { level[y0 * d.x + x0], level[y0 * d.x + x1], level[y1 * d.x + x0], level[y1 * d.x + x1] };
+
+						color_t average = 0;
+						for (unsigned shift = 0; shift < 32; shift += 8)
+						{
+							unsigned sum = 2;
+							for (color_t k : c)
+								sum += (k >> shift) & 0xFF;
+							average |= (sum >> 2) << shift;
+						}
+						next[y * h.x + x] = average;
+					}
+
+				level.swap(next);
+				d = h;
+			}
+
+			return t;
+		}
+
+		void delete_texture(texture* t)
+		{
+			free(t->allocation);
+			t->allocation = nullptr;
+			t->texels = nullptr;
+			t->levels = 0;
+		}
+
+		inline texture_sampler sampler_of(const texture* t, unsigned level)
+		{
+			unsigned w = (std::max)(t->dim.x >> level, 1U), h = (std::max)(t->dim.y >> level, 1U);
+			return {
+				t->texels + t->level_offsets[level],
+				_mm_setr_ps(float(w), float(h), 0.0f, 0.0f),
+				w - 1, h - 1,
+				static_cast<unsigned>(std::bit_width(padded_dim(w))) + 1,
+				t->filter
+			};
+		}
+
+		/*
+		mip level of the texel footprint of a pixel, stq: (u/w, v/w, 1/w) there, dx & dy: their change per pixel
+		along x & y (constant over a triangle, linear in screen space)
+		d(u) = (d(s) - u * d(q)) / q, the level is round(log2) of the longer footprint side in level 0 texels
+		*/
+		inline unsigned texture_level(const texture* t, __m128 stq, __m128 dx, __m128 dy)
+		{
+			if (t->levels == 1)
+				return 0;
+
+			// only the exponent of the result is used, the approximate reciprocal does
+			__m128 rq = _mm_rcp_ps(_mm_shuffle_ps(stq, stq, _MM_SHUFFLE(2, 2, 2, 2)));
+			__m128 uv = _mm_mul_ps(stq, rq);
+			__m128 scale = _mm_mul_ps(_mm_setr_ps(float(t->dim.x), float(t->dim.y), 0.0f, 0.0f), rq);
+
+			__m128 gx = _mm_mul_ps(_mm_sub_ps(dx, _mm_mul_ps(uv, _mm_shuffle_ps(dx, dx, _MM_SHUFFLE(2, 2, 2, 2)))), scale);
+			__m128 gy = _mm_mul_ps(_mm_sub_ps(dy, _mm_mul_ps(uv, _mm_shuffle_ps(dy, dy, _MM_SHUFFLE(2, 2, 2, 2)))), scale);
+			gx = _mm_mul_ps(gx, gx);
+			gy = _mm_mul_ps(gy, gy);
+
+			// squared footprint sides in lane 0
+			__m128 side = _mm_max_ss(_mm_add_ss(gx, _mm_shuffle_ps(gx, gx, _MM_SHUFFLE(1, 1, 1, 1))),
+				_mm_add_ss(gy, _mm_shuffle_ps(gy, gy, _MM_SHUFFLE(1, 1, 1, 1))));
+
+			// log2 of the side^2 from its exponent, (e + 1) / 2 rounds log2 of the side
+			int e = static_cast<int>(std::bit_cast<uint32_t>(_mm_cvtss_f32(side)) >> 23) - 127;
+			if (e <= 0)
+				return 0;
+			return (std::min)((static_cast<unsigned>(e) + 1) >> 1, t->levels - 1);
+		}
+
+		// largest whole numbers not above the lanes
+		inline __m128 floor_ps(__m128 v)
+		{
+			__m128 t = _mm_cvtepi32_ps(_mm_cvttps_epi32(v));
+			return _mm_sub_ps(t, _mm_and_ps(_mm_cmpgt_ps(t, v), _mm_set1_ps(1.0f)));
+		}
+
+		inline color_t sample_nearest(const texture_sampler& s, __m128 uv)
+		{
+			__m128i xy = _mm_cvttps_epi32(floor_ps(_mm_mul_ps(uv, s.size)));
+			return s.texels[texel_offset(_mm_cvtsi128_si32(xy), _mm_cvtsi128_si32(_mm_srli_si128(xy, 4)), s.x_mask, s.y_mask, s.row_shift)];
+		}
+
+		// 4 texels around uv, weights of 8 bit fractions, the channels of 2 texels in 16 bit lanes a time
+		inline color_t sample_bilinear(const texture_sampler& s, __m128 uv)
+		{
+			__m128 p = _mm_sub_ps(_mm_mul_ps(uv, s.size), _mm_set1_ps(0.5f)), f = floor_ps(p);
+			__m128i xy = _mm_cvttps_epi32(f), w = _mm_cvttps_epi32(_mm_mul_ps(_mm_sub_ps(p, f), _mm_set1_ps(256.0f)));
+
+			// texel_offset of (x, y), (x + 1, y), (x, y + 1) & (x + 1, y + 1) in the lanes
+			__m128i xs = _mm_and_si128(_mm_add_epi32(_mm_shuffle_epi32(xy, _MM_SHUFFLE(0, 0, 0, 0)), _mm_setr_epi32(0, 1, 0, 1)),
+				_mm_set1_epi32(static_cast<int>(s.x_mask)));
+			__m128i ys = _mm_and_si128(_mm_add_epi32(_mm_shuffle_epi32(xy, _MM_SHUFFLE(1, 1, 1, 1)), _mm_setr_epi32(0, 0, 1, 1)),
+				_mm_set1_epi32(static_cast<int>(s.y_mask)));
+			__m128i three = _mm_set1_epi32(3);
+			__m128i offsets = _mm_add_epi32(
+				_mm_add_epi32(_mm_sll_epi32(_mm_srli_epi32(ys, 2), _mm_cvtsi32_si128(static_cast<int>(s.row_shift))), _mm_slli_epi32(_mm_srli_epi32(xs, 2), 4)),
+				_mm_add_epi32(_mm_slli_epi32(_mm_and_si128(ys, three), 2), _mm_and_si128(xs, three)));
+
+			__m128i texels = _mm_setr_epi32(
+				s.texels[_mm_cvtsi128_si32(offsets)],
+				s.texels[_mm_cvtsi128_si32(_mm_srli_si128(offsets, 4))],
+				s.texels[_mm_cvtsi128_si32(_mm_srli_si128(offsets, 8))],
+				s.texels[_mm_cvtsi128_si32(_mm_srli_si128(offsets, 12))]);
+
+			// 16 bit lanes of 256 - fy & fy, then of 256 - fx (left) & fx (right)
+			__m128i full = _mm_set1_epi32(256);
+			__m128i wy = _mm_shuffle_epi32(w, _MM_SHUFFLE(1, 1, 1, 1)), wx = _mm_shuffle_epi32(w, _MM_SHUFFLE(0, 0, 0, 0));
+			__m128i vertical = _mm_packs_epi32(_mm_sub_epi32(full, wy), wy), horizontal = _mm_packs_epi32(_mm_sub_epi32(full, wx), wx);
+
+			__m128i zero = _mm_setzero_si128();
+			// rows y & y + 1 blended: left & right texel of the row in the lanes
+			__m128i top = _mm_unpacklo_epi8(texels, zero), bottom = _mm_unpackhi_epi8(texels, zero);
+			__m128i column = _mm_srli_epi16(_mm_add_epi16(
+				_mm_mullo_epi16(top, _mm_unpacklo_epi64(vertical, vertical)),
+				_mm_mullo_epi16(bottom, _mm_unpackhi_epi64(vertical, vertical))), 8);
+
+			__m128i row = _mm_mullo_epi16(column, horizontal);
+			row = _mm_srli_epi16(_mm_add_epi16(row, _mm_srli_si128(row, 8)), 8);
+
+			return static_cast<color_t>(_mm_cvtsi128_si32(_mm_packus_epi16(row, row)));
+		}
+
+		inline color_t sample(const texture_sampler& s, __m128 uv)
+		{
+			return s.filter == fbilinear ? sample_bilinear(s, uv) : sample_nearest(s, uv);
+		}
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <vector>
+
+namespace ebg
+{
+	// persistent workers, run(job) calls job(i) for every i in [0, amount) and waits for all,
+	// index 0 runs on the calling thread
+	class thread_pool
+	{
+	public:
+		unsigned amount;
+
+	private:
+		std::vector<std::thread> workers;
+		std::mutex mutex;
+		std::condition_variable start_cv, done_cv;
+		std::function<void(unsigned)> job;
+		unsigned generation, remaining;
+		bool stopping;
+
+		void work(unsigned index)
+		{
+			unsigned seen = 0;
+
+			while (true)
+			{
+				{
+					std::unique_lock<std::mutex> lock(mutex);
+					start_cv.wait(lock, [&] { return stopping || generation != seen; });
+
+					if (stopping)
+						return;
+					seen = generation;
+				}
+
+				job(index);
+
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--remaining == 0)
+					done_cv.notify_one();
+			}
+		}
+
+	public:
+		thread_pool(unsigned amount) : amount(amount == 0 ? 1 : amount), generation(0), remaining(0), stopping(false)
+		{
+			for (unsigned i = 1; i < this->amount; i++)
+				workers.emplace_back(&thread_pool::work, this, i);
+		}
+
+		~thread_pool()
+		{
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				stopping = true;
+			}
+			start_cv.notify_all();
+
+			for (std::thread& t : workers)
+				t.join();
+		}
+
+		void run(std::function<void(unsigned)> j)
+		{
+			if (amount == 1)
+				return j(0);
+
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				job = std::move(j);
+				remaining = amount - 1;
+				generation++;
+			}
+			start_cv.notify_all();
+
+			job(0);
+
+			std::unique_lock<std::mutex> lock(mutex);
+			done_cv.wait(lock, [&] { return remaining == 0; });
+		}
+	};
+}
@@ -0,0 +1,312 @@
+#pragma once
+
+#include "EBG_3d.h"
+
+/*
+Visibility buffer: a deferred frame that shades every pixel once, whatever the overdraw
+
+pass 1 rasterises only depth & an id per pixel, (mesh + 1) << 16 | triangle (| clipped_half_id for the second
+triangle of a near clip), with the flat raster (camera::draw_triangle with an id) into the bands of draw_bands
+pass 2 shades the rows in bands: every run of one id on a row gets its triangle looked up & set up once,
+the way the forward raster walks it (clip_near, raster::setup), & its span on the row once (raster::row),
+then its pixels are shaded with the attributes the forward raster stepped to them, background pixels cleared
+frames are the same as forward ones in every shading mode
+the lighting is the mesh's (update_colors)
+ids keep the triangle in 16 bits & the mesh in the 15 above it (below clipped_half_id): 16 bit compound_meshes only
+(split larger ones, split_mesh), fewer than 0x7FFF of them a frame
+*/
+
+namespace eb3d
+{
+	class visibility_buffer
+	{
+	private:
+		// the pixel shading & offsets of the forward raster
+		template <uint8_t shade_mode, uint8_t layout = graphics::draw::lrow>
+		using shader = graphics::draw::raster<graphics::draw::ztest, shade_mode, graphics::draw::bopaque, layout>;
+
+		// a triangle ready to shade: the forward raster's walk of it & of its span on the last row shaded,
+		// the span's ends, start & step per pixel, its sampler & the pixel x reached with its attributes a
+		struct triangle_setup
+		{
+			uint32_t id;
+			uint8_t shading;
+			color_t color;
+			const graphics::texture* tex;
+			graphics::draw::raster_walk<graphics::draw::hgouraud> walk;
+			int row;
+			unsigned xs, xb, x;
+			__m128 a1, a2, step, a;
+			graphics::texture_sampler sampler;
+		};
+
+		// setups of the last ids by id, rows of a triangle mostly hit
+		static constexpr unsigned setup_cache_size = 256;
+		static_assert(compound_mesh::index_limit <= 0x10000, "ids keep the triangle index in 16 bits");
+
+		// ids in the layout of the engine's surface, 0: background
+		uint32_t* ids;
+		unsigned capacity;
+		// setup_cache_size setups for every thread of the pool, kept from frame to frame
+		std::vector<triangle_setup> caches;
+
+		compound_mesh** meshes;
+
+		// the raster vertices of draw_triangle: clipped, projected & walked the same
+		template <uint8_t shade_mode>
+		static void setup_walk(triangle_setup& s, const compound_mesh* mesh, triangle tri, bool second_half, const camera* cam, basic_engine* engine)
+		{
+			vertex_t vertices[4] = { mesh->world_vertices[tri.a], mesh->world_vertices[tri.b], mesh->world_vertices[tri.c] };
+			fvec3 attributes[4];
+			index16_t corners[3] = { tri.a, tri.b, tri.c };
+
+			for (unsigned i = 0; i < 3; i++)
+				if constexpr (shade_mode == graphics::draw::hgouraud)
+					attributes[i] = color_attributes(mesh->vertex_colors[corners[i]]);
+				else
+					attributes[i] = uv_attributes(mesh->uvs[corners[i]]);
+
+			char iI = 0, t = 0;
+			clip_near(vertices, attributes, cam->near, iI, t);
+
+			char k[3] = { 0, 1, 2 };
+			if (second_half)
+				k[0] = 3, k[1] = iI, k[2] = t;
+
+			auto vertex = [&](char i) { return shaded_vertex<shade_mode>(mapto_engine(cam->persf(vertices[i]), engine), vertices[i].z, attributes[i]); };
+			s.walk = shader<shade_mode>::setup(vertex(k[0]), vertex(k[1]), vertex(k[2]));
+		}
+
+		static triangle_setup setup(uint32_t id, compound_mesh** meshes, const camera* cam, basic_engine* engine)
+		{
+			const compound_mesh* mesh = meshes[((id & ~clipped_half_id) >> 16) - 1];
+			index16_t index = static_cast<index16_t>(id & 0xFFFF);
+
+			triangle_setup s;
+			s.id = id;
+			s.shading = mesh->shading;
+			s.color = s.shading != graphics::draw::hgouraud ? mesh->triangle_colors[index] : 0;
+			s.tex = mesh->texture;
+			s.row = -1;
+
+			if (s.shading == graphics::draw::hgouraud)
+				setup_walk<graphics::draw::hgouraud>(s, mesh, mesh->triangles[index], (id & clipped_half_id) != 0, cam, engine);
+			else if (s.shading == graphics::draw::htextured)
+				setup_walk<graphics::draw::htextured>(s, mesh, mesh->triangles[index], (id & clipped_half_id) != 0, cam, engine);
+
+			return s;
+		}
+
+		// the span of row y as raster::span gets it: a step from its ends & xs - xb, the sampler from those
+		template <uint8_t shade_mode>
+		static inline void begin_row(triangle_setup& s, int y, int right)
+		{
+			typedef shader<shade_mode> raster;
+			const graphics::draw::raster_walk<graphics::draw::hgouraud>& w = s.walk;
+
+			float z1, z2;
+			raster::row(w.halves[y < w.y[1] ? 0 : 1], y, right, s.xs, s.xb, z1, z2, s.a1, s.a2);
+			s.step = raster::slopes(s.a1, s.a2, float(s.xb - s.xs));
+			if constexpr (shade_mode == graphics::draw::htextured)
+			{
+				graphics::draw::raster_target target = { nullptr, nullptr, s.color, s.tex };
+				s.sampler = raster::begin_span(target, s.a1, s.step, w.dy, float(s.xb - s.xs));
+			}
+
+			s.row = y;
+			s.x = s.xs;
+			s.a = raster::along(s.a1, s.step, 0.0f);
+		}
+
+		/*
+		pixels x to end - 1 of row y (px: the row, x_offsets: the surface's) with raster::run's attributes:
+		from the span start stepped per pixel, the span end pixel xb its own (a single pixel span a1)
+		*/
+		template <uint8_t shade_mode, uint8_t layout>
+		static void shade_run(triangle_setup& s, unsigned x, unsigned end, unsigned y, int right, const unsigned* x_offsets, color_t* px)
+		{
+			typedef shader<shade_mode, layout> raster;
+
+			if (s.row != int(y))
+				begin_row<shade_mode>(s, int(y), right);
+
+			typename raster::sampler sampler = {};
+			if constexpr (shade_mode == graphics::draw::htextured)
+				sampler = s.sampler;
+
+			// runs of a row come left to right, anything else starts the span over
+			if (x < s.x)
+			{
+				s.x = s.xs;
+				s.a = raster::along(s.a1, s.step, 0.0f);
+			}
+
+			// locals, the pixel stores could alias the setup
+			unsigned at = s.x, xs = s.xs, xb = s.xb;
+			color_t color = s.color;
+			__m128 a = s.a, step = s.step;
+
+			for (; x < end; x++)
+			{
+				if (x == xb)
+				{
+					px[raster::offset(x, x_offsets)] = raster::shade(color, xs == xb ? s.a1 : s.a2, sampler);
+					continue;
+				}
+
+				for (; at < x; at++)
+					raster::step(a, step);
+				px[raster::offset(x, x_offsets)] = raster::shade(color, a, sampler);
+			}
+
+			s.x = at;
+			s.a = a;
+		}
+
+		// first pixel from x on of a row (ids: its ids) without id, or width
+		template <uint8_t layout>
+		static inline unsigned run_end(const uint32_t* ids, uint32_t id, unsigned x, unsigned width, const unsigned* x_offsets)
+		{
+			if constexpr (layout == graphics::draw::lrow)
+			{
+				// 4 ids a compare
+				__m128i v = _mm_set1_epi32(static_cast<int>(id));
+				for (; x + 4 <= width; x += 4)
+				{
+					unsigned same = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmpeq_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ids + x)), v)));
+					if (same != 0b1111)
+						return x + std::countr_one(same);
+				}
+			}
+
+			for (; x < width && ids[shader<graphics::draw::hflat, layout>::offset(x, x_offsets)] == id; x++);
+			return x;
+		}
+
+		template <uint8_t layout>
+		void shade_rows(const camera* cam, basic_engine* engine, triangle_setup* cache, color_t clear_color, unsigned row_begin, unsigned row_end) const
+		{
+			const graphics::surface& surf = engine->surface;
+			const unsigned* x_offsets = surf.x_offsets;
+			auto at = [x_offsets](unsigned x) { return shader<graphics::draw::hflat, layout>::offset(x, x_offsets); };
+			int right = int(surf.dim.x) - 1;
+
+			// the setups of the last frame are stale, ids are never 0 in the cache
+			for (unsigned i = 0; i < setup_cache_size; i++)
+				cache[i].id = 0;
+			triangle_setup* s = cache;
+
+			for (unsigned y = row_begin; y < row_end; y++)
+			{
+				unsigned row = shader<graphics::draw::hflat, layout>::row_offset(y, &surf);
+				const uint32_t* id_row = ids + row;
+				color_t* px = surf.buffer + row;
+
+				for (unsigned x = 0, end; x < surf.dim.x; x = end)
+				{
+					uint32_t id = id_row[at(x)];
+					end = run_end<layout>(id_row, id, x + 1, surf.dim.x, x_offsets);
+
+					if (id == 0)
+					{
+						for (unsigned i = x; i < end; i++)
+							px[at(i)] = clear_color;
+						continue;
+					}
+
+					if (s->id != id)
+					{
+						s = &cache[(id ^ (id >> 16) * 97) & (setup_cache_size - 1)];
+						if (s->id != id)
+							*s = setup(id, meshes, cam, engine);
+					}
+
+					if (s->shading == graphics::draw::hgouraud)
+						shade_run<graphics::draw::hgouraud, layout>(*s, x, end, y, right, x_offsets, px);
+					else if (s->shading == graphics::draw::htextured)
+						shade_run<graphics::draw::htextured, layout>(*s, x, end, y, right, x_offsets, px);
+					else
+						for (unsigned i = x; i < end; i++)
+							px[at(i)] = s->color;
+				}
+			}
+		}
+
+	public:
+		visibility_buffer() : ids(nullptr), capacity(0), meshes(nullptr) {}
+
+		visibility_buffer(const visibility_buffer&) = delete;
+
+		~visibility_buffer()
+		{
+			free(ids);
+		}
+
+		// replaces the clear & draw_parallel of a frame, the surface needs no clear (pass 2 writes every pixel,
+		// clear_color where nothing was drawn)
+		void draw(compound_mesh** meshes, const uint8_t* update_types, unsigned mesh_amount, camera* cam, basic_engine* engine, thread_pool* pool,
+			color_t clear_color = 0)
+		{
+			graphics::surface& surf = engine->surface;
+			assert(engine->depth_buffer != nullptr && surf.repaint == nullptr && mesh_amount < 0x7FFF);
+
+			this->meshes = meshes;
+
+			// grows to the largest buffer_size seen (dynamic resolution)
+			if (surf.buffer_size > capacity)
+			{
+				free(ids);
+				capacity = surf.buffer_size;
+				ids = TYPE_MALLOC(uint32_t, capacity);
+				assert(ids != nullptr);
+			}
+
+			{
+				EBG_PROFILE_SCOPE(sclear);
+
+				memset(ids, 0, surf.buffer_size << 2);
+				memset(engine->depth_buffer, 0b01111111, surf.buffer_size << 2);
+			}
+
+			update_parallel(meshes, update_types, mesh_amount, cam, pool);
+
+			unsigned threads = pool->amount;
+			// bands are whole 8 row blocks as in draw_bands
+			unsigned blocks = (surf.dim.y + 7) >> 3;
+			if (caches.size() < threads * setup_cache_size)
+				caches.resize(threads * setup_cache_size);
+
+			pool->run([&](unsigned index)
+			{
+				basic_engine band = *engine;
+				band.surface.buffer = ids;
+				band.surface.end = ids + surf.buffer_size;
+				band.surface.row_begin = min((blocks * index / threads) << 3, surf.dim.y);
+				band.surface.row_end = min((blocks * (index + 1) / threads) << 3, surf.dim.y);
+
+				for (unsigned m = 0; m < mesh_amount; m++)
+				{
+					compound_mesh* mesh = meshes[m];
+					EBG_STATS_BAND_ADD(band.surface, triangles_submitted, mesh->triangle_amount - mesh->visible_amount);
+					EBG_STATS_BAND_ADD(band.surface, backface_rejected, mesh->triangle_amount - mesh->visible_amount);
+
+					for (unsigned i = 0; i < mesh->visible_amount; i++)
+						cam->draw_triangle(mesh, mesh->visible[i], &band, (m + 1) << 16 | mesh->visible[i]);
+					EBG_PROFILE_FLUSH();
+				}
+			});
+
+			pool->run([&](unsigned index)
+			{
+				EBG_PROFILE_SCOPE(sshade);
+
+				unsigned row_begin = min((blocks * index / threads) << 3, surf.dim.y), row_end = min((blocks * (index + 1) / threads) << 3, surf.dim.y);
+				triangle_setup* cache = caches.data() + index * setup_cache_size;
+				if (surf.x_offsets != nullptr)
+					shade_rows<graphics::draw::ltiled>(cam, engine, cache, clear_color, row_begin, row_end);
+				else
+					shade_rows<graphics::draw::lrow>(cam, engine, cache, clear_color, row_begin, row_end);
+			});
+		}
+	};
+}
@@ -0,0 +1,402 @@
+#include "EBG_scenes.h"
+
+#include <string>
+#include <sstream>
+#include <iomanip>
+
+/*
+Headless benchmark over the bundled meshes
+
+benchmark [options]
+	--frames N          measured frames per run (default 120)
+	--warmup N          unmeasured frames before (default 10)
+	--scene NAME        terrain, teapot or objects (default all)
+	--quick             only 1280x720, 1 thread & all threads
+	--out FILE          JSON results (default stdout)
+	--compare FILE      flag p50 regressions against a saved JSON
+	--threshold X       allowed p50 slow down for --compare (default 0.05 = 5%)
+	--mesh-order        reorder the meshes on import (mesh_order::optimize)
+	--quantize          16 bit local vertices (compound_mesh::quantize on import)
+	--sincos            only the sin/cos methods: max error against std::sin/cos & ns per angle
+	--gouraud           lit vertices interpolated over the triangles instead of a color per triangle
+	--lights            several lights (scenes::set_lights) instead of light_direction alone
+	--textured          every mesh textured (scenes::checker_texture, planar uvs) & tinted by its lighting
+	--texture-filter F  nearest or bilinear (default bilinear)
+	--no-mips           sample the full size texture only
+	--visibility        deferred: ids & depth first, then every pixel shaded once (EBG_visibility.h)
+	--msaa              4x multisample anti-aliasing (EBG_msaa.h), not with --visibility
+
+every run: scene x resolution x thread count x surface layout (row-major, 8x8 tiles),
+no window, no frame cap, same camera path & animation every time
+exit code 1 when --compare finds a regression
+*/
+
+using namespace ebg;
+using namespace eb3d;
+
+struct bench_config
+{
+	const char* scene;
+	upoint dim;
+	unsigned threads;
+	unsigned tile_log2;
+};
+
+struct bench_result
+{
+	bench_config config;
+	unsigned frames, triangles;
+	double min, avg, p50, p95, p99, total_ms;
+};
+
+inline double now_ms()
+{
+	static const double ms_per_tick = [] {
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency(&f);
+		return 1000.0 / static_cast<double>(f.QuadPart);
+	}();
+
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return static_cast<double>(t.QuadPart) * ms_per_tick;
+}
+
+// nearest-rank percentile of a sorted list
+inline double percentile(const std::vector<double>& sorted, unsigned p)
+{
+	size_t rank = (sorted.size() * p + 99) / 100;
+	return sorted[rank == 0 ? 0 : rank - 1];
+}
+
+// deferred: through a visibility_buffer instead of forward, multisampled: through an msaa_buffer
+bench_result run(const bench_config& config, scenes::scene* s, camera* cam, unsigned frames, unsigned warmup, bool deferred, bool multisampled)
+{
+	basic_engine engine(config.dim, 0, true, config.tile_log2);
+	thread_pool pool(config.threads);
+	visibility_buffer visibility;
+	visibility_buffer* v = deferred ? &visibility : nullptr;
+	msaa_buffer msaa;
+	msaa_buffer* ms = multisampled ? &msaa : nullptr;
+
+	for (unsigned i = 0; i < warmup; i++)
+		scenes::render_frame(s, i % frames, frames, cam, &engine, &pool, nullptr, v, ms);
+
+	std::vector<double> times(frames);
+	double total = 0.0;
+
+	for (unsigned i = 0; i < frames; i++)
+	{
+		double start = now_ms();
+		scenes::render_frame(s, i, frames, cam, &engine, &pool, nullptr, v, ms);
+		times[i] = now_ms() - start;
+		total += times[i];
+	}
+
+	delete_basic_engine(&engine);
+
+	std::sort(times.begin(), times.end());
+
+	bench_result r;
+	r.config = config;
+	r.frames = frames;
+	r.triangles = s->triangle_amount();
+	r.min = times.front();
+	r.avg = total / static_cast<double>(frames);
+	r.p50 = percentile(times, 50);
+	r.p95 = percentile(times, 95);
+	r.p99 = percentile(times, 99);
+	r.total_ms = total;
+	return r;
+}
+
+inline const char* layout_name(unsigned tile_log2)
+{
+	return tile_log2 == 0 ? "row" : tile_log2 == 2 ? "tile4" : "tile8";
+}
+
+// results are written one per line, so the baseline reader only has to look at single lines
+std::string json_string(const std::string& line, const char* key)
+{
+	std::string k = std::string("\"") + key + "\":\"";
+	size_t i = line.find(k);
+	if (i == std::string::npos)
+		return std::string();
+
+	i += k.size();
+	return line.substr(i, line.find('"', i) - i);
+}
+
+double json_number(const std::string& line, const char* key)
+{
+	std::string k = std::string("\"") + key + "\":";
+	size_t i = line.find(k);
+	return i == std::string::npos ? -1.0 : atof(line.c_str() + i + k.size());
+}
+
+struct baseline_entry
+{
+	std::string scene, layout;
+	unsigned width, height, threads;
+	double p50;
+};
+
+std::vector<baseline_entry> read_baseline(const char* file_name)
+{
+	std::vector<baseline_entry> entries;
+	std::ifstream file(file_name);
+	std::string line;
+
+	while (std::getline(file, line))
+	{
+		if (line.find("\"scene\"") == std::string::npos)
+			continue;
+
+		entries.push_back({
+			json_string(line, "scene"), json_string(line, "layout"),
+			static_cast<unsigned>(json_number(line, "width")),
+			static_cast<unsigned>(json_number(line, "height")),
+			static_cast<unsigned>(json_number(line, "threads")),
+			json_number(line, "p50_ms")
+		});
+	}
+
+	return entries;
+}
+
+const baseline_entry* find_baseline(const std::vector<baseline_entry>& entries, const bench_result& r)
+{
+	for (const baseline_entry& e : entries)
+		if (e.scene == r.config.scene && e.layout == layout_name(r.config.tile_log2) &&
+			e.width == r.config.dim.x && e.height == r.config.dim.y && e.threads == r.config.threads)
+			return &e;
+	return nullptr;
+}
+
+inline double sincos_error(const std::vector<float>& angles, std::vector<float>& sines, std::vector<float>& cosines)
+{
+	double error = 0.0;
+	sincos::batch(angles.data(), sines.data(), cosines.data(), static_cast<unsigned>(angles.size()));
+	for (size_t i = 0; i < angles.size(); i++)
+		error = (std::max)(error, (std::max)(fabs(sines[i] - sin(static_cast<double>(angles[i]))), fabs(cosines[i] - cos(static_cast<double>(angles[i])))));
+	return error;
+}
+
+// accuracy on [-2 pi, 2 pi] & [-64 pi, 64 pi] (negative, many turns) & throughput of batch, per sincos method
+void bench_sincos()
+{
+	constexpr unsigned amount = 1 << 16, repeats = 64;
+	static const char* method_names[] = { "table", "interpolated", "polynomial" };
+
+	// off the table grid
+	std::vector<float> near_angles(amount), far_angles(amount), sines(amount), cosines(amount);
+	uint32_t seed = 12345;
+	for (unsigned i = 0; i < amount; i++)
+	{
+		seed = seed * 1664525 + 1013904223;
+		float u = static_cast<float>(seed >> 8) / static_cast<float>(1 << 24) * 2.0f - 1.0f;
+		near_angles[i] = u * 2.0f * static_cast<float>(M_PI);
+		far_angles[i] = u * 64.0f * static_cast<float>(M_PI);
+	}
+
+	for (uint8_t m = sincos::mtable; m <= sincos::mpolynomial; m++)
+	{
+		sincos::method = m;
+
+		double near_error = sincos_error(near_angles, sines, cosines), far_error = sincos_error(far_angles, sines, cosines);
+
+		double start = now_ms();
+		for (unsigned r = 0; r < repeats; r++)
+			sincos::batch(far_angles.data(), sines.data(), cosines.data(), amount);
+		double ns = (now_ms() - start) * 1e6 / (static_cast<double>(amount) * repeats);
+
+		std::cout << "{\"sincos\":\"" << method_names[m] << "\",\"max_error_2pi\":" << near_error << ",\"max_error_64pi\":" << far_error
+			<< ",\"ns_per_angle\":" << ns << "}\n";
+	}
+
+	sincos::method = sincos::mpolynomial;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned frames = 120, warmup = 10;
+	const char* only_scene = nullptr, * out_name = nullptr, * compare_name = nullptr;
+	bool quick = false, only_sincos = false, gouraud = false, multiple_lights = false, textured = false, mipmaps = true, deferred = false, multisampled = false;
+	uint8_t texture_filter = graphics::fbilinear;
+	double threshold = 0.05;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--frames" && has_value)
+			frames = atoi(argv[++i]);
+		else if (a == "--warmup" && has_value)
+			warmup = atoi(argv[++i]);
+		else if (a == "--scene" && has_value)
+			only_scene = argv[++i];
+		else if (a == "--quick")
+			quick = true;
+		else if (a == "--out" && has_value)
+			out_name = argv[++i];
+		else if (a == "--compare" && has_value)
+			compare_name = argv[++i];
+		else if (a == "--threshold" && has_value)
+			threshold = atof(argv[++i]);
+		else if (a == "--mesh-order")
+			mesh_order::on_import = true;
+		else if (a == "--quantize")
+			quantize_on_import = true;
+		else if (a == "--sincos")
+			only_sincos = true;
+		else if (a == "--gouraud")
+			gouraud = true;
+		else if (a == "--lights")
+			multiple_lights = true;
+		else if (a == "--textured")
+			textured = true;
+		else if (a == "--texture-filter" && has_value)
+			texture_filter = strcmp(argv[++i], "nearest") == 0 ? graphics::fnearest : graphics::fbilinear;
+		else if (a == "--no-mips")
+			mipmaps = false;
+		else if (a == "--visibility")
+			deferred = true;
+		else if (a == "--msaa")
+			multisampled = true;
+		else
+		{
+			std::cerr << "unknown option " << a << '\n';
+			return 2;
+		}
+	}
+
+	if (frames == 0)
+		frames = 1;
+
+	if (deferred && multisampled)
+	{
+		std::cerr << "bad options\n";
+		return 2;
+	}
+
+	data::init();
+	sincos::init(12);
+
+	if (only_sincos)
+	{
+		bench_sincos();
+		data::free_cb();
+		return 0;
+	}
+
+	unsigned hardware = std::thread::hardware_concurrency();
+	if (hardware == 0)
+		hardware = 1;
+
+	std::vector<unsigned> thread_counts = quick ? std::vector<unsigned>{ 1 } : std::vector<unsigned>{ 1, 2, 4 };
+	if (std::find(thread_counts.begin(), thread_counts.end(), hardware) == thread_counts.end())
+		thread_counts.push_back(hardware);
+
+	std::vector<upoint> dims = quick ? std::vector<upoint>{ { 1280, 720 } } : std::vector<upoint>{ { 640, 360 }, { 1280, 720 }, { 1920, 1080 } };
+	unsigned tile_logs[] = { 0, 3 };
+
+	std::vector<bench_result> results;
+	graphics::texture tex = {};
+	if (textured)
+		tex = scenes::checker_texture(1024, 64, texture_filter, mipmaps);
+	camera cam(M_PI_3, EPSILON, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f });
+
+	for (unsigned si = 0; si < scenes::scene_amount; si++)
+	{
+		if (only_scene != nullptr && strcmp(only_scene, scenes::names[si]) != 0)
+			continue;
+
+		scenes::scene s = scenes::by_name(scenes::names[si], &cam);
+		if (gouraud)
+			scenes::set_shading(&s, graphics::draw::hgouraud);
+		if (multiple_lights)
+			scenes::set_lights(&s);
+		if (textured)
+			scenes::set_texture(&s, &tex);
+
+		std::cerr << s.name << " vertex cache miss ratio (FIFO 16):";
+		for (compound_mesh* m : s.meshes)
+			std::cerr << ' ' << mesh_order::acmr(m->triangles, m->triangle_amount, m->vertex_amount);
+		std::cerr << '\n';
+
+		if (quantize_on_import)
+		{
+			std::cerr << s.name << " quantization error:";
+			for (compound_mesh* m : s.meshes)
+				std::cerr << ' ' << m->quantization_error;
+			std::cerr << '\n';
+		}
+
+		for (upoint dim : dims)
+			for (unsigned threads : thread_counts)
+				for (unsigned tile_log2 : tile_logs)
+				{
+					results.push_back(run({ s.name, dim, threads, tile_log2 }, &s, &cam, frames, warmup, deferred, multisampled));
+
+					const bench_result& r = results.back();
+					std::cerr << s.name << ' ' << dim.x << 'x' << dim.y << ' ' << threads << "t " << layout_name(tile_log2)
+						<< ": p50 " << r.p50 << " ms, p99 " << r.p99 << " ms\n";
+				}
+
+		scenes::delete_scene(&s);
+	}
+
+	graphics::delete_texture(&tex);
+
+	std::vector<baseline_entry> baseline;
+	if (compare_name != nullptr)
+		baseline = read_baseline(compare_name);
+
+	unsigned regressions = 0;
+	std::ostringstream json;
+	json << std::fixed << std::setprecision(4);
+	json << "{\"version\":1,\"frames\":" << frames << ",\"warmup\":" << warmup << ",\"results\":[\n";
+
+	for (size_t i = 0; i < results.size(); i++)
+	{
+		const bench_result& r = results[i];
+		double seconds = r.total_ms * 0.001;
+
+		json << "{\"scene\":\"" << r.config.scene << "\",\"layout\":\"" << layout_name(r.config.tile_log2)
+			<< "\",\"width\":" << r.config.dim.x << ",\"height\":" << r.config.dim.y
+			<< ",\"threads\":" << r.config.threads << ",\"frames\":" << r.frames
+			<< ",\"min_ms\":" << r.min << ",\"avg_ms\":" << r.avg << ",\"p50_ms\":" << r.p50
+			<< ",\"p95_ms\":" << r.p95 << ",\"p99_ms\":" << r.p99
+			<< ",\"triangles_per_s\":" << static_cast<double>(r.triangles) * r.frames / seconds
+			<< ",\"pixels_per_s\":" << static_cast<double>(r.config.dim.x * r.config.dim.y) * r.frames / seconds;
+
+		if (const baseline_entry* b = compare_name != nullptr ? find_baseline(baseline, r) : nullptr)
+		{
+			double change = r.p50 / b->p50 - 1.0;
+			bool regression = change > threshold;
+			regressions += regression;
+
+			json << ",\"baseline_p50_ms\":" << b->p50 << ",\"change\":" << change
+				<< ",\"regression\":" << (regression ? "true" : "false");
+
+			if (regression)
+				std::cerr << "REGRESSION " << r.config.scene << ' ' << r.config.dim.x << 'x' << r.config.dim.y << ' '
+					<< r.config.threads << "t " << layout_name(r.config.tile_log2) << ": p50 "
+					<< b->p50 << " -> " << r.p50 << " ms (+" << change * 100.0 << "%)\n";
+		}
+
+		json << (i + 1 < results.size() ? "},\n" : "}\n");
+	}
+
+	json << "],\"regressions\":" << regressions << "}\n";
+
+	if (out_name != nullptr)
+		std::ofstream(out_name) << json.str();
+	else
+		std::cout << json.str();
+
+	data::free_cb();
+
+	return regressions != 0;
+}
@@ -0,0 +1,565 @@
+#include "EBG_graphics.h"
+
+#include <chrono>
+#include <functional>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <iomanip>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/*
+Microbenchmark of the graphics::draw kernels
+
+microbenchmark [options]
+	--reps N        timed repetitions per case (default 15)
+	--filter TEXT   only cases whose name contains TEXT
+	--tiled         also run every case on an 8x8 tiled surface
+	--json FILE     one JSON result per line
+
+every case draws a fixed batch of synthetic primitives (same seed every run),
+the batch grows until it takes ~2 ms, then one warmup and N timed repetitions
+reports ns/primitive (median, min, relative stddev) and ns/pixel (median)
+pixels are the ones the batch writes, counted once before timing
+
+hardware counters (Linux perf_event_open, needs perf_event_paranoid <= 2):
+cycles, instructions, cache misses & branch misses of the median repetition
+*/
+
+using namespace ebg;
+using namespace ebg::graphics;
+
+constexpr upoint surface_dim(1920, 1080);
+
+struct primitive
+{
+	std::function<void()> draw;
+	// bounding box on the surface, only used to count pixels
+	ipoint lo, hi;
+};
+
+struct bench_case
+{
+	std::string name;
+	std::vector<primitive> primitives;
+
+	void add(std::function<void()> draw, ipoint a, ipoint b)
+	{
+		primitives.push_back({ std::move(draw),
+			ipoint((std::min)(a.x, b.x), (std::min)(a.y, b.y)), ipoint((std::max)(a.x, b.x), (std::max)(a.y, b.y)) });
+	}
+};
+
+struct hw_counters
+{
+	bool available;
+	unsigned long long cycles, instructions, cache_misses, branch_misses;
+};
+
+#ifdef __linux__
+struct perf_group
+{
+	int fds[4];
+
+	perf_group()
+	{
+		unsigned long long configs[4] = {
+			PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES
+		};
+
+		for (int i = 0; i < 4; i++)
+		{
+			perf_event_attr attr;
+			memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = PERF_TYPE_HARDWARE;
+			attr.config = configs[i];
+			attr.disabled = i == 0;
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+
+			fds[i] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, i == 0 ? -1 : fds[0], 0));
+		}
+	}
+
+	~perf_group()
+	{
+		for (int fd : fds)
+			if (fd >= 0)
+				close(fd);
+	}
+
+	bool available() const
+	{
+		return fds[0] >= 0 && fds[1] >= 0 && fds[2] >= 0 && fds[3] >= 0;
+	}
+
+	void start()
+	{
+		ioctl(fds[0], PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+		ioctl(fds[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+	}
+
+	hw_counters stop()
+	{
+		ioctl(fds[0], PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+
+		hw_counters c = { true, 0, 0, 0, 0 };
+		unsigned long long* values[4] = { &c.cycles, &c.instructions, &c.cache_misses, &c.branch_misses };
+		for (int i = 0; i < 4; i++)
+			if (read(fds[i], values[i], sizeof(unsigned long long)) != sizeof(unsigned long long))
+				c.available = false;
+		return c;
+	}
+};
+#else
+// no portable user mode counters elsewhere, timings only
+struct perf_group
+{
+	bool available() const { return false; }
+	void start() {}
+	hw_counters stop() { return { false, 0, 0, 0, 0 }; }
+};
+#endif
+
+struct bench_target
+{
+	surface surf;
+	float* depth_buffer;
+	// 256x256 xor pattern, bilinear & mipmapped, of the textured cases
+	texture tex;
+
+	bench_target(unsigned tile_log2) : surf(surface_dim, true, tile_log2)
+	{
+		depth_buffer = TYPE_MALLOC(float, surf.buffer_size);
+
+		std::vector<color_t> texels(256 * 256);
+		for (unsigned y = 0; y < 256; y++)
+			for (unsigned x = 0; x < 256; x++)
+				texels[y * 256 + x] = ((x ^ y) & 0xFF) * 0x010101U;
+		tex = create_texture(texels.data(), upoint(256, 256));
+	}
+
+	~bench_target()
+	{
+		delete_surface(&surf);
+		free(depth_buffer);
+		delete_texture(&tex);
+	}
+
+	void clear()
+	{
+		0 >> surf;
+		// (float)0x7F7F7F7F = very large float number
+		memset(depth_buffer, 0b01111111, surf.buffer_size << 2);
+	}
+};
+
+// fixed seed xorshift, the same primitives on every machine
+struct random_source
+{
+	unsigned state = 0x9E3779B9U;
+
+	unsigned next()
+	{
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+		return state;
+	}
+
+	int range(int lo, int hi) { return lo + static_cast<int>(next() % static_cast<unsigned>(hi - lo)); }
+	float unit() { return static_cast<float>(next() & 0xFFFFFF) / 16777216.0f; }
+};
+
+enum clip_cases { cinside, cpartial, coutside_crossing };
+const char* clip_names[] = { "inside", "partial", "crossing" };
+
+// start & end of a line of the given length and angle, placed by the clip case
+void place_line(random_source& r, int length, float angle, uint8_t clip, ipoint& start, ipoint& end)
+{
+	ipoint d(static_cast<int>(cosf(angle) * length), static_cast<int>(sinf(angle) * length));
+	ipoint dim = surface_dim;
+
+	switch (clip)
+	{
+	case cinside:
+		start = ipoint(r.range(0, dim.x - d.x), r.range((std::max)(0, -d.y), (std::min)(dim.y, dim.y - d.y)));
+		break;
+	case cpartial:
+		// starts inside, ends past the right or top edge
+		start = ipoint(r.range(dim.x - d.x / 2 - 1, dim.x), r.range(dim.y / 4, dim.y * 3 / 4));
+		break;
+	default:
+		// both ends outside, crossing the surface
+		start = ipoint(-d.x / 2 + r.range(-4, 4), dim.y / 2 - d.y / 2 + r.range(-4, 4));
+		break;
+	}
+
+	end = start + d;
+}
+
+void add_line_cases(std::vector<bench_case>& cases, bench_target* target, bool depth)
+{
+	const char* kernel = depth ? "depth_line" : "line";
+	int lengths[] = { 8, 64, 512 };
+	float angles[] = { 0.0f, 0.5236f, 0.7854f, 1.0472f, 1.5708f };
+	const char* angle_names[] = { "0deg", "30deg", "45deg", "60deg", "90deg" };
+
+	for (int length : lengths)
+		for (unsigned a = 0; a < 5; a++)
+			for (uint8_t clip = cinside; clip <= coutside_crossing; clip++)
+			{
+				if (clip == coutside_crossing && length < 512)
+					continue;
+
+				bench_case c;
+				c.name = std::string(kernel) + " len=" + std::to_string(length) + ' ' + angle_names[a] + ' ' + clip_names[clip];
+
+				random_source r;
+				for (int i = 0; i < 256; i++)
+				{
+					ipoint s, e;
+					// the longest lines have to cross
+					place_line(r, clip == coutside_crossing ? 2200 : length, angles[a], clip, s, e);
+					color_t color = r.next() | colors::alpha;
+
+					if (depth)
+						c.add([=] { draw::depth_line(s, e, target->depth_buffer, color, &target->surf); }, s, e);
+					else
+						c.add([=] { draw::line(s, e, color, &target->surf); }, s, e);
+				}
+
+				cases.push_back(std::move(c));
+			}
+}
+
+enum triangle_shapes { sregular, sthin_tall, sthin_wide };
+const char* shape_names[] = { "regular", "thin_tall", "thin_wide" };
+
+// shading draw::hgouraud: depth tested with a color per vertex (draw::rasterise<ztest, hgouraud, bopaque>),
+// htextured: depth tested & perspective correct uvs, about a texel per pixel
+void add_triangle_cases(std::vector<bench_case>& cases, bench_target* target, bool depth, uint8_t shading = draw::hflat)
+{
+	const char* kernel = shading == draw::hgouraud ? "gouraud_rasterisation" : shading == draw::htextured ? "textured_rasterisation" :
+		depth ? "depth_rasterisation" : "rasterisation";
+	int sizes[] = { 4, 16, 64, 256 };
+
+	for (int size : sizes)
+		for (uint8_t shape = sregular; shape <= sthin_wide; shape++)
+			for (uint8_t clip = cinside; clip <= cpartial; clip++)
+			{
+				bench_case c;
+				c.name = std::string(kernel) + " size=" + std::to_string(size) + ' ' + shape_names[shape] + ' ' + clip_names[clip];
+
+				ipoint extent = shape == sthin_tall ? ipoint((std::max)(size / 16, 2), size) :
+					shape == sthin_wide ? ipoint(size, (std::max)(size / 16, 2)) : ipoint(size, size);
+
+				random_source r;
+				for (int i = 0; i < 256; i++)
+				{
+					ipoint o = clip == cinside ?
+						ipoint(r.range(0, surface_dim.x - extent.x), r.range(0, surface_dim.y - extent.y)) :
+						ipoint(surface_dim.x - extent.x / 2, r.range(-extent.y / 2, surface_dim.y - extent.y / 2));
+
+					ipoint a = o, b = o + ipoint(extent.x, extent.y / 3), cc = o + ipoint(extent.x / 4, extent.y);
+					float az = 1.0f + r.unit() * 100.0f, bz = 1.0f + r.unit() * 100.0f, cz = 1.0f + r.unit() * 100.0f;
+					color_t color = r.next() | colors::alpha;
+
+					if (shading == draw::hgouraud)
+					{
+						typedef draw::raster_vertex<draw::hgouraud> vertex;
+						vertex va = { a, az, { r.unit() * 255.0f, r.unit() * 255.0f, r.unit() * 255.0f } },
+							vb = { b, bz, { r.unit() * 255.0f, r.unit() * 255.0f, r.unit() * 255.0f } },
+							vc = { cc, cz, { r.unit() * 255.0f, r.unit() * 255.0f, r.unit() * 255.0f } };
+
+						c.add([=] { draw::rasterise<draw::ztest, draw::hgouraud, draw::bopaque>(va, vb, vc, { &target->surf, target->depth_buffer, color, nullptr }); }, o, o + extent);
+					}
+					else if (shading == draw::htextured)
+					{
+						typedef draw::raster_vertex<draw::htextured> vertex;
+						vertex va = { a, az, { a.x / 256.0f, a.y / 256.0f } },
+							vb = { b, bz, { b.x / 256.0f, b.y / 256.0f } },
+							vc = { cc, cz, { cc.x / 256.0f, cc.y / 256.0f } };
+
+						c.add([=] { draw::rasterise<draw::ztest, draw::htextured, draw::bopaque>(va, vb, vc,
+							{ &target->surf, target->depth_buffer, colors::white, &target->tex }); }, o, o + extent);
+					}
+					else if (depth)
+						c.add([=] { draw::depth_rasterisation(a, b, cc, az, bz, cz, target->depth_buffer, color, &target->surf); }, o, o + extent);
+					else
+						c.add([=] { draw::rasterisation(a, b, cc, color, &target->surf); }, o, o + extent);
+				}
+
+				cases.push_back(std::move(c));
+			}
+}
+
+void add_span_cases(std::vector<bench_case>& cases, bench_target* target)
+{
+	unsigned lengths[] = { 1, 4, 16, 64, 256, 1024 };
+
+	for (unsigned length : lengths)
+	{
+		bench_case c;
+		c.name = "depth_sure_x_line len=" + std::to_string(length);
+
+		random_source r;
+		for (int i = 0; i < 256; i++)
+		{
+			// single pixel spans skip the surface edges, keep them off x = 0
+			unsigned xs = r.range(1, surface_dim.x - length - 1), y = r.range(0, surface_dim.y);
+			float z1 = 1.0f + r.unit() * 100.0f, z2 = 1.0f + r.unit() * 100.0f;
+			color_t color = r.next() | colors::alpha;
+
+			c.add([=] { draw::depth_sure_x_line(xs, xs + length - 1, y, z1, z2, target->depth_buffer, color, &target->surf); },
+				ipoint(xs, y), ipoint(xs + length - 1, y));
+		}
+
+		cases.push_back(std::move(c));
+	}
+}
+
+void add_circle_cases(std::vector<bench_case>& cases, bench_target* target)
+{
+	int radii[] = { 4, 32, 256 };
+
+	for (int radius : radii)
+		for (uint8_t clip = cinside; clip <= cpartial; clip++)
+		{
+			bench_case c;
+			c.name = "circle r=" + std::to_string(radius) + ' ' + clip_names[clip];
+
+			random_source r;
+			for (int i = 0; i < 256; i++)
+			{
+				ipoint center = clip == cinside ?
+					ipoint(r.range(radius, surface_dim.x - radius), r.range(radius, surface_dim.y - radius)) :
+					ipoint(r.range(-radius / 2, radius / 2), r.range(0, surface_dim.y));
+				color_t color = r.next() | colors::alpha;
+
+				c.add([=] { draw::circle(center, radius, color, &target->surf); }, center - radius, center + radius);
+			}
+
+			cases.push_back(std::move(c));
+		}
+}
+
+// reference for the std::function call every primitive pays
+void add_call_overhead_case(std::vector<bench_case>& cases)
+{
+	bench_case c;
+	c.name = "empty (call overhead)";
+
+	for (int i = 0; i < 256; i++)
+		c.add([] {}, ipoint(0, 0), ipoint(0, 0));
+
+	cases.push_back(std::move(c));
+}
+
+// pixels written by one pass over the primitives, each primitive counted on its own inside its bounding box
+unsigned long long count_pixels(const bench_case& c, bench_target* target)
+{
+	unsigned long long pixels = 0;
+	ipoint hi = ipoint(surface_dim) - 1;
+
+	target->clear();
+
+	for (const primitive& p : c.primitives)
+	{
+		ipoint lo = clamp(p.lo - 1, hi), up = clamp(p.hi + 1, hi);
+
+		p.draw();
+
+		for (int y = lo.y; y <= up.y; y++)
+			for (int x = lo.x; x <= up.x; x++)
+			{
+				unsigned o = pixel_offset(x, y, &target->surf);
+
+				pixels += target->surf.buffer[o] != 0;
+				target->surf.buffer[o] = 0;
+				target->depth_buffer[o] = 3.0e38f;
+			}
+	}
+
+	return pixels;
+}
+
+struct case_result
+{
+	std::string name;
+	const char* layout;
+	unsigned batch, primitives_per_rep;
+	unsigned long long pixels_per_pass;
+	double median_ns, min_ns, rel_stddev, median_ns_per_pixel;
+	hw_counters counters;
+};
+
+inline double time_ns(bench_case& c, bench_target* target, unsigned batch)
+{
+	target->clear();
+
+	auto start = std::chrono::steady_clock::now();
+	for (unsigned b = 0; b < batch; b++)
+		for (primitive& p : c.primitives)
+			p.draw();
+	auto end = std::chrono::steady_clock::now();
+
+	return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+}
+
+case_result run_case(bench_case& c, bench_target* target, const char* layout, unsigned reps, perf_group* perf)
+{
+	case_result r;
+	r.name = c.name;
+	r.layout = layout;
+
+	r.pixels_per_pass = count_pixels(c, target);
+
+	// grow the batch to ~2 ms, this also warms caches & branch predictors
+	r.batch = 1;
+	while (time_ns(c, target, r.batch) < 2000000.0 && r.batch < (1U << 16))
+		r.batch <<= 1;
+	time_ns(c, target, r.batch);
+
+	r.primitives_per_rep = r.batch * static_cast<unsigned>(c.primitives.size());
+
+	std::vector<std::pair<double, hw_counters>> samples;
+	for (unsigned i = 0; i < reps; i++)
+	{
+		perf->start();
+		double ns = time_ns(c, target, r.batch);
+		samples.push_back({ ns, perf->stop() });
+	}
+
+	std::sort(samples.begin(), samples.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+
+	double sum = 0.0, square_sum = 0.0;
+	for (const auto& s : samples)
+	{
+		sum += s.first;
+		square_sum += s.first * s.first;
+	}
+
+	double mean = sum / reps, variance = square_sum / reps - mean * mean;
+	const auto& median = samples[reps / 2];
+
+	r.median_ns = median.first / r.primitives_per_rep;
+	r.min_ns = samples.front().first / r.primitives_per_rep;
+	r.rel_stddev = variance > 0.0 ? sqrt(variance) / mean : 0.0;
+	// pixels a pass covers, repeated passes of depth kernels test them again but may not write
+	r.median_ns_per_pixel = r.pixels_per_pass != 0 ? median.first / r.batch / static_cast<double>(r.pixels_per_pass) : 0.0;
+	r.counters = median.second;
+
+	return r;
+}
+
+int main(int argc, char** argv)
+{
+	unsigned reps = 15;
+	const char* filter = nullptr, * json_name = nullptr;
+	bool tiled = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--reps" && has_value)
+			reps = atoi(argv[++i]);
+		else if (a == "--filter" && has_value)
+			filter = argv[++i];
+		else if (a == "--tiled")
+			tiled = true;
+		else if (a == "--json" && has_value)
+			json_name = argv[++i];
+		else
+		{
+			std::cerr << "unknown option " << a << '\n';
+			return 2;
+		}
+	}
+
+	if (reps == 0)
+		reps = 1;
+
+	perf_group perf;
+	if (perf.available() == false)
+		std::cerr << "hardware counters unavailable, timings only\n";
+
+	std::vector<case_result> results;
+	unsigned tile_logs[] = { 0, 3 };
+
+	for (unsigned tile_log2 : tile_logs)
+	{
+		if (tile_log2 != 0 && tiled == false)
+			continue;
+
+		bench_target target(tile_log2);
+		const char* layout = tile_log2 == 0 ? "row" : "tile8";
+
+		std::vector<bench_case> cases;
+		add_call_overhead_case(cases);
+		add_line_cases(cases, &target, false);
+		add_line_cases(cases, &target, true);
+		add_triangle_cases(cases, &target, false);
+		add_triangle_cases(cases, &target, true);
+		add_triangle_cases(cases, &target, true, draw::hgouraud);
+		add_triangle_cases(cases, &target, true, draw::htextured);
+		add_span_cases(cases, &target);
+		add_circle_cases(cases, &target);
+
+		for (bench_case& c : cases)
+		{
+			if (filter != nullptr && c.name.find(filter) == std::string::npos)
+				continue;
+
+			results.push_back(run_case(c, &target, layout, reps, &perf));
+			const case_result& r = results.back();
+
+			std::cout << std::left << std::setw(52) << r.name << std::setw(6) << r.layout << std::right << std::fixed
+				<< std::setprecision(2) << std::setw(10) << r.median_ns << " ns/prim"
+				<< std::setw(9) << r.min_ns << " min"
+				<< std::setprecision(3) << std::setw(8) << r.median_ns_per_pixel << " ns/px"
+				<< std::setprecision(1) << std::setw(6) << r.rel_stddev * 100.0 << "% sd";
+
+			if (r.counters.available)
+				std::cout << std::setprecision(2) << "  ipc " << static_cast<double>(r.counters.instructions) / r.counters.cycles
+					<< "  cyc/prim " << static_cast<double>(r.counters.cycles) / r.primitives_per_rep
+					<< "  miss/prim " << static_cast<double>(r.counters.cache_misses) / r.primitives_per_rep
+					<< "  brmiss/prim " << static_cast<double>(r.counters.branch_misses) / r.primitives_per_rep;
+
+			std::cout << '\n';
+		}
+	}
+
+	if (json_name != nullptr)
+	{
+		std::ofstream json(json_name);
+		json << std::fixed << std::setprecision(4);
+
+		for (const case_result& r : results)
+		{
+			json << "{\"case\":\"" << r.name << "\",\"layout\":\"" << r.layout
+				<< "\",\"primitives\":" << r.primitives_per_rep << ",\"pixels\":" << r.pixels_per_pass * r.batch
+				<< ",\"ns_per_primitive\":" << r.median_ns << ",\"min_ns_per_primitive\":" << r.min_ns
+				<< ",\"ns_per_pixel\":" << r.median_ns_per_pixel << ",\"rel_stddev\":" << r.rel_stddev;
+
+			if (r.counters.available)
+				json << ",\"cycles\":" << r.counters.cycles << ",\"instructions\":" << r.counters.instructions
+					<< ",\"cache_misses\":" << r.counters.cache_misses << ",\"branch_misses\":" << r.counters.branch_misses;
+
+			json << "}\n";
+		}
+	}
+
+	return 0;
+}
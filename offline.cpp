@@ -0,0 +1,259 @@
+#include "EBG_scenes.h"
+#include "EBG_frame_writer.h"
+#include "EBG_stream.h"
+
+#include <string>
+
+/*
+Offline batch rendering of a camera path, as fast as possible
+
+offline [options]
+	--scene NAME        terrain, teapot or objects (default terrain)
+	--path FILE         camera path file instead of the scene's own path,
+	                    one key per line: time x y z rotation_x rotation_y rotation_z
+	--slerp             rotations between path keys on the shortest arc (camera_path::slerp)
+	--frames N          frames over the whole path (default 300)
+	--size WxH          default 1280x720
+	--threads N         render threads (default all cores)
+	--tiled             draw on 8x8 tiles
+	--format F          ppm, qoi, y4m or none (default y4m)
+	--out NAME          ppm/qoi: printf pattern (default frame_%05u.ppm / .qoi),
+	                    y4m: file or - for stdout (default -)
+	--fps N             y4m frame rate (default 60)
+	--writers N         encoding threads (default 2)
+	--queue N           frames buffered for the writers (default 8)
+	--serve PORT        also stream the frames to a viewer (stream_client) on 127.0.0.1:PORT,
+	                    waits for the viewer before the first frame
+	--reproject N       reuse the previous frame (EBG_reprojection.h), a full frame every N frames
+	--gouraud           lit vertices interpolated over the triangles instead of a color per triangle
+	--lights            several lights (scenes::set_lights) instead of light_direction alone
+	--textured          every mesh textured (scenes::checker_texture, planar uvs) & tinted by its lighting
+	--texture-filter F  nearest or bilinear (default bilinear)
+	--no-mips           sample the full size texture only
+	--visibility        deferred: ids & depth first, then every pixel shaded once (EBG_visibility.h), not with --reproject
+	--msaa              4x multisample anti-aliasing (EBG_msaa.h), not with --reproject or --visibility
+
+no window and no frame cap, the progress & summary go to stderr
+exit code 1 when a frame couldn't be written
+*/
+
+using namespace ebg;
+using namespace eb3d;
+
+inline double now_ms()
+{
+	static const double ms_per_tick = [] {
+		LARGE_INTEGER f;
+		QueryPerformanceFrequency(&f);
+		return 1000.0 / static_cast<double>(f.QuadPart);
+	}();
+
+	LARGE_INTEGER t;
+	QueryPerformanceCounter(&t);
+	return static_cast<double>(t.QuadPart) * ms_per_tick;
+}
+
+int main(int argc, char** argv)
+{
+	const char* scene_name = "terrain", * path_name = nullptr, * out = nullptr;
+	unsigned frames = 300, fps = 60, writers = 2, queue = 8, tile_log2 = 0;
+	unsigned threads = (std::max)(std::thread::hardware_concurrency(), 1U);
+	upoint dim(1280, 720);
+	uint8_t format = fy4m;
+	bool write_frames = true;
+	unsigned serve_port = 0, reproject_interval = 0;
+	bool slerp = false, gouraud = false, multiple_lights = false, textured = false, mipmaps = true, deferred = false, multisampled = false;
+	uint8_t texture_filter = graphics::fbilinear;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--scene" && has_value)
+			scene_name = argv[++i];
+		else if (a == "--path" && has_value)
+			path_name = argv[++i];
+		else if (a == "--slerp")
+			slerp = true;
+		else if (a == "--frames" && has_value)
+			frames = atoi(argv[++i]);
+		else if (a == "--size" && has_value && sscanf(argv[i + 1], "%ux%u", &dim.x, &dim.y) == 2)
+			i++;
+		else if (a == "--threads" && has_value)
+			threads = atoi(argv[++i]);
+		else if (a == "--tiled")
+			tile_log2 = 3;
+		else if (a == "--format" && has_value)
+		{
+			std::string f = argv[++i];
+			if (f == "ppm")
+				format = fppm;
+			else if (f == "qoi")
+				format = fqoi;
+			else if (f == "y4m")
+				format = fy4m;
+			else if (f == "none")
+				write_frames = false;
+			else
+			{
+				std::cerr << "unknown format " << f << '\n';
+				return 2;
+			}
+		}
+		else if (a == "--out" && has_value)
+			out = argv[++i];
+		else if (a == "--fps" && has_value)
+			fps = atoi(argv[++i]);
+		else if (a == "--writers" && has_value)
+			writers = atoi(argv[++i]);
+		else if (a == "--queue" && has_value)
+			queue = atoi(argv[++i]);
+		else if (a == "--serve" && has_value)
+			serve_port = atoi(argv[++i]);
+		else if (a == "--reproject" && has_value)
+			reproject_interval = atoi(argv[++i]);
+		else if (a == "--gouraud")
+			gouraud = true;
+		else if (a == "--lights")
+			multiple_lights = true;
+		else if (a == "--textured")
+			textured = true;
+		else if (a == "--texture-filter" && has_value)
+			texture_filter = strcmp(argv[++i], "nearest") == 0 ? graphics::fnearest : graphics::fbilinear;
+		else if (a == "--no-mips")
+			mipmaps = false;
+		else if (a == "--visibility")
+			deferred = true;
+		else if (a == "--msaa")
+			multisampled = true;
+		else
+		{
+			std::cerr << "unknown option " << a << '\n';
+			return 2;
+		}
+	}
+
+	if (frames == 0 || dim.x == 0 || dim.y == 0 || fps == 0 || (deferred && reproject_interval != 0) ||
+		(multisampled && (deferred || reproject_interval != 0)))
+	{
+		std::cerr << "bad options\n";
+		return 2;
+	}
+
+	if (out == nullptr)
+		out = format == fppm ? "frame_%05u.ppm" : format == fqoi ? "frame_%05u.qoi" : "-";
+
+	data::init();
+	sincos::init(12);
+
+	camera cam(M_PI_3, EPSILON, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f });
+	scenes::scene s = scenes::by_name(scene_name, &cam);
+
+	if (path_name != nullptr && s.path.load(path_name) == false)
+	{
+		std::cerr << "can't read camera path " << path_name << '\n';
+		scenes::delete_scene(&s);
+		data::free_cb();
+		return 2;
+	}
+	s.path.slerp = slerp;
+	if (gouraud)
+		scenes::set_shading(&s, graphics::draw::hgouraud);
+	if (multiple_lights)
+		scenes::set_lights(&s);
+	graphics::texture tex = {};
+	if (textured)
+	{
+		tex = scenes::checker_texture(1024, 64, texture_filter, mipmaps);
+		scenes::set_texture(&s, &tex);
+	}
+
+	// fps 0: end_tick never sleeps
+	basic_engine engine(dim, 0, true, tile_log2);
+	thread_pool pool(threads);
+	frame_writer* writer = write_frames ? new frame_writer(dim, format, out, fps, writers, queue) : nullptr;
+	stream::server* server = nullptr;
+	reprojector* reproject = reproject_interval != 0 ? new reprojector(&engine, reproject_interval) : nullptr;
+	visibility_buffer* visibility = deferred ? new visibility_buffer : nullptr;
+	msaa_buffer* msaa = multisampled ? new msaa_buffer : nullptr;
+	unsigned long long redrawn_blocks = 0, total_blocks = 0;
+
+	if (serve_port != 0)
+	{
+		server = new stream::server(dim, static_cast<uint16_t>(serve_port));
+		if (server->listening() == false)
+			std::cerr << "can't listen on port " << serve_port << '\n';
+		else
+		{
+			std::cerr << "waiting for a viewer on port " << serve_port << '\n';
+			while (server->stats().client_connected == false)
+				std::this_thread::sleep_for(std::chrono::milliseconds(20));
+		}
+	}
+
+	double start = now_ms(), render_ms = 0.0;
+	unsigned rendered = 0;
+
+	for (; rendered < frames && (writer == nullptr || writer->failed() == false); rendered++)
+	{
+		double frame_start = now_ms();
+		scenes::render_frame(&s, rendered, frames, &cam, &engine, &pool, reproject, visibility, msaa);
+		render_ms += now_ms() - frame_start;
+
+		if (reproject != nullptr)
+		{
+			redrawn_blocks += reproject->redrawn_blocks;
+			total_blocks += reproject->total_blocks;
+		}
+
+		if (writer != nullptr)
+			writer->submit(engine.present_buffer);
+		if (server != nullptr)
+			server->submit(engine.present_buffer);
+
+		if ((rendered + 1) % 60 == 0)
+			std::cerr << "frame " << rendered + 1 << '/' << frames << '\n';
+	}
+
+	if (writer != nullptr)
+		writer->finish();
+	double total_ms = now_ms() - start;
+
+	std::cerr << rendered << " frames in " << total_ms << " ms (" << rendered * 1000.0 / total_ms << " fps), "
+		<< "rendering " << render_ms / rendered << " ms/frame";
+	if (writer != nullptr)
+	{
+		std::cerr << ", " << writer->stalls << " stalls on a full queue";
+		if (writer->failed())
+			std::cerr << ", " << writer->errors << " failed writes";
+	}
+	std::cerr << '\n';
+
+	if (reproject != nullptr)
+	{
+		std::cerr << "reprojection: " << 100.0 * redrawn_blocks / (std::max)(total_blocks, 1ULL) << "% of the blocks drawn\n";
+		delete reproject;
+	}
+
+	if (server != nullptr)
+	{
+		server->drain(1000);
+		stream::counters c = server->stats();
+		std::cerr << "streamed " << c.frames_sent << " frames (" << c.frames_dropped << " dropped), " << c.tiles_sent << " tiles, "
+			<< c.bytes_sent / 1024 << " KiB, average latency " << c.average_latency_ms << " ms\n";
+		delete server;
+	}
+
+	bool failed = writer != nullptr && writer->failed();
+	delete writer;
+	delete visibility;
+	delete msaa;
+
+	delete_basic_engine(&engine);
+	scenes::delete_scene(&s);
+	graphics::delete_texture(&tex);
+	data::free_cb();
+
+	return failed;
+}
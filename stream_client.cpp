@@ -0,0 +1,160 @@
+#include "EBG_stream.h"
+
+#include <iostream>
+#include <string>
+
+/*
+Test viewer of the framebuffer stream (EBG_stream.h), keeps the frame in memory
+
+stream_client [options]
+	--host ADDRESS      IPv4 address of the server (default 127.0.0.1)
+	--port N            default 5900
+	--frames N          quit after N frames (default 0 = until the server closes)
+	--save FILE         write the last frame as PPM
+
+prints frames, tiles & bandwidth every second
+*/
+
+using namespace ebg;
+using namespace ebg::stream;
+
+int main(int argc, char** argv)
+{
+	const char* host = "127.0.0.1", * save_name = nullptr;
+	unsigned port = 5900, max_frames = 0;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--host" && has_value)
+			host = argv[++i];
+		else if (a == "--port" && has_value)
+			port = atoi(argv[++i]);
+		else if (a == "--frames" && has_value)
+			max_frames = atoi(argv[++i]);
+		else if (a == "--save" && has_value)
+			save_name = argv[++i];
+		else
+		{
+			std::cerr << "unknown option " << a << '\n';
+			return 2;
+		}
+	}
+
+	if (init_sockets() == false)
+		return 2;
+
+	socket_t s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+	sockaddr_in address = {};
+	address.sin_family = AF_INET;
+	address.sin_port = htons(static_cast<uint16_t>(port));
+	address.sin_addr.s_addr = inet_addr(host);
+
+	if (s == invalid_socket || connect(s, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0)
+	{
+		std::cerr << "can't connect to " << host << ':' << port << '\n';
+		free_sockets();
+		return 2;
+	}
+
+	uint8_t hello[20];
+	if (recv_all(s, hello, 20) == false || memcmp(hello, "EBGS", 4) != 0 || get32(hello + 4) != version || get32(hello + 16) != tile_size)
+	{
+		std::cerr << "not a stream server or a different version\n";
+		close_socket(s);
+		free_sockets();
+		return 2;
+	}
+
+	upoint dim(get32(hello + 8), get32(hello + 12));
+	std::vector<color_t> frame(dim.x * dim.y, colors::black);
+	std::vector<uint8_t> payload;
+	unsigned tiles_x = (dim.x + tile_size - 1) / tile_size, tiles_y = (dim.y + tile_size - 1) / tile_size;
+
+	std::cerr << "connected, " << dim.x << 'x' << dim.y << '\n';
+
+	unsigned long long frames = 0, window_frames = 0, window_tiles = 0, window_bytes = 0;
+	double window_start = now_ms();
+	bool bad = false;
+
+	while (max_frames == 0 || frames < max_frames)
+	{
+		uint8_t header[16];
+		if (recv_all(s, header, 16) == false)
+			break;
+
+		unsigned frame_index = get32(header + 4), tiles = get32(header + 8), size = get32(header + 12);
+		payload.resize(size);
+
+		if (memcmp(header, "FRME", 4) != 0 || recv_all(s, payload.data(), size) == false)
+		{
+			bad = true;
+			break;
+		}
+
+		size_t p = 0;
+		for (unsigned t = 0; t < tiles && bad == false; t++)
+		{
+			if (p + 9 > size)
+			{
+				bad = true;
+				break;
+			}
+
+			unsigned tx = get16(&payload[p]), ty = get16(&payload[p + 2]), bytes = get32(&payload[p + 5]);
+			uint8_t encoding = payload[p + 4];
+			p += 9;
+
+			if (tx >= tiles_x || ty >= tiles_y || p + bytes > size)
+			{
+				bad = true;
+				break;
+			}
+
+			unsigned x0 = tx * tile_size, y0 = ty * tile_size;
+			bad = decode_tile(&payload[p], bytes, encoding, frame.data() + y0 * dim.x + x0,
+				(std::min)(tile_size, dim.x - x0), (std::min)(tile_size, dim.y - y0), dim.x) == false;
+			p += bytes;
+		}
+
+		if (bad)
+			break;
+
+		uint8_t ack[8] = { 'A', 'C', 'K', ' ' };
+		put32_at(ack + 4, frame_index);
+		if (send_all(s, ack, 8) == false)
+			break;
+
+		frames++;
+		window_frames++;
+		window_tiles += tiles;
+		window_bytes += size + 16;
+
+		double now = now_ms();
+		if (now - window_start >= 1000.0)
+		{
+			double seconds = (now - window_start) * 0.001;
+			std::cerr << window_frames / seconds << " fps, " << static_cast<double>(window_tiles) / window_frames << " tiles/frame, "
+				<< window_bytes / seconds / 1024.0 << " KiB/s\n";
+			window_start = now;
+			window_frames = window_tiles = window_bytes = 0;
+		}
+	}
+
+	close_socket(s);
+	free_sockets();
+
+	if (bad)
+		std::cerr << "bad frame data\n";
+	std::cerr << frames << " frames received\n";
+
+	if (save_name != nullptr && frames != 0 && capture::write_ppm(save_name, frame.data(), dim) == false)
+	{
+		std::cerr << "can't write " << save_name << '\n';
+		return 2;
+	}
+
+	return bad;
+}
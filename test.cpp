@@ -1,5 +1,9 @@
 #include "EBG.h"
 #include "EBG_3d.h"
+#include "EBG_static_layer.h"
+#ifdef EBG_STREAM
+#include "EBG_stream.h"
+#endif
 
 ebg::basic_engine beta;
 ebg::upoint window_dimension(1920, 1080);
@@ -45,9 +49,18 @@ int WINAPI WinMain(
 	sincos::init(12);
 
 	beta = basic_engine("Test b1 3d", window_dimension, false, 50, window_proc, hInstance, true);
+	// holds the 50 fps on slower machines by drawing at 50% - 100% of the window
+	beta.enable_dynamic_resolution();
 
 	camera cam(M_PI_3, EPSILON, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f }/*, {0.0f, 0.0f, 0.0f}*/);
 
+#ifdef EBG_STREAM
+	// EBG_STREAM = port of the viewer (stream_client)
+	stream::server streamer(window_dimension, EBG_STREAM);
+	beta.frame_sink = stream::sink;
+	beta.frame_sink_data = &streamer;
+#endif
+
 	/*
 	dynamic_mesh cube(8, 12, { 0.0f, 0.0f, 3.0f }, { 0.0f, 0.0f, 0.0f });
 
@@ -122,6 +135,11 @@ int WINAPI WinMain(
 	unk3.bccd.bm = 0.7f;
 	unk3.bccd.bc = 0.0f;
 
+	// landscape & sphere don't change: drawn once while the camera stands still, sun & unk3 every frame
+	compound_mesh* static_meshes[] = { &landscape, &sphere };
+	const uint8_t static_types[] = { tauto, tonly_pos };
+	static_layer statics(static_meshes, static_types, 2);
+
 	sphere_collision_module collision;
 	collision.orianted_position = &sphere.position;
 	collision.radius = 1.0f;
@@ -141,6 +159,11 @@ int WINAPI WinMain(
 	{
 		beta.start_tick();
 
+#ifdef EBG_STATS
+		// hold O for the overdraw heatmap
+		stats::overdraw = beta.keyboard.get_key('o');
+#endif
+
 		/*
 		float some_multipler = beta.delta_time * 0.001f;
 
@@ -157,11 +180,6 @@ int WINAPI WinMain(
 		}
 		*/
 
-		0 >> Surface;
-
-		// (float)0b01111111011111110111111101111111 = very large float number
-		memset(beta.depth_buffer, 0b01111111, Surface.buffer_size << 2);
-
 		/*
 		cube.rotation.rotation += fvec3(0.01f, -0.01f, 0.02f);
 
@@ -212,11 +230,8 @@ int WINAPI WinMain(
 		else if (beta.keyboard.get_key('q'))
 			cam.position.y -= 0.1f;
 
-		landscape.update(&cam);
-		landscape.draw(&cam, &beta);
-
-		sphere.update(&cam, tonly_pos);
-		sphere.draw(&cam, &beta);
+		// clear & landscape + sphere, or their cached pixels
+		statics.draw(&cam, &beta);
 
 		sun.bccd.bc += 0.01f;
 
@@ -241,6 +256,11 @@ int WINAPI WinMain(
 		char* buffer = reinterpret_cast<char*>(data::cb);
 		strcpy_s(buffer, 14, "Performance: ");
 		_itoa_s(beta.udt, buffer + 13, 128, 10);
+#ifdef EBG_STATS
+		size_t title_length = strlen(buffer);
+		buffer[title_length++] = ' ';
+		stats::format(buffer + title_length, data::cb_size - title_length, Surface.dim.x * Surface.dim.y);
+#endif
 		SetWindowTextA(beta.window, buffer);
 
 		// print tick
@@ -252,6 +272,11 @@ int WINAPI WinMain(
 		*/
 	}
 
+	EBG_PROFILE_DUMP("profile_trace.json", "profile_summary.csv");
+
+#ifdef EBG_STREAM
+	streamer.stop();
+#endif
 	delete_basic_engine(&beta);
 	data::free_cb();
 
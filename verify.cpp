@@ -0,0 +1,509 @@
+#include "EBG_scenes.h"
+#include "EBG_capture.h"
+
+#include <string>
+#include <functional>
+
+/*
+Image-diff verification of the renderer over the scripted scenes
+
+verify [options]
+	--capture DIR       render the reference (1 thread, row-major) and save
+	                    DIR/<scene>_<frame>.ppm (colors) & .pfm (depth)
+	--compare DIR       render the configuration below and compare against DIR
+	(neither)           render the reference and every fast path (threads x layout) in memory and compare
+	--frames N          frames sampled along each scene path (default 8)
+	--scene NAME        terrain, teapot or objects (default all)
+	--size WxH          default 640x360
+	--threads N         threads of the compared configuration (default 1)
+	--tiled             compared configuration draws on 8x8 tiles
+	--clear RRGGBB      background of every run (default 000000)
+	--sincos-bits N     sin/cos table resolution of this run (default 12)
+	--sincos M          sin/cos method of this run: table, lerp or poly (default poly)
+	--color-tol N       accepted color channel difference (default 0)
+	--depth-tol X       accepted relative depth error (default 0)
+	--max-mismatch N    accepted pixels over the tolerances per frame (default 0)
+	--diff              with --compare: DIR/<scene>_<frame>_diff.ppm for failing frames
+	--gouraud           every run with gouraud shading
+	--lights            every run with several lights (scenes::set_lights)
+	--textured          every run with the checker texture (scenes::set_texture)
+	--visibility        the fast paths (or the --compare run) deferred through a visibility buffer, against the forward
+	                    reference, exact in every shading mode (with --gouraud, --textured too)
+	--msaa              every run (the reference too) 4x multisampled (EBG_msaa.h), not with --visibility
+	--quantize          the fast paths (or the --compare run) draw 16 bit vertices (compound_mesh::quantize) against the
+	                    float reference, unless set the tolerances are color 4, depth 0.002 & 2% of the pixels
+	                    (vertices move by up to 1/131070 of a mesh's extent, pixels on edges may flip)
+	--rotations         instead of the scenes: rotation_data::update, update_rotations, set(quaternion) & quaternion::rotate
+	                    against double precision euler XYZ matrices, largest element error 1e-5 (poly & lerp sin/cos, the
+	                    table is ~3e-3 off), update_rotations the same matrices as update
+	--split             instead of the scenes: a 300x300 grid as compound_mesh32 against its split_mesh parts
+	                    (same frame at --size), & a compound_mesh that large left empty (index_overflow)
+
+built with EBG_STATS the triangle counters of every frame (stats::counters but the pixel ones, which follow the
+layout's tile tests) must match the reference's too: threads & bands may not count a triangle twice
+
+exit code 0 when everything matches, 1 on a mismatch, 2 on bad options or files
+*/
+
+using namespace ebg;
+using namespace eb3d;
+
+struct render_config
+{
+	unsigned threads;
+	unsigned tile_log2;
+	// through a visibility_buffer
+	bool deferred;
+	// through an msaa_buffer
+	bool multisampled;
+	// background of the frames
+	color_t clear_color;
+};
+
+inline const char* layout_name(unsigned tile_log2)
+{
+	return tile_log2 == 0 ? "row" : "tile8";
+}
+
+std::string frame_name(const std::string& dir, const char* scene, unsigned frame, const char* suffix)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "_%03u", frame);
+	return dir + '/' + scene + name + suffix;
+}
+
+// every frame of the scene with the configuration, on_frame gets the row-major image
+void render_frames(scenes::scene* s, camera* cam, upoint dim, const render_config& config, unsigned frames,
+	const std::function<void(unsigned, const capture::image&)>& on_frame)
+{
+	basic_engine engine(dim, 0, true, config.tile_log2);
+	thread_pool pool(config.threads);
+	visibility_buffer visibility;
+	msaa_buffer msaa;
+	capture::image img;
+
+	for (unsigned i = 0; i < frames; i++)
+	{
+		scenes::render_frame(s, i, frames, cam, &engine, &pool, nullptr, config.deferred ? &visibility : nullptr,
+			config.multisampled ? &msaa : nullptr, config.clear_color);
+		EBG_STATS_FRAME_END(nullptr, 0);
+		capture::grab(&engine.surface, engine.depth_buffer, &img);
+		on_frame(i, img);
+	}
+
+	delete_basic_engine(&engine);
+}
+
+// the grid drawn into a cleared engine, the 32 bit mesh itself or its parts
+template <typename mesh_t>
+void draw_grid(mesh_t** meshes, unsigned mesh_amount, camera* cam, basic_engine* engine, capture::image* img)
+{
+	0 >> engine->surface;
+	memset(engine->depth_buffer, 0b01111111, engine->surface.buffer_size << 2);
+
+	for (unsigned m = 0; m < mesh_amount; m++)
+	{
+		meshes[m]->update(cam);
+		meshes[m]->draw(cam, engine);
+	}
+	capture::grab(&engine->surface, engine->depth_buffer, img);
+}
+
+bool check_split(upoint dim)
+{
+	constexpr unsigned side = 300, vertex_amount = side * side, triangle_amount = (side - 1) * (side - 1) * 2;
+	camera cam(M_PI_3, EPSILON, { 0.0f, 10.0f, -80.0f }, { 0.3f, 0.2f, 0.0f });
+
+	compound_mesh32 grid(vertex_amount, triangle_amount, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f });
+	for (unsigned z = 0; z < side; z++)
+		for (unsigned x = 0; x < side; x++)
+			grid.local_vertices[z * side + x] = vertex_t((float(x) - 150.0f) * 0.5f, sinf(float(x) * 0.2f) * cosf(float(z) * 0.15f) * 2.0f,
+				(float(z) - 150.0f) * 0.5f);
+
+	for (unsigned z = 0, i = 0; z + 1 < side; z++)
+		for (unsigned x = 0; x + 1 < side; x++)
+		{
+			index32_t v = z * side + x;
+			grid.triangles[i++] = { v, v + side, v + 1, 0.0f };
+			grid.triangles[i++] = { v + 1, v + side, v + side + 1, 0.0f };
+		}
+
+	grid.bccd = { 0.7f, 0.0f, 0.5f, 0.5f, -0.2f, 0.5f };
+	grid.setup(&cam);
+
+	std::vector<compound_mesh*> parts = split_mesh(&grid);
+	for (compound_mesh* part : parts)
+		part->setup(&cam);
+
+	basic_engine engine(dim, 0, true);
+	capture::image whole, split;
+	compound_mesh32* whole_mesh = &grid;
+	draw_grid(&whole_mesh, 1, &cam, &engine, &whole);
+	draw_grid(parts.data(), static_cast<unsigned>(parts.size()), &cam, &engine, &split);
+
+	unsigned lit = 0;
+	for (color_t c : whole.colors)
+		lit += c != 0;
+
+	capture::tolerance exact = { 0, 0.0f, 0 };
+	capture::diff_result r = capture::compare(&split, &whole, exact, nullptr);
+
+	// moved & turned, the parts follow the grid
+	fvec3 position = { 5.0f, -3.0f, 10.0f }, rotation = { 0.2f, 0.5f, -0.1f };
+	grid.position = position;
+	grid.rotation->rotation = rotation;
+	place_parts(parts, position, rotation);
+	draw_grid(&whole_mesh, 1, &cam, &engine, &whole);
+	draw_grid(parts.data(), static_cast<unsigned>(parts.size()), &cam, &engine, &split);
+	capture::diff_result moved = capture::compare(&split, &whole, exact, nullptr);
+
+	compound_mesh too_large(vertex_amount, triangle_amount);
+	bool empty = too_large.index_overflow && too_large.vertex_amount == 0 && too_large.triangle_amount == 0;
+
+	bool passed = r.passed(exact) && moved.passed(exact) && lit != 0 && empty;
+	std::cout << (passed ? "ok   " : "FAIL ") << "split " << vertex_amount << " vertices, " << triangle_amount << " triangles into "
+		<< parts.size() << " parts: color " << r.color_mismatches << " px, depth " << r.depth_mismatches << " px of " << lit
+		<< " lit, moved color " << moved.color_mismatches << " px, depth " << moved.depth_mismatches
+		<< " px, 16 bit mesh " << (empty ? "left empty" : "NOT left empty") << '\n';
+
+	for (compound_mesh* part : parts)
+	{
+		delete_compound_mesh(part);
+		delete part;
+	}
+	delete_compound_mesh(&grid);
+	delete_compound_mesh(&too_large);
+	delete_basic_engine(&engine);
+	return passed;
+}
+
+// largest difference of the images of the unit axes under rotate against m (row major, double)
+template <typename rotate_t>
+double axis_error(const double m[9], rotate_t rotate)
+{
+	double error = 0.0;
+	for (unsigned a = 0; a < 3; a++)
+	{
+		fvec3 v = rotate(fvec3(a == 0, a == 1, a == 2));
+		error = (std::max)(error, (std::max)((std::max)(fabs(v.x - m[a]), fabs(v.y - m[3 + a])), fabs(v.z - m[6 + a])));
+	}
+	return error;
+}
+
+bool check_rotations()
+{
+	constexpr unsigned amount = 4096;
+	constexpr double limit = 1e-5;
+
+	// a grid of angles through several turns, the gimbal lock of y & pseudo-random ones
+	std::vector<fvec3> angles;
+	for (float x = -7.0f; x <= 7.0f; x += 1.75f)
+		for (float y : { -static_cast<float>(M_PI_2), -1.0f, 0.0f, 0.5f, static_cast<float>(M_PI_2), 3.0f })
+			for (float z = -7.0f; z <= 7.0f; z += 1.75f)
+				angles.push_back(fvec3(x, y, z));
+	uint32_t seed = 12345;
+	auto unit = [&seed]() { seed = seed * 1664525U + 1013904223U; return static_cast<float>(seed >> 8) / 16777216.0f; };
+	while (angles.size() < amount)
+		angles.push_back(fvec3(unit() - 0.5f, unit() - 0.5f, unit() - 0.5f) * 20.0f);
+
+	std::vector<rotation_data> single(angles.size()), batched(angles.size()), from_quaternion(angles.size());
+	std::vector<rotation_data*> batch(angles.size());
+	for (size_t i = 0; i < angles.size(); i++)
+	{
+		single[i].rotation = batched[i].rotation = from_quaternion[i].rotation = angles[i];
+		batch[i] = &batched[i];
+	}
+	update_rotations(batch.data(), static_cast<unsigned>(batch.size()));
+
+	double update_error = 0.0, batch_error = 0.0, set_error = 0.0, rotate_error = 0.0, compose_error = 0.0;
+	unsigned batch_differences = 0;
+	for (size_t i = 0; i < angles.size(); i++)
+	{
+		// rz * ry * rx
+		double sx = sin(angles[i].x), cx = cos(angles[i].x), sy = sin(angles[i].y), cy = cos(angles[i].y), sz = sin(angles[i].z), cz = cos(angles[i].z);
+		double m[9] = {
+			cz * cy, cz * sy * sx - sz * cx, cz * sy * cx + sz * sx,
+			sz * cy, sz * sy * sx + cz * cx, sz * sy * cx - cz * sx,
+			-sy, cy * sx, cy * cx
+		};
+
+		single[i].update();
+		quaternion q = quaternion::from_euler(angles[i]);
+		from_quaternion[i].set(q);
+
+		batch_differences += memcmp(single[i].c, batched[i].c, sizeof(single[i].c)) != 0;
+		update_error = (std::max)(update_error, axis_error(m, [&](fvec3 v) { return single[i].rotate_vertex(v); }));
+		batch_error = (std::max)(batch_error, axis_error(m, [&](fvec3 v) { return batched[i].rotate_vertex(v); }));
+		set_error = (std::max)(set_error, axis_error(m, [&](fvec3 v) { return from_quaternion[i].rotate_vertex(v); }));
+		rotate_error = (std::max)(rotate_error, axis_error(m, [&](fvec3 v) { return q.rotate(v); }));
+
+		quaternion composed = quaternion::from_axis_angle(fvec3(0.0f, 0.0f, 1.0f), angles[i].z) *
+			quaternion::from_axis_angle(fvec3(0.0f, 1.0f, 0.0f), angles[i].y) * quaternion::from_axis_angle(fvec3(1.0f, 0.0f, 0.0f), angles[i].x);
+		compose_error = (std::max)(compose_error, axis_error(m, [&](fvec3 v) { return composed.rotate(v); }));
+	}
+
+	bool passed = update_error <= limit && batch_error <= limit && set_error <= limit && rotate_error <= limit && compose_error <= limit &&
+		batch_differences == 0;
+	std::cout << (passed ? "ok   " : "FAIL ") << "rotations of " << angles.size() << " euler angles, largest error against double (limit " << limit
+		<< "): update " << update_error << ", update_rotations " << batch_error << ", set(from_euler) " << set_error << ", quaternion::rotate "
+		<< rotate_error << ", from_axis_angle product " << compose_error << ", " << batch_differences << " update_rotations matrices unlike update\n";
+	return passed;
+}
+
+#ifdef EBG_STATS
+inline bool same_triangle_counts(const stats::counters& a, const stats::counters& b)
+{
+	return a.triangles_submitted == b.triangles_submitted && a.backface_rejected == b.backface_rejected && a.near_rejected == b.near_rejected &&
+		a.clipped_to_one == b.clipped_to_one && a.clipped_to_two == b.clipped_to_two && a.triangles_rasterized == b.triangles_rasterized;
+}
+#endif
+
+void print_result(const char* scene, unsigned frame, const render_config& config, const capture::diff_result& r, bool passed)
+{
+	std::cout << (passed ? "ok   " : "FAIL ") << scene << " frame " << frame << ' ' << config.threads << "t " << layout_name(config.tile_log2)
+		<< (config.deferred ? " visibility" : "") << (config.multisampled ? " msaa" : "") << ": color " << r.color_mismatches << " px (max delta " << r.max_color_delta << "), depth "
+		<< r.depth_mismatches << " px (max error " << r.max_depth_error << ')';
+
+	if (r.first.x >= 0)
+		std::cout << ", first at " << r.first.x << ',' << r.first.y;
+	std::cout << '\n';
+}
+
+int main(int argc, char** argv)
+{
+	const char* capture_dir = nullptr, * compare_dir = nullptr, * only_scene = nullptr;
+	unsigned frames = 8, sincos_bits = 12;
+	upoint dim(640, 360);
+	render_config config = { 1, 0, false, false, 0 };
+	capture::tolerance tol = { 0, 0.0f, 0 };
+	bool write_diff = false, gouraud = false, multiple_lights = false, textured = false, deferred = false, multisampled = false, split = false,
+		quantized = false, tolerance_set = false, rotations = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		std::string a = argv[i];
+		bool has_value = i + 1 < argc;
+
+		if (a == "--capture" && has_value)
+			capture_dir = argv[++i];
+		else if (a == "--compare" && has_value)
+			compare_dir = argv[++i];
+		else if (a == "--frames" && has_value)
+			frames = atoi(argv[++i]);
+		else if (a == "--scene" && has_value)
+			only_scene = argv[++i];
+		else if (a == "--size" && has_value && sscanf(argv[i + 1], "%ux%u", &dim.x, &dim.y) == 2)
+			i++;
+		else if (a == "--threads" && has_value)
+			config.threads = atoi(argv[++i]);
+		else if (a == "--tiled")
+			config.tile_log2 = 3;
+		else if (a == "--clear" && has_value)
+			config.clear_color = static_cast<color_t>(strtoul(argv[++i], nullptr, 16));
+		else if (a == "--sincos-bits" && has_value)
+			sincos_bits = atoi(argv[++i]);
+		else if (a == "--sincos" && has_value)
+		{
+			std::string m = argv[++i];
+			if (m == "table")
+				sincos::method = sincos::mtable;
+			else if (m == "lerp")
+				sincos::method = sincos::minterpolated;
+			else if (m == "poly")
+				sincos::method = sincos::mpolynomial;
+			else
+			{
+				std::cerr << "unknown sin/cos method " << m << '\n';
+				return 2;
+			}
+		}
+		else if (a == "--color-tol" && has_value)
+		{
+			tol.color = atoi(argv[++i]);
+			tolerance_set = true;
+		}
+		else if (a == "--depth-tol" && has_value)
+		{
+			tol.depth = static_cast<float>(atof(argv[++i]));
+			tolerance_set = true;
+		}
+		else if (a == "--max-mismatch" && has_value)
+		{
+			tol.mismatches = atoi(argv[++i]);
+			tolerance_set = true;
+		}
+		else if (a == "--diff")
+			write_diff = true;
+		else if (a == "--gouraud")
+			gouraud = true;
+		else if (a == "--lights")
+			multiple_lights = true;
+		else if (a == "--textured")
+			textured = true;
+		else if (a == "--visibility")
+			deferred = true;
+		else if (a == "--msaa")
+			multisampled = true;
+		else if (a == "--split")
+			split = true;
+		else if (a == "--rotations")
+			rotations = true;
+		else if (a == "--quantize")
+			quantized = true;
+		else
+		{
+			std::cerr << "unknown option " << a << '\n';
+			return 2;
+		}
+	}
+
+	if (frames == 0 || config.threads == 0 || dim.x == 0 || dim.y == 0 || (capture_dir != nullptr && compare_dir != nullptr) ||
+		(deferred && multisampled))
+	{
+		std::cerr << "bad options\n";
+		return 2;
+	}
+
+	if (quantized && tolerance_set == false)
+		tol = { 4, 0.002f, dim.x * dim.y / 50 };
+
+	// diff images go next to the references
+	write_diff = write_diff && compare_dir != nullptr;
+
+	data::init();
+	sincos::init(sincos_bits);
+
+	if (split || rotations)
+	{
+		bool passed = split ? check_split(dim) : check_rotations();
+		data::free_cb();
+		return passed == false;
+	}
+
+	// self check: every fast path against the reference
+	std::vector<render_config> configs;
+	if (capture_dir == nullptr && compare_dir == nullptr)
+	{
+		unsigned hardware = (std::max)(std::thread::hardware_concurrency(), 1U);
+		std::vector<unsigned> thread_counts = { 1, 2, 4 };
+		if (std::find(thread_counts.begin(), thread_counts.end(), hardware) == thread_counts.end())
+			thread_counts.push_back(hardware);
+
+		for (unsigned threads : thread_counts)
+			for (unsigned tile_log2 : { 0U, 3U })
+				if (threads != 1 || tile_log2 != 0 || deferred)
+					configs.push_back({ threads, tile_log2, deferred, multisampled, config.clear_color });
+	}
+	else if (compare_dir != nullptr)
+		configs.push_back({ config.threads, config.tile_log2, deferred, multisampled, config.clear_color });
+
+	const render_config reference_config = { 1, 0, false, multisampled, config.clear_color };
+	camera cam(M_PI_3, EPSILON, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f });
+	unsigned failed = 0, io_errors = 0;
+	graphics::texture tex = {};
+	if (textured)
+		tex = scenes::checker_texture();
+
+	for (unsigned si = 0; si < scenes::scene_amount; si++)
+	{
+		if (only_scene != nullptr && strcmp(only_scene, scenes::names[si]) != 0)
+			continue;
+
+		scenes::scene s = scenes::by_name(scenes::names[si], &cam);
+		if (gouraud)
+			scenes::set_shading(&s, graphics::draw::hgouraud);
+		if (multiple_lights)
+			scenes::set_lights(&s);
+		if (textured)
+			scenes::set_texture(&s, &tex);
+		std::vector<capture::image> reference(frames);
+#ifdef EBG_STATS
+		// only when the reference is rendered here
+		std::vector<stats::counters> reference_counts(frames);
+#endif
+
+		if (compare_dir != nullptr)
+		{
+			for (unsigned i = 0; i < frames; i++)
+				if (capture::read_ppm(frame_name(compare_dir, s.name, i, ".ppm").c_str(), &reference[i]) == false ||
+					capture::read_pfm(frame_name(compare_dir, s.name, i, ".pfm").c_str(), &reference[i]) == false ||
+					reference[i].dim != dim)
+				{
+					std::cerr << "missing or different size reference " << frame_name(compare_dir, s.name, i, ".ppm") << '\n';
+					io_errors++;
+				}
+		}
+		else
+			render_frames(&s, &cam, dim, reference_config, frames, [&](unsigned i, const capture::image& img)
+			{
+				reference[i] = img;
+#ifdef EBG_STATS
+				reference_counts[i] = stats::frame;
+#endif
+
+				if (capture_dir != nullptr && capture::write(frame_name(capture_dir, s.name, i, ".ppm").c_str(),
+					frame_name(capture_dir, s.name, i, ".pfm").c_str(), &img) == false)
+				{
+					std::cerr << "can't write " << frame_name(capture_dir, s.name, i, ".ppm") << '\n';
+					io_errors++;
+				}
+			});
+
+		// the reference stays float, the compared runs draw the 16 bit vertices
+		if (quantized)
+		{
+			float error = 0.0f;
+			for (compound_mesh* m : s.meshes)
+				error = (std::max)(error, m->quantize());
+			std::cout << s.name << " quantized, largest vertex error " << error << '\n';
+		}
+
+		if (io_errors == 0)
+			for (const render_config& c : configs)
+				render_frames(&s, &cam, dim, c, frames, [&](unsigned i, const capture::image& img)
+				{
+					std::vector<uint8_t> mask;
+					capture::diff_result r = capture::compare(&img, &reference[i], tol, write_diff ? &mask : nullptr);
+					bool passed = r.passed(tol);
+#ifdef EBG_STATS
+					if (compare_dir == nullptr && same_triangle_counts(stats::frame, reference_counts[i]) == false)
+					{
+						const stats::counters& a = stats::frame, & b = reference_counts[i];
+						std::cout << "FAIL " << s.name << " frame " << i << ' ' << c.threads << "t " << layout_name(c.tile_log2)
+							<< ": triangle counters " << a.triangles_submitted << '/' << a.backface_rejected << '/' << a.near_rejected << '/'
+							<< a.clipped_to_one << '/' << a.clipped_to_two << '/' << a.triangles_rasterized << ", reference " << b.triangles_submitted
+							<< '/' << b.backface_rejected << '/' << b.near_rejected << '/' << b.clipped_to_one << '/' << b.clipped_to_two << '/'
+							<< b.triangles_rasterized << '\n';
+						passed = false;
+					}
+#endif
+
+					failed += passed == false;
+					print_result(s.name, i, c, r, passed);
+
+					if (passed == false && write_diff)
+					{
+						std::vector<color_t> diff;
+						capture::diff_colors(&reference[i], mask, diff);
+						capture::write_ppm(frame_name(compare_dir, s.name, i, "_diff.ppm").c_str(), diff.data(), dim);
+					}
+				});
+
+		scenes::delete_scene(&s);
+	}
+
+	graphics::delete_texture(&tex);
+	data::free_cb();
+
+	if (io_errors != 0)
+		return 2;
+
+	if (capture_dir != nullptr)
+		std::cout << "reference written to " << capture_dir << '\n';
+	else if (failed == 0)
+		std::cout << "all frames match\n";
+	else
+		std::cout << failed << " mismatching frames\n";
+
+	return failed != 0;
+}